@@ -100,3 +100,9 @@ private:
   kj::Array<capnp::word> aligned_buf;
   size_t words_size;
 };
+
+// Reads which() and logMonoTime of the first event in words straight from the capnp
+// stream framing, without building a capnp::FlatArrayMessageReader. Returns false if the
+// message is truncated or not laid out as expected, in which case use the full reader.
+bool scanEvent(kj::ArrayPtr<const capnp::word> words, cereal::Event::Which *which,
+               uint64_t *mono_time, kj::ArrayPtr<const capnp::word> *event_data);
@@ -1,8 +1,11 @@
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 #include <string>
 #include <mutex>
 
+#include <capnp/schema.h>
+
 #include "cereal/services.h"
 #include "cereal/messaging/messaging.h"
 
@@ -201,3 +204,67 @@ int PubMaster::send(const char *name, MessageBuilder &msg) {
 PubMaster::~PubMaster() {
   for (auto s : sockets_) delete s.second;
 }
+
+namespace {
+
+struct EventLayout {
+  uint32_t which_offset;      // in units of uint16_t
+  uint32_t mono_time_offset;  // in units of uint64_t
+};
+
+const EventLayout &eventLayout() {
+  static const EventLayout layout = []() {
+    auto schema = capnp::Schema::from<cereal::Event>().asStruct();
+    return EventLayout{
+      .which_offset = schema.getProto().getStruct().getDiscriminantOffset(),
+      .mono_time_offset = schema.getFieldByName("logMonoTime").getProto().getSlot().getOffset(),
+    };
+  }();
+  return layout;
+}
+
+}  // namespace
+
+bool scanEvent(kj::ArrayPtr<const capnp::word> words, cereal::Event::Which *which,
+               uint64_t *mono_time, kj::ArrayPtr<const capnp::word> *event_data) {
+  // Segment table: (segment count - 1), followed by the size of each segment in words,
+  // all uint32_t, padded to a word boundary.
+  if (words.size() < 1) return false;
+  const uint32_t *table = (const uint32_t *)words.begin();
+  const size_t segment_count = (size_t)table[0] + 1;
+  const size_t table_words = segment_count / 2 + 1;
+  if (segment_count > 512 || table_words > words.size()) return false;
+
+  size_t message_words = table_words;
+  for (size_t i = 0; i < segment_count; ++i) {
+    message_words += table[i + 1];
+  }
+  const size_t first_segment_words = table[1];
+  if (message_words > words.size() || first_segment_words < 1) return false;
+
+  // The root pointer is the first word of the first segment. Anything other than a plain
+  // struct pointer (e.g. a far pointer into another segment) is left to the full reader.
+  const uint8_t *segment = (const uint8_t *)(words.begin() + table_words);
+  uint64_t root;
+  memcpy(&root, segment, sizeof(root));
+  if ((root & 0x3) != 0) return false;
+
+  const int64_t data_start = 1 + ((int32_t)(uint32_t)root >> 2);
+  const size_t data_words = (root >> 32) & 0xffff;
+  const size_t ptr_words = root >> 48;
+  if (data_start < 1 || data_start + data_words + ptr_words > first_segment_words) return false;
+
+  const auto &layout = eventLayout();
+  const size_t which_byte = layout.which_offset * sizeof(uint16_t);
+  const size_t mono_time_byte = layout.mono_time_offset * sizeof(uint64_t);
+  const size_t data_bytes = data_words * sizeof(capnp::word);
+  if (which_byte + sizeof(uint16_t) > data_bytes || mono_time_byte + sizeof(uint64_t) > data_bytes) return false;
+
+  const uint8_t *data_section = segment + data_start * sizeof(capnp::word);
+  uint16_t tag;
+  memcpy(&tag, data_section + which_byte, sizeof(tag));
+  memcpy(mono_time, data_section + mono_time_byte, sizeof(*mono_time));
+  *which = (cereal::Event::Which)tag;
+  *event_data = kj::arrayPtr(words.begin(), message_words);
+  return true;
+}
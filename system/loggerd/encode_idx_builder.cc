@@ -0,0 +1,39 @@
+#include "system/loggerd/encode_idx_builder.h"
+
+#include <cassert>
+#include <cstring>
+
+kj::ArrayPtr<capnp::byte> EncodeIdxBuilder::build(cereal::Event::Reader event, cereal::EncodeIndex::Reader idx) {
+  capnp::AnyStruct::Reader src(idx);
+  if (msg) {
+    auto evt = msg->getRoot<cereal::Event>();
+    capnp::AnyStruct::Builder dst((evt.*get_idx_func)());
+    // the index only has data fields, copying them gives the same bytes as copying the struct
+    auto dst_data = dst.getDataSection();
+    auto src_data = src.getDataSection();
+    if (dst_data.size() == src_data.size() && dst.getPointerSection().size() == 0 && src.getPointerSection().size() == 0) {
+      evt.setLogMonoTime(event.getLogMonoTime());
+      evt.setValid(event.getValid());
+      memcpy(dst_data.begin(), src_data.begin(), src_data.size());
+      return bytes();
+    }
+  }
+
+  // the first frame, or an index of another size: build the message from scratch
+  memset(buffer, 0, sizeof(buffer));
+  msg = std::make_unique<capnp::FlatMessageBuilder>(kj::arrayPtr(buffer + 1, BUFFER_WORDS - 1));
+  auto evt = msg->initRoot<cereal::Event>();
+  evt.setLogMonoTime(event.getLogMonoTime());
+  evt.setValid(event.getValid());
+  (evt.*set_idx_func)(idx);
+  return bytes();
+}
+
+kj::ArrayPtr<capnp::byte> EncodeIdxBuilder::bytes() {
+  auto segments = msg->getSegmentsForOutput();
+  assert(segments.size() == 1);
+  // the same framing as capnp::messageToFlatArray: the segment count minus one and the size of each segment
+  const uint32_t table[2] = {0, (uint32_t)segments[0].size()};
+  memcpy(buffer, table, sizeof(table));
+  return kj::arrayPtr((capnp::byte *)buffer, (segments[0].size() + 1) * sizeof(capnp::word));
+}
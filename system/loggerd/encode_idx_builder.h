@@ -0,0 +1,29 @@
+#pragma once
+
+#include <memory>
+
+#include "cereal/messaging/messaging.h"
+
+// Builds the *EncodeIdx event logged for each *EncodeData frame. The message built for the
+// first frame is kept and patched in place with the log time, validity and index of the next
+// ones, so no message is allocated per frame. The output is the same as building the event
+// with a MessageBuilder and copying the index into it.
+class EncodeIdxBuilder {
+public:
+  typedef void (cereal::Event::Builder::*SetIdxFunc)(cereal::EncodeIndex::Reader);
+  typedef cereal::EncodeIndex::Builder (cereal::Event::Builder::*GetIdxFunc)();
+
+  EncodeIdxBuilder(SetIdxFunc set_func, GetIdxFunc get_func) : set_idx_func(set_func), get_idx_func(get_func) {}
+  // valid until the next call
+  kj::ArrayPtr<capnp::byte> build(cereal::Event::Reader event, cereal::EncodeIndex::Reader idx);
+
+private:
+  kj::ArrayPtr<capnp::byte> bytes();
+
+  static constexpr size_t BUFFER_WORDS = 128;
+  const SetIdxFunc set_idx_func;
+  const GetIdxFunc get_idx_func;
+  // the segment table of the message, followed by its only segment
+  capnp::word buffer[BUFFER_WORDS];
+  std::unique_ptr<capnp::FlatMessageBuilder> msg;
+};
@@ -0,0 +1,242 @@
+#include "system/loggerd/file_writer.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define HAS_IO_URING
+#endif
+
+#include "common/swaglog.h"
+#include "common/util.h"
+
+// O_DIRECT needs block aligned buffers, offsets and sizes
+constexpr size_t DIRECT_IO_ALIGNMENT = 4096;
+
+#ifdef HAS_IO_URING
+
+// A minimal io_uring with one write in flight, set up with the raw syscalls.
+struct AsyncFileWriter::IoUring {
+  static std::unique_ptr<IoUring> create() {
+    io_uring_params params = {};
+    int ring_fd = syscall(__NR_io_uring_setup, 2, &params);
+    if (ring_fd < 0) return nullptr;
+
+    auto ring = std::make_unique<IoUring>();
+    ring->fd = ring_fd;
+    ring->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+      ring->sq_size = ring->cq_size = std::max(ring->sq_size, ring->cq_size);
+    }
+    ring->sq_ptr = mmap(nullptr, ring->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED) return nullptr;
+    ring->cq_ptr = single_mmap ? ring->sq_ptr
+                               : mmap(nullptr, ring->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+    if (ring->cq_ptr == MAP_FAILED) return nullptr;
+    ring->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    ring->sqes = (io_uring_sqe *)mmap(nullptr, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) return nullptr;
+
+    uint8_t *sq = (uint8_t *)ring->sq_ptr, *cq = (uint8_t *)ring->cq_ptr;
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (io_uring_cqe *)(cq + params.cq_off.cqes);
+    return ring;
+  }
+
+  ~IoUring() {
+    if (sqes && sqes != MAP_FAILED) munmap(sqes, sqes_size);
+    if (cq_ptr && cq_ptr != MAP_FAILED && cq_ptr != sq_ptr) munmap(cq_ptr, cq_size);
+    if (sq_ptr && sq_ptr != MAP_FAILED) munmap(sq_ptr, sq_size);
+    if (fd >= 0) ::close(fd);
+  }
+
+  // returns 0 or -errno. on failure the entry is left in the ring, which can't be used again
+  int submit(int file, const struct iovec *iov, uint64_t pos) {
+    const unsigned tail = *sq_tail;
+    const unsigned index = tail & *sq_mask;
+    io_uring_sqe *sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->fd = file;
+    sqe->addr = (uint64_t)iov;
+    sqe->len = 1;
+    sqe->off = pos;
+    sq_array[index] = index;
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    int ret;
+    do {
+      ret = syscall(__NR_io_uring_enter, fd, 1, 0, 0, nullptr, 0);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0) return -errno;
+    return ret == 1 ? 0 : -EAGAIN;
+  }
+
+  // returns the bytes written or -errno
+  int wait() {
+    while (true) {
+      const unsigned head = *cq_head;
+      if (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+        const int res = cqes[head & *cq_mask].res;
+        __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+        return res;
+      }
+      int ret = syscall(__NR_io_uring_enter, fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+      if (ret < 0 && errno != EINTR) return -errno;
+    }
+  }
+
+  int fd = -1;
+  void *sq_ptr = nullptr, *cq_ptr = nullptr;
+  size_t sq_size = 0, cq_size = 0, sqes_size = 0;
+  io_uring_sqe *sqes = nullptr;
+  io_uring_cqe *cqes = nullptr;
+  unsigned *sq_tail, *sq_mask, *sq_array, *cq_head, *cq_tail, *cq_mask;
+};
+
+#else
+
+struct AsyncFileWriter::IoUring {
+  static std::unique_ptr<IoUring> create() { return nullptr; }
+  int submit(int file, const struct iovec *iov, uint64_t pos) { return -ENOSYS; }
+  int wait() { return -ENOSYS; }
+};
+
+#endif
+
+AsyncFileWriter::AsyncFileWriter(const std::string &path, bool direct, bool use_io_uring) : file_path(path) {
+#ifdef O_DIRECT
+  if (direct) {
+    fd = HANDLE_EINTR(open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_DIRECT, 0664));
+    direct_io = fd >= 0;
+    if (fd < 0) LOGW("O_DIRECT not supported for %s: %s", path.c_str(), strerror(errno));
+  }
+#endif
+  if (fd < 0) {
+    fd = HANDLE_EINTR(open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0664));
+  }
+  assert(fd >= 0);
+
+  for (auto &buf : buffers) {
+    int ret = posix_memalign((void **)&buf, DIRECT_IO_ALIGNMENT, FILE_WRITER_BUFFER_SIZE);
+    assert(ret == 0);
+  }
+  if (use_io_uring) {
+    uring = IoUring::create();
+  }
+}
+
+AsyncFileWriter::~AsyncFileWriter() {
+  close();
+  for (auto buf : buffers) free(buf);
+}
+
+int AsyncFileWriter::close() {
+  if (fd < 0) return write_error;
+
+  submit(true);
+  complete();
+  if (direct_io) {
+    // drop the padding of the last block
+    int ret = HANDLE_EINTR(ftruncate(fd, offset));
+    if (ret != 0) {
+      LOGE("ftruncate %s failed: %s", file_path.c_str(), strerror(errno));
+      if (!write_error) write_error = -errno;
+    }
+  }
+  if (::close(fd) != 0 && !write_error) write_error = -errno;
+  fd = -1;
+  uring.reset();
+  return write_error;
+}
+
+bool AsyncFileWriter::write(const void *data, size_t size) {
+  const uint8_t *src = (const uint8_t *)data;
+  while (size > 0) {
+    const size_t n = std::min(size, FILE_WRITER_BUFFER_SIZE - fill);
+    memcpy(buffers[current] + fill, src, n);
+    fill += n;
+    src += n;
+    size -= n;
+    if (fill == FILE_WRITER_BUFFER_SIZE) {
+      submit();
+    }
+  }
+  return write_error == 0;
+}
+
+void AsyncFileWriter::submit(bool last) {
+  // the other buffer is free once its write is done
+  complete();
+  if (fill == 0) return;
+
+  size_t size = fill;
+  if (direct_io) {
+    // only the last write may end in a partial block, padded with zeros
+    size = (fill + DIRECT_IO_ALIGNMENT - 1) / DIRECT_IO_ALIGNMENT * DIRECT_IO_ALIGNMENT;
+    memset(buffers[current] + fill, 0, size - fill);
+  }
+  iov = {.iov_base = buffers[current], .iov_len = size};
+  iov_offset = offset;
+  if (uring) {
+    int ret = uring->submit(fd, &iov, iov_offset);
+    if (ret == 0) {
+      in_flight = true;
+    } else {
+      LOGE("io_uring submit for %s failed, using pwrite: %s", file_path.c_str(), strerror(-ret));
+      uring.reset();
+      writeSync((const uint8_t *)iov.iov_base, size, iov_offset);
+    }
+  } else {
+    writeSync((const uint8_t *)iov.iov_base, size, iov_offset);
+  }
+
+  offset += last ? fill : size;
+  current ^= 1;
+  fill = 0;
+}
+
+void AsyncFileWriter::complete() {
+  if (!in_flight) return;
+
+  in_flight = false;
+  const int res = uring->wait();
+  if (res < 0) {
+    // retry with pwrite, which reports the error if it persists
+    LOGE("io_uring write to %s failed, using pwrite: %s", file_path.c_str(), strerror(-res));
+    uring.reset();
+    writeSync((const uint8_t *)iov.iov_base, iov.iov_len, iov_offset);
+  } else if ((size_t)res < iov.iov_len) {
+    // finish a short write
+    writeSync((const uint8_t *)iov.iov_base + res, iov.iov_len - res, iov_offset + res);
+  }
+}
+
+void AsyncFileWriter::writeSync(const uint8_t *data, size_t size, uint64_t pos) {
+  while (size > 0) {
+    ssize_t n = HANDLE_EINTR(pwrite(fd, data, size, pos));
+    if (n <= 0) {
+      LOGE("write to %s failed: %s", file_path.c_str(), strerror(errno));
+      if (!write_error) write_error = n < 0 ? -errno : -EIO;
+      return;
+    }
+    data += n;
+    size -= n;
+    pos += n;
+  }
+}
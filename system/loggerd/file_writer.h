@@ -0,0 +1,52 @@
+#pragma once
+
+#include <sys/uio.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+const size_t FILE_WRITER_BUFFER_SIZE = 1024 * 1024;
+// O_DIRECT keeps large files that aren't read back out of the page cache
+const bool LOGGERD_DIRECT_IO = getenv("LOGGERD_DIRECT_IO");
+
+// Appends to a file through two aligned buffers: write() fills one while the other is written
+// in the background with io_uring, so a slow write only blocks the caller once both are full.
+// Without io_uring (old kernels, macOS) the full buffers are written with plain pwrite calls.
+class AsyncFileWriter {
+public:
+  AsyncFileWriter(const std::string &path, bool direct = false, bool use_io_uring = true);
+  ~AsyncFileWriter();
+  // returns false once a write has failed. errors of the background write show up on a later call
+  bool write(const void *data, size_t size);
+  // writes the rest and closes the file, returns 0 or the first error as -errno
+  int close();
+  inline int error() const { return write_error; }
+  inline bool ioUring() const { return uring != nullptr; }
+  inline bool direct() const { return direct_io; }
+
+private:
+  struct IoUring;
+  // starts writing the current buffer and switches to the other one
+  void submit(bool last = false);
+  // waits for the write in flight
+  void complete();
+  void writeSync(const uint8_t *data, size_t size, uint64_t pos);
+
+  std::string file_path;
+  int fd = -1;
+  bool direct_io = false;
+  int write_error = 0;
+  std::unique_ptr<IoUring> uring;
+
+  uint8_t *buffers[2] = {};
+  int current = 0;
+  size_t fill = 0;
+  uint64_t offset = 0;  // of the current buffer in the file
+
+  // the write in flight
+  struct iovec iov = {};
+  uint64_t iov_offset = 0;
+  bool in_flight = false;
+};
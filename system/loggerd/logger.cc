@@ -1,5 +1,6 @@
 #include "system/loggerd/logger.h"
 
+#include <cstring>
 #include <fstream>
 #include <map>
 #include <vector>
@@ -113,51 +114,252 @@ std::string logger_get_identifier(std::string key) {
   return util::string_format("%08x--%s", cnt, ss.str().c_str());
 }
 
-static void log_sentinel(LoggerState *log, SentinelType type, int exit_signal = 0) {
-  MessageBuilder msg;
-  auto sen = msg.initEvent().initSentinel();
-  sen.setType(type);
-  sen.setSignal(exit_signal);
-  log->write(msg.toBytes(), true);
+// ***** zstd writer *****
+
+ZstdFileWriter::ZstdFileWriter(const std::string &path, int level, size_t frame_size, double frame_seconds)
+    : level(level), frame_size(frame_size), frame_ms(frame_seconds * 1000), file(path),
+      thread(&ZstdFileWriter::compressThread, this) {
+  frame.reserve(frame_size);
+}
+
+ZstdFileWriter::~ZstdFileWriter() {
+  {
+    std::lock_guard lk(lock);
+    if (!frame.empty()) pending.push_back(std::move(frame));
+    done = true;
+  }
+  cv.notify_one();
+  thread.join();
+
+  // https://github.com/facebook/zstd/blob/dev/contrib/seekable_format/zstd_seekable_compression_format.md
+  auto put32 = [](std::string &out, uint32_t v) {
+    for (int i = 0; i < 4; ++i) out.push_back((char)(v >> (i * 8)));
+  };
+  std::string table;
+  put32(table, 0x184D2A5E);  // skippable frame magic
+  put32(table, seek_table.size() * 8 + 9);
+  for (auto [compressed, decompressed] : seek_table) {
+    put32(table, compressed);
+    put32(table, decompressed);
+  }
+  put32(table, seek_table.size());
+  table.push_back(0);  // no checksums in the table, the frames have their own
+  put32(table, 0x8F92EAB1);  // seekable magic
+  file.write(table.data(), table.size());
+}
+
+void ZstdFileWriter::write(void* data, size_t size) {
+  const double now = millis_since_boot();
+  if (!frame.empty() && (frame.size() + size > frame_size || now - frame_start_ms >= frame_ms)) {
+    std::string next;
+    {
+      std::unique_lock lk(lock);
+      frame_taken.wait(lk, [this]() { return pending.size() < MAX_PENDING_FRAMES; });
+      pending.push_back(std::move(frame));
+      if (!spare.empty()) {
+        next = std::move(spare.front());
+        spare.pop_front();
+      }
+    }
+    cv.notify_one();
+    frame = std::move(next);
+    frame.reserve(frame_size);
+  }
+  if (frame.empty()) frame_start_ms = now;
+  frame.append((const char *)data, size);
 }
 
-LoggerState::LoggerState(const std::string &log_root) {
+void ZstdFileWriter::compressThread() {
+  ZSTD_CCtx *cctx = ZSTD_createCCtx();
+  assert(cctx != nullptr);
+  ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
+  ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 1);
+
+  std::string out;
+  while (true) {
+    std::string in;
+    {
+      std::unique_lock lk(lock);
+      cv.wait(lk, [this]() { return done || !pending.empty(); });
+      if (pending.empty()) break;
+      in = std::move(pending.front());
+      pending.pop_front();
+    }
+    frame_taken.notify_one();
+
+    out.resize(ZSTD_compressBound(in.size()));
+    size_t size = ZSTD_compress2(cctx, out.data(), out.size(), in.data(), in.size());
+    assert(!ZSTD_isError(size));
+    file.write(out.data(), size);
+    seek_table.push_back({(uint32_t)size, (uint32_t)in.size()});
+
+    // hand the buffer back to write()
+    in.clear();
+    std::lock_guard lk(lock);
+    spare.push_back(std::move(in));
+  }
+  ZSTD_freeCCtx(cctx);
+}
+
+LoggerState::LoggerState(const std::string &log_root, size_t buffer_size)
+    : ring(buffer_size), writer(&LoggerState::writerThread, this) {
   route_name = logger_get_identifier("RouteCount");
   route_path = log_root + "/" + route_name;
   init_data = logger_build_init_data();
 }
 
 LoggerState::~LoggerState() {
-  if (rlog) {
-    log_sentinel(this, SentinelType::END_OF_ROUTE, exit_signal);
-    std::remove(lock_file.c_str());
+  close();
+}
+
+void LoggerState::close() {
+  if (closed) return;
+  closed = true;
+
+  if (part >= 0) {
+    writeSentinel(SentinelType::END_OF_ROUTE, exit_signal);
   }
+  {
+    std::lock_guard lk(lock);
+    done = true;
+  }
+  notifyWriter();
+  writer.join();
 }
 
 bool LoggerState::next() {
-  if (rlog) {
-    log_sentinel(this, SentinelType::END_OF_SEGMENT);
-    std::remove(lock_file.c_str());
+  if (part >= 0) {
+    writeSentinel(SentinelType::END_OF_SEGMENT);
   }
+  ring.resetPeak();
 
   segment_path = route_path + "--" + std::to_string(++part);
   bool ret = util::create_directories(segment_path, 0775);
   assert(ret == true);
 
-  const std::string rlog_path = segment_path + "/rlog";
-  lock_file = rlog_path + ".lock";
+  const std::string rlog_path = segment_path + "/rlog.zst";
+  const std::string lock_file = rlog_path + ".lock";
   std::ofstream{lock_file};
 
-  rlog.reset(new RawFile(rlog_path));
-  qlog.reset(new RawFile(segment_path + "/qlog"));
+  {
+    std::lock_guard lk(lock);
+    opened.push_back({.rlog = std::make_unique<ZstdFileWriter>(rlog_path),
+                      .qlog = std::make_unique<ZstdFileWriter>(segment_path + "/qlog.zst"),
+                      .lock_file = lock_file,
+                      .index_file = segment_path + "/rlog.idx"});
+  }
+  push(nullptr, 0, ROTATE);
 
   // log init data & sentinel type.
-  write(init_data.asBytes(), true);
-  log_sentinel(this, part > 0 ? SentinelType::START_OF_SEGMENT : SentinelType::START_OF_ROUTE);
+  push(init_data.begin(), init_data.asBytes().size(), IN_QLOG);
+  writeSentinel(part > 0 ? SentinelType::START_OF_SEGMENT : SentinelType::START_OF_ROUTE);
+  return true;
+}
+
+bool LoggerState::write(uint8_t* data, size_t size, bool in_qlog) {
+  if (!ring.push(data, size, in_qlog ? IN_QLOG : 0)) {
+    ++dropped_msgs;
+    dropped_bytes += size;
+    return false;
+  }
+  notifyWriter();
   return true;
 }
 
-void LoggerState::write(uint8_t* data, size_t size, bool in_qlog) {
-  rlog->write(data, size);
-  if (in_qlog) qlog->write(data, size);
+void LoggerState::push(const void* data, size_t size, uint32_t flags) {
+  assert(sizeof(RingBuffer::Header) + size <= ring.capacity());
+  while (!ring.push(data, size, flags)) {
+    util::sleep_for(1);
+  }
+  notifyWriter();
+}
+
+void LoggerState::notifyWriter() {
+  // pairs with the fence in writerThread(): either the writer sees the new record before it
+  // waits, or we see it waiting and notify under the lock, which it only releases in cv.wait()
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (writer_waiting.load(std::memory_order_relaxed)) {
+    std::lock_guard lk(lock);
+    cv.notify_one();
+  }
+}
+
+void LoggerState::writeSentinel(SentinelType type, int signal) {
+  MessageBuilder msg;
+  auto sen = msg.initEvent().initSentinel();
+  sen.setType(type);
+  sen.setSignal(signal);
+  auto bytes = msg.toBytes();
+  push(bytes.begin(), bytes.size(), IN_QLOG);
+}
+
+// reads the event header from the message framing, the full reader is only a fallback
+static LogIndexEntry index_entry(const uint8_t *data, size_t size, uint64_t offset) {
+  LogIndexEntry entry = {.offset = offset, .size = (uint32_t)size, .which = UINT16_MAX};
+  kj::ArrayPtr<const capnp::word> words((const capnp::word *)data, size / sizeof(capnp::word));
+  cereal::Event::Which which;
+  kj::ArrayPtr<const capnp::word> event_data;
+  if (scanEvent(words, &which, &entry.mono_time, &event_data)) {
+    entry.which = which;
+    return entry;
+  }
+  try {
+    capnp::FlatArrayMessageReader reader(words);
+    auto event = reader.getRoot<cereal::Event>();
+    entry.mono_time = event.getLogMonoTime();
+    entry.which = event.which();
+  } catch (const kj::Exception &e) {
+    LOGE("failed to index event: %s", e.getDescription().cStr());
+  }
+  return entry;
+}
+
+static void write_index(const std::string &path, const std::vector<LogIndexEntry> &index) {
+  LogIndexHeader header = {.version = LOG_INDEX_VERSION, .count = index.size()};
+  memcpy(header.magic, LOG_INDEX_MAGIC, sizeof(header.magic));
+  RawFile file(path);
+  file.write(&header, sizeof(header));
+  file.write((void *)index.data(), index.size() * sizeof(LogIndexEntry));
+}
+
+void LoggerState::writerThread() {
+  Segment current;
+  auto close_segment = [&current]() {
+    if (!current.rlog) return;
+    // the logs are complete once their last frames and seek tables are written
+    current.rlog.reset();
+    current.qlog.reset();
+    write_index(current.index_file, current.index);
+    std::remove(current.lock_file.c_str());
+  };
+
+  while (true) {
+    const RingBuffer::Header *h = ring.front();
+    if (!h) {
+      std::unique_lock lk(lock);
+      writer_waiting.store(true, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      cv.wait(lk, [this]() { return done || ring.front(); });
+      writer_waiting.store(false, std::memory_order_relaxed);
+      if (done && !ring.front()) break;
+      continue;
+    }
+    if (before_write) before_write();
+
+    if (h->flags & ROTATE) {
+      close_segment();
+      std::lock_guard lk(lock);
+      assert(!opened.empty());
+      current = std::move(opened.front());
+      opened.pop_front();
+    } else {
+      assert(current.rlog);
+      current.rlog->write((void *)h->data(), h->size);
+      current.index.push_back(index_entry(h->data(), h->size, current.rlog_size));
+      current.rlog_size += h->size;
+      if (h->flags & IN_QLOG) current.qlog->write((void *)h->data(), h->size);
+    }
+    ring.pop();
+  }
+  close_segment();
 }
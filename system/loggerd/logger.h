@@ -1,54 +1,165 @@
 #pragma once
 
+#include <zstd.h>
+
+#include <atomic>
 #include <cassert>
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include "cereal/messaging/messaging.h"
 #include "common/util.h"
 #include "system/hardware/hw.h"
+#include "system/loggerd/file_writer.h"
+#include "system/loggerd/ring_buffer.h"
 
 class RawFile {
  public:
-  RawFile(const std::string &path) {
-    file = util::safe_fopen(path.c_str(), "wb");
-    assert(file != nullptr);
-  }
+  RawFile(const std::string &path) : file(path) {}
   ~RawFile() {
-    util::safe_fflush(file);
-    int err = fclose(file);
+    int err = file.close();
     assert(err == 0);
   }
   inline void write(void* data, size_t size) {
-    int written = util::safe_fwrite(data, 1, size, file);
-    assert(written == size);
+    bool ok = file.write(data, size);
+    assert(ok);
   }
   inline void write(kj::ArrayPtr<capnp::byte> array) { write(array.begin(), array.size()); }
 
  private:
-  FILE* file = nullptr;
+  AsyncFileWriter file;
+};
+
+const size_t LOG_BUFFER_SIZE = 32 * 1024 * 1024;
+const int LOG_COMPRESSION_LEVEL = 10;  // same as the uploader. little benefit up to level 15
+const size_t LOG_FRAME_SIZE = 4 * 1024 * 1024;
+const double LOG_FRAME_SECONDS = 5;  // frames are also cut by age, the qlog fills them slowly
+
+// Compresses a log into independent zstd frames of up to frame_size input bytes and ends it
+// with a seek table in the zstd seekable format, so readers can start decompressing at any frame.
+// Frames are only cut between writes, so each one starts at a message. A frame is also cut by
+// the first write after it's frame_seconds old, which bounds how much of the log is only in
+// memory, since loggerd writes every log several times a second. write() copies the data,
+// the frames are compressed and written on a worker thread. write() waits for the worker when
+// MAX_PENDING_FRAMES are queued, so a slow disk fills the log buffer instead of memory.
+class ZstdFileWriter {
+public:
+  ZstdFileWriter(const std::string &path, int level = LOG_COMPRESSION_LEVEL, size_t frame_size = LOG_FRAME_SIZE,
+                 double frame_seconds = LOG_FRAME_SECONDS);
+  ~ZstdFileWriter();
+  void write(void* data, size_t size);
+  inline void write(kj::ArrayPtr<capnp::byte> array) { write(array.begin(), array.size()); }
+
+private:
+  void compressThread();
+
+  static constexpr size_t MAX_PENDING_FRAMES = 2;
+  const int level;
+  const size_t frame_size;
+  const double frame_ms;
+  std::string frame;  // the frame being filled
+  double frame_start_ms = 0;
+
+  std::mutex lock;
+  std::condition_variable cv, frame_taken;
+  std::deque<std::string> pending, spare;
+  bool done = false;
+
+  // owned by the compress thread
+  RawFile file;
+  std::vector<std::pair<uint32_t, uint32_t>> seek_table;  // compressed and decompressed size of each frame
+  std::thread thread;
 };
 
 typedef cereal::Sentinel::SentinelType SentinelType;
 
+// Each segment's rlog.idx lists the events in its rlog, so readers can seek into a segment
+// without parsing it first. It's a header followed by one entry per event, written when the
+// segment is closed. Offsets are into the decompressed rlog.
+const char LOG_INDEX_MAGIC[4] = {'R', 'I', 'D', 'X'};
+const uint32_t LOG_INDEX_VERSION = 1;
+
+struct LogIndexHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t count;
+};
+
+struct LogIndexEntry {
+  uint64_t mono_time;
+  uint64_t offset;
+  uint32_t size;
+  uint16_t which;  // cereal::Event::Which
+  uint16_t reserved;
+};
+static_assert(sizeof(LogIndexEntry) == 24);
+
 
+// Messages are copied into a ring buffer by write() and written to the logs by a writer thread,
+// so a slow disk doesn't hold up the caller. Segments are opened by next() and closed by the writer
+// thread once it has written all of their messages.
 class LoggerState {
 public:
-  LoggerState(const std::string& log_root = Path::log_root());
+  LoggerState(const std::string& log_root = Path::log_root(), size_t buffer_size = LOG_BUFFER_SIZE);
   ~LoggerState();
   bool next();
-  void write(uint8_t* data, size_t size, bool in_qlog);
+  // ends the route and waits for the writer thread to write out and close the logs.
+  // nothing can be written after it. called by the destructor if it wasn't called before
+  void close();
+  // returns false if the message was dropped because the buffer is full
+  bool write(uint8_t* data, size_t size, bool in_qlog);
   inline int segment() const { return part; }
   inline const std::string& segmentPath() const { return segment_path; }
   inline const std::string& routeName() const { return route_name; }
-  inline void write(kj::ArrayPtr<kj::byte> bytes, bool in_qlog) { write(bytes.begin(), bytes.size(), in_qlog); }
+  inline bool write(kj::ArrayPtr<kj::byte> bytes, bool in_qlog) { return write(bytes.begin(), bytes.size(), in_qlog); }
   inline void setExitSignal(int signal) { exit_signal = signal; }
 
+  // its peak is reset by next(), so it covers the current segment
+  inline const RingBuffer& buffer() const { return ring; }
+  inline uint64_t droppedMessages() const { return dropped_msgs; }
+  inline uint64_t droppedBytes() const { return dropped_bytes; }
+
 protected:
+  enum RecordFlags : uint32_t {
+    IN_QLOG = 1,
+    ROTATE = 2,  // continue in the next opened segment
+  };
+  struct Segment {
+    std::unique_ptr<ZstdFileWriter> rlog, qlog;
+    std::string lock_file, index_file;
+    std::vector<LogIndexEntry> index;
+    uint64_t rlog_size = 0;  // decompressed
+  };
+  // waits for space instead of dropping
+  void push(const void* data, size_t size, uint32_t flags);
+  void writeSentinel(SentinelType type, int signal = 0);
+  // call after pushing a record or setting done
+  void notifyWriter();
+  void writerThread();
+
   int part = -1, exit_signal = 0;
-  std::string route_path, route_name, segment_path, lock_file;
+  std::string route_path, route_name, segment_path;
   kj::Array<capnp::word> init_data;
-  std::unique_ptr<RawFile> rlog, qlog;
+  uint64_t dropped_msgs = 0, dropped_bytes = 0;
+
+  RingBuffer ring;
+  std::mutex lock;
+  std::condition_variable cv;
+  std::deque<Segment> opened;  // by next(), waiting for their ROTATE record
+  bool done = false;
+  std::atomic<bool> writer_waiting = false;  // set under lock while the writer waits on cv
+  std::thread writer;
+  bool closed = false;
+
+  // for tests: run by the writer thread before it writes each record
+  std::function<void()> before_write;
 };
 
 kj::Array<capnp::word> logger_build_init_data();
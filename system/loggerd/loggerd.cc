@@ -7,6 +7,7 @@
 #include <vector>
 
 #include "common/params.h"
+#include "system/loggerd/encode_idx_builder.h"
 #include "system/loggerd/encoder/encoder.h"
 #include "system/loggerd/loggerd.h"
 #include "system/loggerd/video_writer.h"
@@ -15,17 +16,34 @@ ExitHandler do_exit;
 
 struct LoggerdState {
   LoggerState logger;
+  uint64_t dropped_msgs = 0;  // as of the last rotation
   std::atomic<double> last_camera_seen_tms{0.0};
   std::atomic<int> ready_to_rotate{0};  // count of encoders ready to rotate
   int max_waiting = 0;
   double last_rotate_tms = 0.;      // last rotate time in ms
+  double rotate_pause_ms = 0.;      // spent rotating to the current segment and opening its videos
 };
 
+void log_rotate_pause(LoggerdState *s) {
+  LOGW("rotation to %s paused logging for %.2f ms", s->logger.segmentPath().c_str(), s->rotate_pause_ms);
+}
+
 void logger_rotate(LoggerdState *s) {
+  const double start_tms = millis_since_boot();
+  if (s->logger.segment() >= 0) {
+    log_rotate_pause(s);
+  }
+  if (uint64_t dropped = s->logger.droppedMessages() - s->dropped_msgs) {
+    const RingBuffer &buf = s->logger.buffer();
+    LOGE("dropped %" PRIu64 " messages in %s, log buffer peaked at %.1f%%",
+         dropped, s->logger.segmentPath().c_str(), buf.peakUsed() * 100.0 / buf.capacity());
+    s->dropped_msgs = s->logger.droppedMessages();
+  }
   bool ret =s->logger.next();
   assert(ret);
   s->ready_to_rotate = 0;
   s->last_rotate_tms = millis_since_boot();
+  s->rotate_pause_ms = s->last_rotate_tms - start_tms;
   LOGW((s->logger.segment() == 0) ? "logging to %s" : "rotated to %s", s->logger.segmentPath().c_str());
 }
 
@@ -55,6 +73,7 @@ void rotate_if_needed(LoggerdState *s) {
 
 struct RemoteEncoder {
   std::unique_ptr<VideoWriter> writer;
+  std::unique_ptr<EncodeIdxBuilder> idx_builder;
   int encoderd_segment_offset;
   int current_segment = -1;
   std::vector<Message *> q;
@@ -88,8 +107,10 @@ int handle_encoder_msg(LoggerdState *s, Message *msg, std::string &name, struct
     // if this is a new segment, we close any possible old segments, move to the new, and process any queued packets
     if (re.current_segment != s->logger.segment()) {
       if (re.recording) {
+        const double start_tms = millis_since_boot();
         re.writer.reset();
         re.recording = false;
+        s->rotate_pause_ms += millis_since_boot() - start_tms;
       }
       re.current_segment = s->logger.segment();
       re.marked_ready_to_rotate = false;
@@ -114,12 +135,14 @@ int handle_encoder_msg(LoggerdState *s, Message *msg, std::string &name, struct
         // if we aren't actually recording, don't create the writer
         if (encoder_info.record) {
           assert(encoder_info.filename != NULL);
+          const double start_tms = millis_since_boot();
           re.writer.reset(new VideoWriter(s->logger.segmentPath().c_str(),
             encoder_info.filename, idx.getType() != cereal::EncodeIndex::Type::FULL_H_E_V_C,
             edata.getWidth(), edata.getHeight(), encoder_info.fps, idx.getType()));
           // write the header
           auto header = edata.getHeader();
           re.writer->write((uint8_t *)header.begin(), header.size(), idx.getTimestampEof()/1000, true, false);
+          s->rotate_pause_ms += millis_since_boot() - start_tms;
         }
         re.recording = true;
       } else {
@@ -141,11 +164,10 @@ int handle_encoder_msg(LoggerdState *s, Message *msg, std::string &name, struct
     }
 
     // put it in log stream as the idx packet
-    MessageBuilder bmsg;
-    auto evt = bmsg.initEvent(event.getValid());
-    evt.setLogMonoTime(event.getLogMonoTime());
-    (evt.*(encoder_info.set_encode_idx_func))(idx);
-    auto new_msg = bmsg.toBytes();
+    if (!re.idx_builder) {
+      re.idx_builder = std::make_unique<EncodeIdxBuilder>(encoder_info.set_encode_idx_func, encoder_info.get_encode_idx_func);
+    }
+    auto new_msg = re.idx_builder->build(event, idx);
     s->logger.write((uint8_t *)new_msg.begin(), new_msg.size(), true);   // always in qlog?
     bytes_count += new_msg.size();
 
@@ -272,7 +294,11 @@ void loggerd_thread() {
 
         if ((++msg_count % 1000) == 0) {
           double seconds = (millis_since_boot() - start_ts) / 1000.0;
-          LOGD("%" PRIu64 " messages, %.2f msg/sec, %.2f KB/sec", msg_count, msg_count / seconds, bytes_count * 0.001 / seconds);
+          const RingBuffer &buf = s.logger.buffer();
+          LOGD("%" PRIu64 " messages, %.2f msg/sec, %.2f KB/sec, buffer %.1f%% full (peak %.1f%%), dropped %" PRIu64 " messages (%" PRIu64 " bytes)",
+               msg_count, msg_count / seconds, bytes_count * 0.001 / seconds,
+               buf.used() * 100.0 / buf.capacity(), buf.peakUsed() * 100.0 / buf.capacity(),
+               s.logger.droppedMessages(), s.logger.droppedBytes());
         }
 
         count++;
@@ -284,8 +310,13 @@ void loggerd_thread() {
     }
   }
 
+  if (s.logger.segment() >= 0) {
+    log_rotate_pause(&s);
+  }
   LOGW("closing logger");
   s.logger.setExitSignal(do_exit.signal);
+  // write out everything buffered in memory before syncing
+  s.logger.close();
 
   if (do_exit.power_failure) {
     LOGE("power failure");
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+// A preallocated single-producer single-consumer ring of variable-size records. Each record
+// is stored contiguously behind an 8 byte header, a record that would wrap around is moved to
+// the start of the buffer. push() never blocks, it fails if the record doesn't fit yet.
+class RingBuffer {
+public:
+  struct Header {
+    uint32_t size;
+    uint32_t flags;
+    inline const uint8_t *data() const { return (const uint8_t *)(this + 1); }
+  };
+
+  RingBuffer(size_t capacity) : buf_size(align(capacity)), buf(new uint8_t[buf_size]) {}
+
+  // producer
+  bool push(const void *data, size_t size, uint32_t flags) {
+    assert(size <= UINT32_MAX && !(flags & PADDING));
+    const uint64_t record = sizeof(Header) + align(size);
+    uint64_t head = write_pos.load(std::memory_order_relaxed);
+    uint64_t avail = buf_size - (head - read_pos.load(std::memory_order_acquire));
+    const uint64_t pos = head % buf_size;
+    if (pos + record > buf_size) {
+      // skip to the start, even if the record doesn't fit there yet
+      const uint64_t padding = buf_size - pos;
+      if (padding > avail) return false;
+      *(Header *)(buf.get() + pos) = {.size = 0, .flags = PADDING};
+      head += padding;
+      avail -= padding;
+      write_pos.store(head, std::memory_order_release);
+    }
+    if (record > avail) return false;
+
+    Header *h = (Header *)(buf.get() + head % buf_size);
+    *h = {.size = (uint32_t)size, .flags = flags};
+    memcpy(h + 1, data, size);
+    head += record;
+    write_pos.store(head, std::memory_order_release);
+
+    const uint64_t fill = head - read_pos.load(std::memory_order_relaxed);
+    if (fill > peak_used.load(std::memory_order_relaxed)) {
+      peak_used.store(fill, std::memory_order_relaxed);
+    }
+    return true;
+  }
+
+  // producer: starts a new peak from the current fill level
+  void resetPeak() { peak_used.store(used(), std::memory_order_relaxed); }
+
+  // consumer: the oldest record, or nullptr if the buffer is empty
+  const Header *front() {
+    uint64_t tail = read_pos.load(std::memory_order_relaxed);
+    while (tail != write_pos.load(std::memory_order_acquire)) {
+      const Header *h = (const Header *)(buf.get() + tail % buf_size);
+      if (!(h->flags & PADDING)) return h;
+      tail += buf_size - tail % buf_size;
+      read_pos.store(tail, std::memory_order_release);
+    }
+    return nullptr;
+  }
+  void pop() {
+    const Header *h = front();
+    assert(h != nullptr);
+    read_pos.store(read_pos.load(std::memory_order_relaxed) + sizeof(Header) + align(h->size), std::memory_order_release);
+  }
+
+  // fill level, readable from any thread
+  inline size_t capacity() const { return buf_size; }
+  inline size_t used() const { return write_pos.load(std::memory_order_relaxed) - read_pos.load(std::memory_order_relaxed); }
+  inline size_t peakUsed() const { return peak_used.load(std::memory_order_relaxed); }
+
+private:
+  static constexpr uint32_t PADDING = 1u << 31;
+  static inline uint64_t align(uint64_t size) { return (size + 7) & ~7ull; }
+
+  const size_t buf_size;
+  std::unique_ptr<uint8_t[]> buf;
+  // total bytes pushed and popped
+  std::atomic<uint64_t> write_pos = 0;
+  std::atomic<uint64_t> read_pos = 0;
+  std::atomic<uint64_t> peak_used = 0;
+};
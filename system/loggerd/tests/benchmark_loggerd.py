@@ -0,0 +1,171 @@
+#!/usr/bin/env python3
+import argparse
+import os
+import re
+import signal
+import struct
+import subprocess
+import tempfile
+import time
+from dataclasses import dataclass, field
+from pathlib import Path
+
+import cereal.messaging as messaging
+from cereal import log
+from cereal.services import SERVICE_LIST
+from openpilot.common.basedir import BASEDIR
+from openpilot.common.prefix import OpenpilotPrefix
+
+# Publishes synthetic messages at the rates in cereal/services.py, times a multiplier, and runs
+# loggerd against a temporary log root. Encoded video is faked at the real frame rate and bitrate,
+# so segments rotate like on a device and no GPU or encoderd is needed.
+
+LOGGERD = os.path.join(BASEDIR, "system/loggerd/loggerd")
+FPS = 20
+V4L2_BUF_FLAG_KEYFRAME = 8
+# publish name, encode type, frame size, bytes per frame
+ENCODERS = [
+  ("roadEncodeData", "fullHEVC", (1928, 1208), 10_000_000 // 8 // FPS),
+  ("wideRoadEncodeData", "fullHEVC", (1928, 1208), 10_000_000 // 8 // FPS),
+  ("driverEncodeData", "fullHEVC", (1928, 1208), 10_000_000 // 8 // FPS),
+  ("qRoadEncodeData", "qcameraH264", (526, 330), 256_000 // 8 // FPS),
+]
+# header, entries are (mono_time, offset, size, which, reserved). see logger.h
+LOG_INDEX_HEADER = struct.Struct("<4sIQ")
+LOG_INDEX_ENTRY = struct.Struct("<QQIHH")
+LOG_INDEX_EVENTS_PER_SEGMENT = 3  # initData and two sentinels
+
+PAUSE_RE = re.compile(r"rotation to (\S+) paused logging for ([\d.]+) ms")
+
+
+@dataclass
+class BenchmarkResult:
+  duration: float = 0.
+  sent_msgs: int = 0
+  sent_bytes: int = 0
+  logged_msgs: int = 0
+  cpu_time: float = 0.
+  segments: int = 0
+  rotation_pauses: list[float] = field(default_factory=list)
+
+  @property
+  def dropped_msgs(self) -> int:
+    return self.sent_msgs - self.logged_msgs
+
+
+def log_services() -> list[str]:
+  return [s for s in log.Event.schema.union_fields if s in SERVICE_LIST and SERVICE_LIST[s].should_log and SERVICE_LIST[s].frequency > 0
+          and not s.endswith("EncodeData")]
+
+
+def build_message(service: str) -> bytes:
+  try:
+    return messaging.new_message(service).to_bytes()
+  except Exception:
+    return messaging.new_message(service, 10).to_bytes()
+
+
+def build_encode_message(service: str, encode_type: str, frame_size: tuple[int, int], payload: bytes, frame: int, segment_length: int) -> bytes:
+  frames_per_segment = FPS * segment_length
+  keyframe = frame % frames_per_segment == 0
+  msg = messaging.new_message(service)
+  edata = getattr(msg, service)
+  edata.idx.frameId = frame
+  edata.idx.type = encode_type
+  edata.idx.encodeId = frame
+  edata.idx.segmentNum = frame // frames_per_segment
+  edata.idx.segmentId = frame % frames_per_segment
+  edata.idx.segmentIdEncode = frame % frames_per_segment
+  edata.idx.timestampEof = int(frame * 1e9 / FPS)
+  edata.idx.flags = V4L2_BUF_FLAG_KEYFRAME if keyframe else 0
+  edata.idx.len = len(payload)
+  edata.width, edata.height = frame_size
+  if keyframe:
+    edata.header = payload[:64]
+  edata.data = payload
+  return msg.to_bytes()
+
+
+def count_logged_messages(log_root: str) -> tuple[int, int]:
+  # from the event index next to each rlog
+  segments, msgs = 0, 0
+  for idx in sorted(Path(log_root).glob("*/rlog.idx")):
+    magic, _, count = LOG_INDEX_HEADER.unpack_from(idx.read_bytes())
+    assert magic == b"RIDX", f"bad index {idx}"
+    segments += 1
+    msgs += count - LOG_INDEX_EVENTS_PER_SEGMENT
+  return segments, msgs
+
+
+def run_benchmark(duration: int, segment_length: int, multiplier: float = 1., log_root: str | None = None) -> BenchmarkResult:
+  # logs go to log_root if given, so they can be checked afterwards, else to a temporary directory
+  # only whole segments, so no encoder packets are left waiting for a rotation at the end
+  duration = max(1, duration // segment_length) * segment_length
+  services = log_services()
+  messages = {s: build_message(s) for s in services}
+  rates = {s: SERVICE_LIST[s].frequency * multiplier for s in services}
+  # the start of an H.264 access unit, so the qcamera muxer accepts the frames
+  payloads = {s: b"\x00\x00\x00\x01\x09" + os.urandom(size - 5) for s, _, _, size in ENCODERS}
+  pm = messaging.PubMaster(services + [e[0] for e in ENCODERS])
+
+  result = BenchmarkResult()
+  with tempfile.TemporaryDirectory() as tmp_root, tempfile.TemporaryFile("w+") as output:
+    log_root = log_root or tmp_root
+    env = {**os.environ, "LOG_ROOT": log_root, "LOGGERD_TEST": "1", "LOGGERD_SEGMENT_LENGTH": str(segment_length)}
+    proc = subprocess.Popen([LOGGERD], cwd=os.path.dirname(LOGGERD), env=env, stdout=output, stderr=subprocess.STDOUT)
+    for s in pm.sock:
+      assert pm.wait_for_readers_to_update(s, timeout=10), f"loggerd didn't subscribe to {s}"
+
+    sent = dict.fromkeys(services, 0)
+    frame = 0
+    start = time.monotonic()
+    while (t := time.monotonic() - start) < duration:
+      for s in services:
+        while sent[s] < int(t * rates[s]):
+          pm.send(s, messages[s])
+          sent[s] += 1
+          result.sent_bytes += len(messages[s])
+      while frame < int(t * FPS):
+        for s, encode_type, frame_size, _ in ENCODERS:
+          dat = build_encode_message(s, encode_type, frame_size, payloads[s], frame, segment_length)
+          pm.send(s, dat)
+          result.sent_msgs += 1
+          result.sent_bytes += len(dat)
+        frame += 1
+      time.sleep(0.001)
+    result.sent_msgs += sum(sent.values())
+
+    for s in pm.sock:
+      pm.wait_for_readers_to_update(s, timeout=10, dt=0.01)
+    proc.send_signal(signal.SIGINT)
+    _, status, rusage = os.wait4(proc.pid, 0)
+    proc.returncode = os.waitstatus_to_exitcode(status)
+    result.duration = time.monotonic() - start
+    result.cpu_time = rusage.ru_utime + rusage.ru_stime
+    assert proc.returncode == 0, f"loggerd exited with {proc.returncode}"
+
+    output.seek(0)
+    result.rotation_pauses = [float(m.group(2)) for m in PAUSE_RE.finditer(output.read())]
+    result.segments, result.logged_msgs = count_logged_messages(log_root)
+  return result
+
+
+def print_result(r: BenchmarkResult, multiplier: float) -> None:
+  print(f"loggerd at {multiplier:g}x the services.py rates for {r.duration:.1f}s, {r.segments} segments")
+  print(f"  sent:     {r.sent_msgs / r.duration:.0f} msgs/s, {r.sent_bytes / r.duration / 1e6:.2f} MB/s")
+  print(f"  logged:   {r.logged_msgs} of {r.sent_msgs} messages, dropped {r.dropped_msgs}")
+  print(f"  cpu:      {r.cpu_time:.2f}s, {r.cpu_time / r.duration * 100:.1f}% of one core")
+  if r.rotation_pauses:
+    pauses = sorted(r.rotation_pauses)
+    print(f"  rotation: paused logging for max {pauses[-1]:.2f} ms, median {pauses[len(pauses) // 2]:.2f} ms")
+
+
+if __name__ == "__main__":
+  parser = argparse.ArgumentParser(description="Benchmark loggerd with a synthetic load")
+  parser.add_argument("--duration", type=int, default=60, help="seconds, rounded down to whole segments")
+  parser.add_argument("--segment-length", type=int, default=10, help="seconds")
+  parser.add_argument("--multiplier", type=float, default=1., help="scales the rate of every service except the cameras")
+  args = parser.parse_args()
+
+  with OpenpilotPrefix():
+    print_result(run_benchmark(args.duration, args.segment_length, args.multiplier), args.multiplier)
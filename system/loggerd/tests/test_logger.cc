@@ -1,17 +1,59 @@
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <random>
+#include <thread>
+
 #include "catch2/catch.hpp"
+#include "common/timing.h"
+#include "system/loggerd/encode_idx_builder.h"
+#include "system/loggerd/file_writer.h"
 #include "system/loggerd/logger.h"
+#include "system/loggerd/ring_buffer.h"
 
 typedef cereal::Sentinel::SentinelType SentinelType;
 
+static uint32_t read_u32(const std::string &s, size_t pos) {
+  uint32_t v;
+  memcpy(&v, s.data() + pos, sizeof(v));
+  return v;
+}
+
+// decompresses a seekable zstd file frame by frame, using its seek table
+std::string decompress_seekable(const std::string &file, std::vector<std::string> *frames = nullptr) {
+  REQUIRE(file.size() >= 17);
+  REQUIRE(read_u32(file, file.size() - 4) == 0x8F92EAB1);
+  const uint32_t num_frames = read_u32(file, file.size() - 9);
+  const size_t table_pos = file.size() - (num_frames * 8 + 9) - 8;
+  REQUIRE(read_u32(file, table_pos) == 0x184D2A5E);
+  REQUIRE(read_u32(file, table_pos + 4) == num_frames * 8 + 9);
+
+  std::string result;
+  size_t pos = 0;
+  for (uint32_t i = 0; i < num_frames; ++i) {
+    const uint32_t compressed = read_u32(file, table_pos + 8 + i * 8);
+    std::string frame(read_u32(file, table_pos + 12 + i * 8), '\0');
+    REQUIRE(ZSTD_decompress(frame.data(), frame.size(), file.data() + pos, compressed) == frame.size());
+    result += frame;
+    if (frames) frames->push_back(frame);
+    pos += compressed;
+  }
+  REQUIRE(pos == table_pos);
+  return result;
+}
+
 void verify_segment(const std::string &route_path, int segment, int max_segment, int required_event_cnt) {
   const std::string segment_path = route_path + "--" + std::to_string(segment);
   SentinelType begin_sentinel = segment == 0 ? SentinelType::START_OF_ROUTE : SentinelType::START_OF_SEGMENT;
   SentinelType end_sentinel = segment == max_segment - 1 ? SentinelType::END_OF_ROUTE : SentinelType::END_OF_SEGMENT;
 
-  REQUIRE(!util::file_exists(segment_path + "/rlog.lock"));
-  for (const char *fn : {"/rlog", "/qlog"}) {
+  REQUIRE(!util::file_exists(segment_path + "/rlog.zst.lock"));
+  for (const char *fn : {"/rlog.zst", "/qlog.zst"}) {
     const std::string log_file = segment_path + fn;
-    std::string log = util::read_file(log_file);
+    std::string log = decompress_seekable(util::read_file(log_file));
     REQUIRE(!log.empty());
     int event_cnt = 0, i = 0;
     kj::ArrayPtr<const capnp::word> words((capnp::word *)log.data(), log.size() / sizeof(capnp::word));
@@ -62,7 +104,7 @@ TEST_CASE("logger") {
     route_name = logger.routeName();
     for (int i = 0; i < segment_cnt; ++i) {
       REQUIRE(logger.next());
-      REQUIRE(util::file_exists(logger.segmentPath() + "/rlog.lock"));
+      REQUIRE(util::file_exists(logger.segmentPath() + "/rlog.zst.lock"));
       REQUIRE(logger.segment() == i);
       write_msg(&logger);
     }
@@ -72,3 +114,481 @@ TEST_CASE("logger") {
     verify_segment(log_root + "/" + route_name, i, segment_cnt, 1);
   }
 }
+
+TEST_CASE("RingBuffer with a slow reader") {
+  RingBuffer ring(16 * 1024);
+  const int count = 2000;
+  std::atomic<bool> done = false;
+  bool valid = true;
+  std::vector<uint32_t> received;
+  uint64_t received_bytes = 0;
+
+  // the reader stalls now and then, like a disk during an fsync. Catch isn't thread safe, so
+  // it only records what it read
+  std::thread reader([&]() {
+    while (true) {
+      const RingBuffer::Header *h = ring.front();
+      if (!h) {
+        if (done) break;
+        std::this_thread::yield();
+        continue;
+      }
+      uint32_t seq;
+      memcpy(&seq, h->data(), sizeof(seq));
+      valid = valid && h->flags == seq % 3 && h->size == 4 + seq % 1000;
+      for (size_t i = 4; i < h->size; ++i) valid = valid && h->data()[i] == (uint8_t)seq;
+      received.push_back(seq);
+      received_bytes += h->size;
+      ring.pop();
+      if (received.size() % 10 == 0) util::sleep_for(5);
+    }
+  });
+
+  uint64_t pushed = 0, pushed_bytes = 0;
+  for (uint32_t seq = 0; seq < count; ++seq) {
+    std::string msg(4 + seq % 1000, (char)seq);
+    memcpy(msg.data(), &seq, sizeof(seq));
+    if (ring.push(msg.data(), msg.size(), seq % 3)) {
+      ++pushed;
+      pushed_bytes += msg.size();
+    }
+    REQUIRE(ring.used() <= ring.capacity());
+    if (seq % 100 == 0) util::sleep_for(1);
+  }
+  done = true;
+  reader.join();
+
+  REQUIRE(valid);
+  REQUIRE(pushed < count);
+  REQUIRE(received.size() == pushed);
+  REQUIRE(received_bytes == pushed_bytes);
+  REQUIRE(std::is_sorted(received.begin(), received.end()));
+  REQUIRE(ring.used() == 0);
+  REQUIRE(ring.peakUsed() <= ring.capacity());
+  REQUIRE(ring.peakUsed() > ring.capacity() / 2);
+
+  ring.resetPeak();
+  REQUIRE(ring.peakUsed() == 0);
+  REQUIRE(ring.push("x", 1, 0));
+  REQUIRE(ring.peakUsed() == sizeof(RingBuffer::Header) + 8);
+}
+
+TEST_CASE("logger with a full buffer") {
+  const std::string log_root = "/tmp/test_logger_full_buffer";
+  system(("rm " + log_root + " -rf").c_str());
+  std::string segment_path;
+  uint64_t written = 0, dropped = 0;
+  {
+    // just large enough for the init data
+    LoggerState logger(log_root, logger_build_init_data().asBytes().size() + 64 * 1024);
+    REQUIRE(logger.next());
+    segment_path = logger.segmentPath();
+    for (int i = 0; i < 20000; ++i) {
+      MessageBuilder msg;
+      msg.initEvent().initClocks().setWallTimeNanos(i);
+      if (logger.write(msg.toBytes(), i % 10 == 0)) {
+        ++written;
+      } else {
+        ++dropped;
+      }
+    }
+    REQUIRE(logger.droppedMessages() == dropped);
+    REQUIRE(logger.buffer().peakUsed() <= logger.buffer().capacity());
+  }
+
+  // the log holds the messages that weren't dropped, in order, between the sentinels
+  std::string log = decompress_seekable(util::read_file(segment_path + "/rlog.zst"));
+  kj::ArrayPtr<const capnp::word> words((capnp::word *)log.data(), log.size() / sizeof(capnp::word));
+  std::vector<cereal::Event::Which> types;
+  int64_t last_time = -1;
+  while (words.size() > 0) {
+    capnp::FlatArrayMessageReader reader(words);
+    auto event = reader.getRoot<cereal::Event>();
+    if (event.which() == cereal::Event::CLOCKS) {
+      REQUIRE((int64_t)event.getClocks().getWallTimeNanos() > last_time);
+      last_time = event.getClocks().getWallTimeNanos();
+    }
+    types.push_back(event.which());
+    words = kj::arrayPtr(reader.getEnd(), words.end());
+  }
+  REQUIRE(types.size() == written + 3);
+  REQUIRE(types.front() == cereal::Event::INIT_DATA);
+  REQUIRE(types[1] == cereal::Event::SENTINEL);
+  REQUIRE(types.back() == cereal::Event::SENTINEL);
+}
+
+TEST_CASE("logger with a stalled writer") {
+  // the writer thread stalls before each record until it's let go, like on a slow disk
+  struct StalledLogger : public LoggerState {
+    StalledLogger(const std::string &log_root, size_t buffer_size) : LoggerState(log_root, buffer_size) {
+      before_write = [this]() {
+        while (stalled) util::sleep_for(1);
+      };
+    }
+    ~StalledLogger() {
+      stalled = false;
+      close();
+    }
+    std::atomic<bool> stalled = true;
+  };
+
+  const std::string log_root = "/tmp/test_logger_stalled";
+  system(("rm " + log_root + " -rf").c_str());
+  std::string route_name;
+  uint64_t written = 0, dropped = 0;
+  {
+    StalledLogger logger(log_root, logger_build_init_data().asBytes().size() + 64 * 1024);
+    route_name = logger.routeName();
+    REQUIRE(logger.next());
+    for (int i = 0; i < 5000; ++i) {
+      MessageBuilder msg;
+      msg.initEvent().initClocks();
+      if (logger.write(msg.toBytes(), true)) {
+        ++written;
+      } else {
+        ++dropped;
+      }
+    }
+    REQUIRE(written > 0);
+    REQUIRE(dropped > 0);
+    REQUIRE(logger.droppedMessages() == dropped);
+
+    // rotating waits for space in the buffer instead of dropping the sentinels
+    std::thread release([&logger]() {
+      util::sleep_for(200);
+      logger.stalled = false;
+    });
+    const double start = millis_since_boot();
+    REQUIRE(logger.next());
+    REQUIRE(millis_since_boot() - start >= 150);
+    release.join();
+    REQUIRE(logger.segment() == 1);
+    logger.setExitSignal(1);
+  }
+  verify_segment(log_root + "/" + route_name, 0, 2, written);
+  verify_segment(log_root + "/" + route_name, 1, 2, 0);
+}
+
+TEST_CASE("logger event index") {
+  const std::string log_root = "/tmp/test_logger_index";
+  system(("rm " + log_root + " -rf").c_str());
+  std::vector<std::string> segments;
+  {
+    LoggerState logger(log_root);
+    for (int i = 0; i < 3; ++i) {
+      REQUIRE(logger.next());
+      REQUIRE(!util::file_exists(logger.segmentPath() + "/rlog.idx"));
+      segments.push_back(logger.segmentPath());
+      for (int j = 0; j < 1000; ++j) {
+        MessageBuilder msg;
+        if (j % 2) {
+          msg.initEvent().initClocks().setWallTimeNanos(j);
+        } else {
+          msg.initEvent().initCarState().setVEgo(j);
+        }
+        logger.write(msg.toBytes(), j % 10 == 0);
+      }
+    }
+  }
+
+  for (const auto &segment_path : segments) {
+    // every event in the rlog is in the index, in order
+    std::string log = decompress_seekable(util::read_file(segment_path + "/rlog.zst"));
+    std::string idx = util::read_file(segment_path + "/rlog.idx");
+    REQUIRE(idx.size() >= sizeof(LogIndexHeader));
+    LogIndexHeader header;
+    memcpy(&header, idx.data(), sizeof(header));
+    REQUIRE(memcmp(header.magic, LOG_INDEX_MAGIC, sizeof(header.magic)) == 0);
+    REQUIRE(header.version == LOG_INDEX_VERSION);
+    REQUIRE(idx.size() == sizeof(header) + header.count * sizeof(LogIndexEntry));
+    REQUIRE(header.count == 1000 + 3);
+
+    uint64_t offset = 0;
+    for (uint64_t i = 0; i < header.count; ++i) {
+      LogIndexEntry entry;
+      memcpy(&entry, idx.data() + sizeof(header) + i * sizeof(entry), sizeof(entry));
+      REQUIRE(entry.offset == offset);
+      REQUIRE(entry.offset + entry.size <= log.size());
+      kj::ArrayPtr<const capnp::word> words((capnp::word *)(log.data() + entry.offset), entry.size / sizeof(capnp::word));
+      capnp::FlatArrayMessageReader reader(words);
+      auto event = reader.getRoot<cereal::Event>();
+      REQUIRE(reader.getEnd() == words.end());
+      REQUIRE(entry.which == event.which());
+      REQUIRE(entry.mono_time == event.getLogMonoTime());
+      offset += entry.size;
+    }
+    REQUIRE(offset == log.size());
+  }
+}
+
+TEST_CASE("ZstdFileWriter") {
+  const std::string path = "/tmp/test_zstd_writer.zst";
+  const size_t frame_size = 10000;
+  std::mt19937 rng(Catch::rngSeed());
+  std::string input;
+  std::vector<std::string> msgs;
+  {
+    ZstdFileWriter writer(path, LOG_COMPRESSION_LEVEL, frame_size);
+    for (int i = 0; i < 5000; ++i) {
+      std::string msg(8 + rng() % 300, 'a' + i % 5);
+      for (size_t j = 0; j < msg.size(); j += 7) msg[j] = rng();
+      writer.write(msg.data(), msg.size());
+      input += msg;
+      msgs.push_back(msg);
+    }
+  }
+
+  // every frame decompresses on its own and starts at a message
+  std::vector<std::string> frames;
+  REQUIRE(decompress_seekable(util::read_file(path), &frames) == input);
+  REQUIRE(frames.size() > 1);
+  size_t msg_idx = 0;
+  for (const auto &frame : frames) {
+    REQUIRE(frame.size() <= frame_size);
+    size_t size = 0;
+    while (size < frame.size()) size += msgs[msg_idx++].size();
+    REQUIRE(size == frame.size());
+  }
+  REQUIRE(msg_idx == msgs.size());
+
+  {
+    ZstdFileWriter empty(path);
+  }
+  REQUIRE(decompress_seekable(util::read_file(path)).empty());
+
+  // a slow log is cut into frames by age
+  std::string slow_input;
+  {
+    ZstdFileWriter writer(path, LOG_COMPRESSION_LEVEL, frame_size, 0.05);
+    for (int i = 0; i < 10; ++i) {
+      writer.write(msgs[i].data(), msgs[i].size());
+      slow_input += msgs[i];
+      util::sleep_for(20);
+    }
+  }
+  frames.clear();
+  REQUIRE(decompress_seekable(util::read_file(path), &frames) == slow_input);
+  REQUIRE(frames.size() >= 3);
+}
+
+// LOGGERD_BENCH_RLOG=<uncompressed rlog> ./test_logger "[.benchmark]"
+TEST_CASE("ZstdFileWriter benchmark", "[.benchmark]") {
+  const char *rlog = getenv("LOGGERD_BENCH_RLOG");
+  if (!rlog) {
+    WARN("set LOGGERD_BENCH_RLOG to the path of an uncompressed rlog");
+    return;
+  }
+  const std::string log = util::read_file(rlog);
+  REQUIRE(!log.empty());
+
+  const std::string path = "/tmp/test_zstd_writer_benchmark.zst";
+  uint64_t first_time = 0, last_time = 0;
+  struct rusage start = {}, end = {};
+  getrusage(RUSAGE_SELF, &start);
+  double t = millis_since_boot();
+  {
+    ZstdFileWriter writer(path);
+    kj::ArrayPtr<const capnp::word> words((const capnp::word *)log.data(), log.size() / sizeof(capnp::word));
+    while (words.size() > 0) {
+      capnp::FlatArrayMessageReader reader(words);
+      const uint64_t mono_time = reader.getRoot<cereal::Event>().getLogMonoTime();
+      if (first_time == 0) first_time = mono_time;
+      last_time = std::max(last_time, mono_time);
+      const kj::byte *begin = (const kj::byte *)words.begin();
+      words = kj::arrayPtr(reader.getEnd(), words.end());
+      writer.write((void *)begin, (const kj::byte *)words.begin() - begin);
+    }
+  }
+  t = millis_since_boot() - t;
+  getrusage(RUSAGE_SELF, &end);
+
+  auto cpu_secs = [](const struct rusage &r) {
+    return r.ru_utime.tv_sec + r.ru_stime.tv_sec + (r.ru_utime.tv_usec + r.ru_stime.tv_usec) / 1e6;
+  };
+  const double minutes = std::max((last_time - first_time) / 1e9, 1.0) / 60;
+  const double written = util::read_file(path).size();
+  printf("%.1f minutes of log: %.2f MB/min uncompressed, %.2f MB/min written (%.1fx), "
+         "%.2f cpu seconds per minute, %.1f ms\n",
+         minutes, log.size() / 1e6 / minutes, written / 1e6 / minutes, log.size() / written,
+         (cpu_secs(end) - cpu_secs(start)) / minutes, t);
+}
+
+TEST_CASE("AsyncFileWriter") {
+  const std::string path = "/tmp/test_async_file_writer";
+  auto [direct, use_io_uring] = GENERATE(table<bool, bool>({{false, false}, {false, true}, {true, false}, {true, true}}));
+  INFO("direct " << direct << " io_uring " << use_io_uring);
+
+  std::mt19937 rng(Catch::rngSeed());
+  std::string expected;
+  {
+    AsyncFileWriter writer(path, direct, use_io_uring);
+    for (int i = 0; i < 100; ++i) {
+      // mostly small writes, a few spanning both buffers
+      std::string data(i % 20 == 0 ? FILE_WRITER_BUFFER_SIZE * 2 + rng() % 5000 : rng() % 70000, '\0');
+      for (auto &c : data) c = rng();
+      writer.write(data.data(), data.size());
+      expected += data;
+    }
+  }
+  REQUIRE(util::read_file(path) == expected);
+
+  {
+    AsyncFileWriter empty(path, direct, use_io_uring);
+  }
+  REQUIRE(util::read_file(path).empty());
+}
+
+TEST_CASE("AsyncFileWriter reports write errors") {
+  auto use_io_uring = GENERATE(false, true);
+  INFO("io_uring " << use_io_uring);
+
+  // every write to /dev/full fails with ENOSPC
+  AsyncFileWriter full("/dev/full", false, use_io_uring);
+  const std::string data(FILE_WRITER_BUFFER_SIZE * 3, 'x');
+  full.write(data.data(), data.size());
+  REQUIRE_FALSE(full.write(data.data(), data.size()));
+  REQUIRE(full.error() == -ENOSPC);
+  REQUIRE(full.close() == -ENOSPC);
+}
+
+// Writes three camera streams and a log to tmpfs and to LOGGERD_BENCH_DIR (the current
+// directory by default), with fwrite and with AsyncFileWriter in each mode.
+TEST_CASE("AsyncFileWriter benchmark", "[.benchmark]") {
+  const char *bench_dir = getenv("LOGGERD_BENCH_DIR");
+  const size_t total_size = 512 * 1024 * 1024;
+  const size_t frame_size = 62500;  // 10 Mbit/s at 20 fps
+  const size_t log_size = 4096;
+
+  std::mt19937 rng(Catch::rngSeed());
+  std::string frame(frame_size, '\0');
+  for (auto &c : frame) c = rng();
+
+  struct Mode {
+    const char *name;
+    bool use_fwrite, direct, use_io_uring;
+  };
+  const Mode modes[] = {
+    {"fwrite", true, false, false},
+    {"pwrite", false, false, false},
+    {"io_uring", false, false, true},
+    {"io_uring O_DIRECT", false, true, true},
+  };
+  for (const std::string dir : {std::string("/dev/shm"), std::string(bench_dir ? bench_dir : ".")}) {
+    for (const Mode &mode : modes) {
+      std::vector<std::string> paths;
+      for (const char *fn : {"fcamera.hevc", "dcamera.hevc", "ecamera.hevc", "rlog"}) {
+        paths.push_back(dir + "/bench_" + std::to_string(getpid()) + "_" + fn);
+      }
+      std::vector<FILE *> files;
+      std::vector<std::unique_ptr<AsyncFileWriter>> writers;
+      for (const auto &path : paths) {
+        if (mode.use_fwrite) {
+          files.push_back(util::safe_fopen(path.c_str(), "wb"));
+        } else {
+          writers.push_back(std::make_unique<AsyncFileWriter>(path, mode.direct, mode.use_io_uring));
+        }
+      }
+
+      std::vector<double> latencies;
+      const double start = millis_since_boot();
+      for (size_t written = 0; written < total_size; written += frame_size * 3 + log_size) {
+        for (int i = 0; i < 4; ++i) {
+          const size_t size = i < 3 ? frame_size : log_size;
+          const double t = millis_since_boot();
+          if (mode.use_fwrite) {
+            util::safe_fwrite(frame.data(), 1, size, files[i]);
+          } else {
+            writers[i]->write(frame.data(), size);
+          }
+          latencies.push_back(millis_since_boot() - t);
+        }
+      }
+      for (FILE *f : files) {
+        util::safe_fflush(f);
+        fclose(f);
+      }
+      writers.clear();
+      const double elapsed = millis_since_boot() - start;
+
+      std::sort(latencies.begin(), latencies.end());
+      printf("%-10s %-18s %7.1f MB/s, write latency p50 %.3f ms, p99 %.3f ms, max %.3f ms\n", dir.c_str(), mode.name,
+             total_size / 1e6 / (elapsed / 1000), latencies[latencies.size() / 2],
+             latencies[latencies.size() * 99 / 100], latencies.back());
+      for (const auto &path : paths) unlink(path.c_str());
+    }
+  }
+}
+
+// a roadEncodeData event as sent by encoderd. a truncated index has only its first data word
+static kj::Array<capnp::word> build_encode_data(int frame, bool truncated_idx = false) {
+  MessageBuilder msg;
+  auto edata = msg.initEvent(frame % 7 != 0).initRoadEncodeData();
+  if (truncated_idx) {
+    auto idx = capnp::AnyStruct::Builder(edata).getPointerSection()[0].initAsAnyStruct(1, 0);
+    const uint32_t frame_id = frame;
+    memcpy(idx.getDataSection().begin(), &frame_id, sizeof(frame_id));
+  } else {
+    auto idx = edata.initIdx();
+    idx.setFrameId(frame);
+    idx.setType(cereal::EncodeIndex::Type::FULL_H_E_V_C);
+    idx.setEncodeId(frame);
+    idx.setSegmentNum(frame / 1200);
+    idx.setSegmentId(frame % 1200);
+    idx.setSegmentIdEncode(frame % 1200);
+    idx.setTimestampSof(frame * 50000000ull);
+    idx.setTimestampEof(frame * 50000000ull + 1000000);
+    idx.setFlags(frame % 20 == 0 ? 8 : 0);
+    idx.setLen(1000 + frame);
+  }
+  std::string data(1000 + frame, (char)frame);
+  edata.setData(kj::arrayPtr((const capnp::byte *)data.data(), data.size()));
+  return capnp::messageToFlatArray(msg);
+}
+
+// how loggerd built the roadEncodeIdx event before EncodeIdxBuilder
+static kj::Array<capnp::word> build_encode_idx(cereal::Event::Reader event) {
+  MessageBuilder msg;
+  auto evt = msg.initEvent(event.getValid());
+  evt.setLogMonoTime(event.getLogMonoTime());
+  evt.setRoadEncodeIdx(event.getRoadEncodeData().getIdx());
+  return capnp::messageToFlatArray(msg);
+}
+
+TEST_CASE("EncodeIdxBuilder") {
+  EncodeIdxBuilder builder(&cereal::Event::Builder::setRoadEncodeIdx, &cereal::Event::Builder::getRoadEncodeIdx);
+  for (int frame = 0; frame < 100; ++frame) {
+    // an index of another size is copied as it is, like before
+    auto encode_data = build_encode_data(frame, frame % 30 == 29);
+    capnp::FlatArrayMessageReader reader(encode_data);
+    auto event = reader.getRoot<cereal::Event>();
+
+    auto expected = build_encode_idx(event);
+    auto bytes = builder.build(event, event.getRoadEncodeData().getIdx());
+    REQUIRE(bytes.size() == expected.asBytes().size());
+    REQUIRE(memcmp(bytes.begin(), expected.begin(), bytes.size()) == 0);
+  }
+}
+
+TEST_CASE("EncodeIdxBuilder benchmark", "[.benchmark]") {
+  const int frames = 100000;
+  std::vector<kj::Array<capnp::word>> encode_data;
+  for (int frame = 0; frame < 1200; ++frame) {
+    encode_data.push_back(build_encode_data(frame));
+  }
+
+  EncodeIdxBuilder builder(&cereal::Event::Builder::setRoadEncodeIdx, &cereal::Event::Builder::getRoadEncodeIdx);
+  uint64_t total[2] = {};
+  double elapsed[2] = {};
+  for (int i = 0; i < 2; ++i) {
+    double t = millis_since_boot();
+    for (int frame = 0; frame < frames; ++frame) {
+      capnp::FlatArrayMessageReader reader(encode_data[frame % encode_data.size()]);
+      auto event = reader.getRoot<cereal::Event>();
+      total[i] += i == 0 ? build_encode_idx(event).size() : builder.build(event, event.getRoadEncodeData().getIdx()).size();
+    }
+    elapsed[i] = millis_since_boot() - t;
+  }
+  REQUIRE(total[0] * sizeof(capnp::word) == total[1]);
+  printf("%d frames: MessageBuilder %.1f ns/frame, EncodeIdxBuilder %.1f ns/frame\n",
+         frames, elapsed[0] * 1e6 / frames, elapsed[1] * 1e6 / frames);
+}
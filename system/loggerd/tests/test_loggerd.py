@@ -18,6 +18,7 @@ from openpilot.common.timeout import Timeout
 from openpilot.system.hardware.hw import Paths
 from openpilot.system.loggerd.xattr_cache import getxattr
 from openpilot.system.loggerd.deleter import PRESERVE_ATTR_NAME, PRESERVE_ATTR_VALUE
+from openpilot.system.loggerd.tests.benchmark_loggerd import LOG_INDEX_ENTRY, LOG_INDEX_HEADER, run_benchmark
 from openpilot.system.manager.process_config import managed_processes
 from openpilot.system.version import get_version
 from openpilot.tools.lib.helpers import RE
@@ -142,7 +143,7 @@ class TestLoggerd:
     Params().put("RecordFront", "1")
 
     d = DEVICE_CAMERAS[("tici", "ar0231")]
-    expected_files = {"rlog", "qlog", "qcamera.ts", "fcamera.hevc", "dcamera.hevc", "ecamera.hevc"}
+    expected_files = {"rlog.zst", "rlog.idx", "qlog.zst", "qcamera.ts", "fcamera.hevc", "dcamera.hevc", "ecamera.hevc"}
     streams = [(VisionStreamType.VISION_STREAM_ROAD, (d.fcam.width, d.fcam.height, 2048*2346, 2048, 2048*1216), "roadCameraState"),
                (VisionStreamType.VISION_STREAM_DRIVER, (d.dcam.width, d.dcam.height, 2048*2346, 2048, 2048*1216), "driverCameraState"),
                (VisionStreamType.VISION_STREAM_WIDE_ROAD, (d.ecam.width, d.ecam.height, 2048*2346, 2048, 2048*1216), "wideRoadCameraState")]
@@ -229,7 +230,7 @@ class TestLoggerd:
                random.sample(no_qlog_services, random.randint(2, min(10, len(no_qlog_services))))
     sent_msgs = self._publish_random_messages(services)
 
-    qlog_path = os.path.join(self._get_latest_log_dir(), "qlog")
+    qlog_path = os.path.join(self._get_latest_log_dir(), "qlog.zst")
     lr = list(LogReader(qlog_path))
 
     # check initData and sentinel
@@ -255,7 +256,7 @@ class TestLoggerd:
     services = random.sample(CEREAL_SERVICES, random.randint(5, 10))
     sent_msgs = self._publish_random_messages(services)
 
-    lr = list(LogReader(os.path.join(self._get_latest_log_dir(), "rlog")))
+    lr = list(LogReader(os.path.join(self._get_latest_log_dir(), "rlog.zst")))
 
     # check initData and sentinel
     self._check_init_data(lr)
@@ -282,3 +283,21 @@ class TestLoggerd:
     segment_dir = self._get_latest_log_dir()
     assert getxattr(segment_dir, PRESERVE_ATTR_NAME) is None
 
+
+  def test_synthetic_load(self):
+    # checks rotation and the event index under load. throughput and drops depend on the
+    # machine, measure them with benchmark_loggerd.py
+    result = run_benchmark(duration=6, segment_length=2, log_root=Paths.log_root())
+    assert result.segments == 3
+    assert len(result.rotation_pauses) == result.segments
+    assert result.dropped_msgs <= 0.01 * result.sent_msgs
+
+    for idx in sorted(Path(Paths.log_root()).glob("*/rlog.idx")):
+      lr = list(LogReader(str(idx.with_name("rlog.zst"))))
+      data = idx.read_bytes()
+      magic, _, count = LOG_INDEX_HEADER.unpack_from(data)
+      assert magic == b"RIDX"
+      assert count == len(lr)
+      assert len(data) == LOG_INDEX_HEADER.size + count * LOG_INDEX_ENTRY.size
+      mono_times = [e[0] for e in LOG_INDEX_ENTRY.iter_unpack(data[LOG_INDEX_HEADER.size:])]
+      assert mono_times == [m.logMonoTime for m in lr]
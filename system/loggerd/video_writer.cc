@@ -1,5 +1,6 @@
 #pragma clang diagnostic ignored "-Wdeprecated-declarations"
 #include <cassert>
+#include <cstring>
 
 #include "system/loggerd/video_writer.h"
 #include "common/swaglog.h"
@@ -45,16 +46,14 @@ VideoWriter::VideoWriter(const char *path, const char *filename, bool remuxing,
     assert(err >= 0);
 
   } else {
-    this->of = util::safe_fopen(this->vid_path.c_str(), "wb");
-    assert(this->of);
+    this->of = std::make_unique<AsyncFileWriter>(this->vid_path, LOGGERD_DIRECT_IO);
   }
 }
 
 void VideoWriter::write(uint8_t *data, int len, long long timestamp, bool codecconfig, bool keyframe) {
   if (of && data) {
-    size_t written = util::safe_fwrite(data, 1, len, of);
-    if (written != len) {
-      LOGE("failed to write file.errno=%d", errno);
+    if (!of->write(data, len)) {
+      LOGE("failed to write file.errno=%d", -of->error());
     }
   }
 
@@ -104,9 +103,9 @@ VideoWriter::~VideoWriter() {
     if (err != 0) LOGE("avio_closep failed %d", err);
     avformat_free_context(this->ofmt_ctx);
   } else {
-    util::safe_fflush(this->of);
-    fclose(this->of);
-    this->of = nullptr;
+    int err = this->of->close();
+    if (err != 0) LOGE("failed to close %s: %s", this->vid_path.c_str(), strerror(-err));
+    this->of.reset();
   }
   unlink(this->lock_path.c_str());
 }
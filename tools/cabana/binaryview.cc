@@ -303,6 +303,17 @@ void BinaryViewModel::updateState() {
     endInsertRows();
   }
 
+  // within a time range, highlight the flips of the range, looked up from the prefix sums of the events
+  std::vector<std::array<uint32_t, 8>> range_flips;
+  size_t range_count = 0;
+  const auto &range = can->timeRange();
+  if (range) {
+    auto events = can->events(msg_id);
+    CanEventsView view(events.lowerBound(can->toMonoTime(range->first)), events.upperBound(can->toMonoTime(range->second)));
+    range_flips = view.bitFlips();
+    range_count = view.size();
+  }
+
   const double max_f = 255.0;
   const double factor = 0.25;
   const double scaler = max_f / log2(1.0 + factor);
@@ -312,9 +323,14 @@ void BinaryViewModel::updateState() {
       int val = ((binary[i] >> (7 - j)) & 1) != 0 ? 1 : 0;
       // Bit update frequency based highlighting
       double offset = !item.sigs.empty() ? 50 : 0;
-      auto n = last_msg.last_changes[i].bit_change_counts[j];
+      uint32_t n = last_msg.last_changes[i].bit_change_counts[j];
+      double count = last_msg.count;
+      if (range) {
+        n = i < range_flips.size() && !last_msg.last_changes[i].suppressed ? range_flips[i][j] : 0;
+        count = std::max<size_t>(range_count, 1);
+      }
       double min_f = n == 0 ? offset : offset + 25;
-      double alpha = std::clamp(offset + log2(1.0 + factor * (double)n / (double)last_msg.count) * scaler, min_f, max_f);
+      double alpha = std::clamp(offset + log2(1.0 + factor * (double)n / count) * scaler, min_f, max_f);
       auto color = item.bg_color;
       color.setAlpha(alpha);
       updateItem(i, j, val, color);
@@ -336,7 +352,19 @@ QVariant BinaryViewModel::headerData(int section, Qt::Orientation orientation, i
 
 QVariant BinaryViewModel::data(const QModelIndex &index, int role) const {
   auto item = (const BinaryViewModel::Item *)index.internalPointer();
-  return role == Qt::ToolTipRole && item && !item->sigs.empty() ? signalToolTip(item->sigs.back()) : QVariant();
+  if (role != Qt::ToolTipRole || !item) return {};
+  if (!item->sigs.empty()) return signalToolTip(item->sigs.back());
+
+  const auto &msgs = can->busStatistics().messages;
+  auto it = msgs.find(msg_id);
+  if (it == msgs.end() || index.row() >= (int)it->second.entropy.size()) return {};
+  const auto &stats = it->second;
+  if (index.column() == column_count - 1) {
+    return tr("Entropy: %1 bits").arg(stats.entropy[index.row()], 0, 'f', 2);
+  }
+  const double duration = (stats.last_time - stats.first_time) / 1e9;
+  const uint32_t flips = stats.bit_flips[index.row()][index.column()];
+  return tr("Flips: %1 (%2/s)").arg(flips).arg(duration > 0 ? flips / duration : 0, 0, 'f', 2);
 }
 
 // BinaryItemDelegate
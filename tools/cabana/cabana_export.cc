@@ -0,0 +1,333 @@
+// Headless signal export: decodes the CAN messages of one or more routes with a
+// DBC and writes the selected signals as CSV or as a binary columnar file.
+//
+// Columnar files (<bus>_<MSG>.bin) are laid out as
+//   header: "CBSG" | u32 version | u32 address | u8 bus | u8[3] reserved | u32 num_signals
+//           | num_signals x (u16 name length | name bytes)
+//   blocks until EOF, one per segment:
+//           u64 rows | u64 mono_time[rows] | num_signals x f64 value[rows]
+// Values of multiplexed signals are NaN in frames where they are not present.
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+
+#include "tools/cabana/dbc/dbcfile.h"
+#include "tools/cabana/streams/caneventstore.h"
+#include "tools/replay/logreader.h"
+#include "tools/replay/route.h"
+
+namespace {
+
+constexpr uint32_t COLUMNAR_VERSION = 1;
+
+struct ExportMessage {
+  const cabana::Msg *msg;
+  std::vector<const cabana::Signal *> sigs;
+};
+
+struct DecodedMessage {
+  std::vector<uint64_t> mono_times;
+  std::vector<std::vector<double>> values;  // one column per signal
+};
+
+struct DecodedSegment {
+  bool done = false;
+  bool ok = false;
+  uint64_t begin_time = 0;  // the first event of the segment
+  std::map<MessageId, DecodedMessage> msgs;
+};
+
+DecodedSegment decodeSegment(const QString &file, const std::map<uint32_t, ExportMessage> &selected) {
+  DecodedSegment seg;
+  // the same events replay keeps, so the times match the ones shown in cabana
+  const cereal::Event::Which kept[] = {cereal::Event::Which::INIT_DATA, cereal::Event::Which::CAR_PARAMS, cereal::Event::Which::CAN};
+  std::vector<bool> filters((size_t)*std::max_element(std::begin(kept), std::end(kept)) + 1, false);
+  for (auto which : kept) filters[(size_t)which] = true;
+  LogReader log(filters);
+  if (!log.load(file.toStdString(), nullptr, true, 0, 3)) return seg;
+
+  seg.begin_time = log.events.front().mono_time;
+
+  std::map<MessageId, CanEventStore> stores;
+  for (const Event &e : log.events) {
+    if (e.which != cereal::Event::Which::CAN) continue;
+
+    capnp::FlatArrayMessageReader reader(e.data);
+    auto event = reader.getRoot<cereal::Event>();
+    for (const auto &c : event.getCan()) {
+      if (selected.count(c.getAddress())) {
+        MessageId id = {.source = (uint8_t)c.getSrc(), .address = c.getAddress()};
+        auto dat = c.getDat();
+        stores.try_emplace(id, id).first->second.append(e.mono_time, (const uint8_t *)dat.begin(), dat.size());
+      }
+    }
+  }
+
+  for (const auto &[id, store] : stores) {
+    const auto &m = selected.at(id.address);
+    auto &decoded = seg.msgs[id];
+    const CanEventsView view(store);
+    view.forEachSpan([&](const CanEventsView::Span &s) {
+      decoded.mono_times.insert(decoded.mono_times.end(), s.mono_times, s.mono_times + s.count);
+    });
+    decoded.values.resize(m.sigs.size());
+    for (int i = 0; i < m.sigs.size(); ++i) {
+      decoded.values[i].resize(store.size());
+      view.getValues(m.sigs[i], decoded.values[i].data());
+    }
+  }
+  seg.ok = true;
+  return seg;
+}
+
+class Writer {
+public:
+  Writer(const QString &dir, bool columnar) : dir_(dir), columnar_(columnar) {}
+  ~Writer() {
+    for (auto &[_, f] : files_) fclose(f);
+  }
+
+  bool write(const DecodedSegment &seg, const std::map<uint32_t, ExportMessage> &selected) {
+    // times are relative to the start of the first segment, like in cabana
+    if (!start_time_ && seg.ok) start_time_ = seg.begin_time;
+
+    for (const auto &[id, decoded] : seg.msgs) {
+      if (decoded.mono_times.empty()) continue;
+
+      const auto &m = selected.at(id.address);
+      FILE *f = file(id, m);
+      if (!f) return false;
+      columnar_ ? writeColumnar(f, decoded) : writeCSV(f, id, decoded, m);
+    }
+    return true;
+  }
+
+private:
+  FILE *file(const MessageId &id, const ExportMessage &m) {
+    auto it = files_.find(id);
+    if (it != files_.end()) return it->second;
+
+    QString fn = QString("%1/%2_%3.%4").arg(dir_).arg(id.source).arg(m.msg->name, columnar_ ? "bin" : "csv");
+    FILE *f = fopen(fn.toStdString().c_str(), "wb");
+    if (!f) {
+      fprintf(stderr, "failed to open %s\n", fn.toStdString().c_str());
+      return nullptr;
+    }
+    files_[id] = f;
+
+    if (columnar_) {
+      const uint8_t bus[4] = {id.source};
+      const uint32_t num_signals = m.sigs.size();
+      fwrite("CBSG", 1, 4, f);
+      fwrite(&COLUMNAR_VERSION, sizeof(COLUMNAR_VERSION), 1, f);
+      fwrite(&id.address, sizeof(id.address), 1, f);
+      fwrite(bus, 1, sizeof(bus), f);
+      fwrite(&num_signals, sizeof(num_signals), 1, f);
+      for (auto s : m.sigs) {
+        std::string name = s->name.toStdString();
+        uint16_t len = name.size();
+        fwrite(&len, sizeof(len), 1, f);
+        fwrite(name.data(), 1, len, f);
+      }
+    } else {
+      std::string header = "time,addr,bus";
+      for (auto s : m.sigs) header += "," + s->name.toStdString();
+      header += "\n";
+      fwrite(header.data(), 1, header.size(), f);
+    }
+    return f;
+  }
+
+  void writeColumnar(FILE *f, const DecodedMessage &decoded) {
+    const uint64_t rows = decoded.mono_times.size();
+    fwrite(&rows, sizeof(rows), 1, f);
+    fwrite(decoded.mono_times.data(), sizeof(uint64_t), rows, f);
+    for (const auto &col : decoded.values) {
+      fwrite(col.data(), sizeof(double), rows, f);
+    }
+  }
+
+  void writeCSV(FILE *f, const MessageId &id, const DecodedMessage &decoded, const ExportMessage &m) {
+    std::string buf;
+    buf.reserve(1 << 16);
+    char field[64];
+    for (size_t row = 0; row < decoded.mono_times.size(); ++row) {
+      const double t = ((int64_t)decoded.mono_times[row] - (int64_t)start_time_) / 1e9;
+      int n = snprintf(field, sizeof(field), "%.3f,0x%X,%d", t, id.address, id.source);
+      buf.append(field, n);
+      for (int i = 0; i < m.sigs.size(); ++i) {
+        buf += ',';
+        double v = decoded.values[i][row];
+        if (!std::isnan(v)) {
+          n = snprintf(field, sizeof(field), "%.*f", m.sigs[i]->precision, v);
+          buf.append(field, n);
+        }
+      }
+      buf += '\n';
+      if (buf.size() > (1 << 16) - 1024) {
+        fwrite(buf.data(), 1, buf.size(), f);
+        buf.clear();
+      }
+    }
+    fwrite(buf.data(), 1, buf.size(), f);
+  }
+
+  QString dir_;
+  bool columnar_;
+  uint64_t start_time_ = 0;
+  std::map<MessageId, FILE *> files_;
+};
+
+// Decodes the segments on a pool of threads and writes them in order. Workers stay at
+// most a few segments ahead of the writer, so memory is bounded by the window.
+bool exportRoute(const Route &route, const std::map<uint32_t, ExportMessage> &selected,
+                 const QString &dir, bool columnar, int num_threads) {
+  std::vector<QString> files;
+  for (const auto &[n, seg] : route.segments()) {
+    QString file = seg.rlog.isEmpty() ? seg.qlog : seg.rlog;
+    if (!file.isEmpty()) files.push_back(file);
+  }
+
+  const size_t window = num_threads * 2;
+  std::vector<DecodedSegment> segments(files.size());
+  std::atomic<size_t> next = 0;
+  size_t written = 0;
+  std::mutex lock;
+  std::condition_variable cv;
+
+  std::vector<std::thread> workers;
+  for (int i = 0; i < num_threads; ++i) {
+    workers.emplace_back([&]() {
+      for (size_t n = next++; n < files.size(); n = next++) {
+        {
+          std::unique_lock lk(lock);
+          cv.wait(lk, [&]() { return n < written + window; });
+        }
+        auto seg = decodeSegment(files[n], selected);
+        if (!seg.ok) fprintf(stderr, "failed to load %s\n", files[n].toStdString().c_str());
+
+        std::lock_guard lk(lock);
+        segments[n] = std::move(seg);
+        segments[n].done = true;
+        cv.notify_all();
+      }
+    });
+  }
+
+  bool ok = QDir().mkpath(dir);
+  size_t failed = 0;
+  {
+    Writer writer(dir, columnar);
+    for (size_t n = 0; n < files.size(); ++n) {
+      DecodedSegment seg;
+      {
+        std::unique_lock lk(lock);
+        cv.wait(lk, [&]() { return segments[n].done; });
+        seg = std::move(segments[n]);
+      }
+      if (!seg.ok) ++failed;
+      ok = ok && writer.write(seg, selected);
+      fprintf(stderr, "\r%s: %zu/%zu segments", route.name().toStdString().c_str(), n + 1, files.size());
+
+      std::lock_guard lk(lock);
+      ++written;
+      cv.notify_all();
+    }
+    fprintf(stderr, "\n");
+  }
+
+  for (auto &t : workers) t.join();
+  if (failed > 0) {
+    fprintf(stderr, "%s: %zu of %zu segments failed to load\n", route.name().toStdString().c_str(), failed, files.size());
+  }
+  return ok && failed == 0;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  QCoreApplication app(argc, argv);
+  QCoreApplication::setApplicationName("cabana_export");
+
+  QCommandLineParser cmd_parser;
+  cmd_parser.addHelpOption();
+  cmd_parser.setApplicationDescription("Decode CAN signals of routes with a DBC and export them");
+  cmd_parser.addPositionalArgument("routes", "the routes to export", "route [route...]");
+  cmd_parser.addOption({"dbc", "opendbc name or path of the dbc file", "dbc"});
+  cmd_parser.addOption({"signals", "comma separated list of MSG or MSG.SIGNAL to export (default: all)", "signals"});
+  cmd_parser.addOption({"format", "output format: csv or columnar (default: csv)", "format", "csv"});
+  cmd_parser.addOption({"output", "output directory (default: current directory)", "output", "."});
+  cmd_parser.addOption({"data_dir", "local directory with routes", "data_dir"});
+  cmd_parser.addOption({"threads", "number of decoding threads", "threads", QString::number(std::thread::hardware_concurrency())});
+  cmd_parser.process(app);
+
+  const QStringList routes = cmd_parser.positionalArguments();
+  const QString format = cmd_parser.value("format");
+  if (routes.isEmpty() || !cmd_parser.isSet("dbc") || (format != "csv" && format != "columnar")) {
+    cmd_parser.showHelp(1);
+  }
+
+  QString dbc_path = cmd_parser.value("dbc");
+  if (!QFile::exists(dbc_path)) {
+    dbc_path = QString("%1/%2.dbc").arg(OPENDBC_FILE_PATH, dbc_path);
+  }
+  std::unique_ptr<DBCFile> dbc_file;
+  try {
+    dbc_file = std::make_unique<DBCFile>(dbc_path);
+  } catch (std::exception &e) {
+    fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+
+  // select messages and signals
+  std::map<QString, QStringList> requested;
+  for (const QString &s : cmd_parser.value("signals").split(',')) {
+    if (s.trimmed().isEmpty()) continue;
+    auto parts = s.trimmed().split('.');
+    requested[parts[0]] += parts.size() > 1 ? parts[1] : QString();
+  }
+  std::map<uint32_t, ExportMessage> selected;
+  for (const auto &[address, msg] : dbc_file->getMessages()) {
+    auto it = requested.find(msg.name);
+    if (msg.sigs.empty() || (!requested.empty() && it == requested.end())) continue;
+
+    ExportMessage m = {.msg = &msg};
+    for (auto s : msg.sigs) {
+      if (requested.empty() || it->second.contains(QString()) || it->second.contains(s->name)) {
+        m.sigs.push_back(s);
+      }
+    }
+    if (!m.sigs.empty()) selected[address] = m;
+  }
+  if (selected.empty()) {
+    fprintf(stderr, "no signals selected\n");
+    return 1;
+  }
+
+  const int num_threads = std::max(1, cmd_parser.value("threads").toInt());
+  int ret = 0;
+  for (const QString &r : routes) {
+    Route route(r, cmd_parser.value("data_dir"));
+    if (!route.load()) {
+      fprintf(stderr, "failed to load route %s\n", r.toStdString().c_str());
+      ret = 1;
+      continue;
+    }
+    QString dir = QString("%1/%2").arg(cmd_parser.value("output"), QString(route.name()).replace('|', '_').replace('/', '_'));
+    if (!exportRoute(route, selected, dir, format == "columnar", num_threads)) {
+      ret = 1;
+    }
+  }
+  return ret;
+}
@@ -1,6 +1,7 @@
 #include "tools/cabana/chart/chart.h"
 
 #include <algorithm>
+#include <cmath>
 #include <limits>
 
 #include <QActionGroup>
@@ -218,6 +219,9 @@ void ChartView::updatePlotArea(int left_pos, bool force) {
     x_label_size += QSizeF{5, 5};
     chart()->setPlotArea(rect().adjusted(align_to + left, adjust_top + top, -x_label_size.width() / 2 - right, -x_label_size.height() - bottom));
     chart()->layout()->invalidate();
+    for (auto &s : sigs) {
+      resampleSeries(s);
+    }
     resetChartCache();
   }
 }
@@ -248,6 +252,9 @@ void ChartView::updatePlot(double cur, double min, double max) {
   cur_sec = cur;
   if (min != axis_x->min() || max != axis_x->max()) {
     axis_x->setRange(min, max);
+    for (auto &s : sigs) {
+      resampleSeries(s);
+    }
     updateAxisY();
     updateSeriesPoints();
     // update tooltip
@@ -282,21 +289,52 @@ void ChartView::updateSeriesPoints() {
   }
 }
 
-void ChartView::appendCanEvents(const cabana::Signal *sig, const std::vector<const CanEvent *> &events,
-                                std::vector<QPointF> &vals, std::vector<QPointF> &step_vals) {
-  vals.reserve(vals.size() + events.capacity());
-  step_vals.reserve(step_vals.size() + events.capacity() * 2);
-
-  double value = 0;
-  for (const CanEvent *e : events) {
-    if (sig->getValue(e->dat, e->size, &value)) {
-      const double ts = can->toSeconds(e->mono_time);
-      vals.emplace_back(ts, value);
-      if (!step_vals.empty())
-        step_vals.emplace_back(ts, step_vals.back().y());
-      step_vals.emplace_back(ts, value);
+// Hand the series only the visible part of the signal, reduced to the min and max of
+// each pyramid bucket so that a redraw costs O(plot width) at any zoom level. Step lines
+// also keep the first and last point of each bucket, the value they hold until the next.
+void ChartView::resampleSeries(SigItem &s) {
+  std::vector<QPointF> points;
+  const bool step_line = series_type == SeriesType::StepLine;
+  if (!s.vals.empty()) {
+    auto first = std::lower_bound(s.vals.cbegin(), s.vals.cend(), axis_x->min(), xLessThan);
+    auto last = std::lower_bound(first, s.vals.cend(), axis_x->max(), xLessThan);
+    // include one point beyond each edge so lines run to the border of the plot
+    size_t begin = std::distance(s.vals.cbegin(), first);
+    size_t end = std::min<size_t>(std::distance(s.vals.cbegin(), last) + 1, s.vals.size());
+    if (begin > 0) --begin;
+    const size_t max_buckets = std::max<int>(chart()->plotArea().width(), 1);
+    points.reserve(std::min(end - begin, max_buckets * (step_line ? 4 : 2) + 2));
+    s.pyramid.downsample(s.vals, begin, end, max_buckets, points, step_line);
+  }
+
+  if (step_line && points.size() > 1) {
+    std::vector<QPointF> step_points;
+    step_points.reserve(points.size() * 2);
+    step_points.push_back(points[0]);
+    for (size_t i = 1; i < points.size(); ++i) {
+      step_points.emplace_back(points[i].x(), points[i - 1].y());
+      step_points.push_back(points[i]);
     }
+    points = std::move(step_points);
   }
+  s.series->replace(QVector<QPointF>::fromStdVector(points));
+}
+
+void ChartView::appendCanEvents(const cabana::Signal *sig, const CanEventsView &events, std::vector<QPointF> &vals) {
+  if (events.empty()) return;
+
+  vals.reserve(vals.size() + events.size());
+
+  std::vector<double> values(events.size());
+  events.getValues(sig, values.data());
+  const double *value = values.data();
+  events.forEachSpan([&](const CanEventsView::Span &s) {
+    for (size_t i = 0; i < s.count; ++i, ++value) {
+      if (!std::isnan(*value)) {
+        vals.emplace_back(can->toSeconds(s.mono_times[i]), *value);
+      }
+    }
+  });
 }
 
 void ChartView::updateSeries(const cabana::Signal *sig, const MessageEventsMap *msg_new_events) {
@@ -304,27 +342,25 @@ void ChartView::updateSeries(const cabana::Signal *sig, const MessageEventsMap *
     if (!sig || s.sig == sig) {
       if (!msg_new_events) {
         s.vals.clear();
-        s.step_vals.clear();
+        s.pyramid.build(s.vals);
       }
       auto events = msg_new_events ? msg_new_events : &can->eventsMap();
       auto it = events->find(s.msg_id);
       if (it == events->end() || it->second.empty()) continue;
 
-      if (s.vals.empty() || can->toSeconds(it->second.back()->mono_time) > s.vals.back().x()) {
-        appendCanEvents(s.sig, it->second, s.vals, s.step_vals);
+      if (s.vals.empty() || can->toSeconds(it->second.front().mono_time) >= s.vals.back().x()) {
+        // appending at the end only touches the last bucket of each level
+        appendCanEvents(s.sig, it->second, s.vals);
+        s.pyramid.append(s.vals);
       } else {
-        std::vector<QPointF> vals, step_vals;
-        appendCanEvents(s.sig, it->second, vals, step_vals);
+        std::vector<QPointF> vals;
+        appendCanEvents(s.sig, it->second, vals);
+        if (vals.empty()) continue;
         s.vals.insert(std::lower_bound(s.vals.begin(), s.vals.end(), vals.front().x(), xLessThan),
                       vals.begin(), vals.end());
-        s.step_vals.insert(std::lower_bound(s.step_vals.begin(), s.step_vals.end(), step_vals.front().x(), xLessThan),
-                           step_vals.begin(), step_vals.end());
-      }
-
-      if (!can->liveStreaming()) {
-        s.segment_tree.build(s.vals);
+        s.pyramid.build(s.vals);
       }
-      s.series->replace(QVector<QPointF>::fromStdVector(series_type == SeriesType::StepLine ? s.step_vals : s.vals));
+      resampleSeries(s);
     }
   }
   updateAxisY();
@@ -350,16 +386,7 @@ void ChartView::updateAxisY() {
 
     auto first = std::lower_bound(s.vals.cbegin(), s.vals.cend(), axis_x->min(), xLessThan);
     auto last = std::lower_bound(first, s.vals.cend(), axis_x->max(), xLessThan);
-    s.min = std::numeric_limits<double>::max();
-    s.max = std::numeric_limits<double>::lowest();
-    if (can->liveStreaming()) {
-      for (auto it = first; it != last; ++it) {
-        if (it->y() < s.min) s.min = it->y();
-        if (it->y() > s.max) s.max = it->y();
-      }
-    } else {
-      std::tie(s.min, s.max) = s.segment_tree.minmax(std::distance(s.vals.cbegin(), first), std::distance(s.vals.cbegin(), last));
-    }
+    std::tie(s.min, s.max) = s.pyramid.minmax(s.vals, std::distance(s.vals.cbegin(), first), std::distance(s.vals.cbegin(), last));
     min = std::min(min, s.min);
     max = std::max(max, s.max);
   }
@@ -838,7 +865,7 @@ void ChartView::setSeriesType(SeriesType type) {
     }
     for (auto &s : sigs) {
       s.series = createSeries(series_type, s.sig->color);
-      s.series->replace(QVector<QPointF>::fromStdVector(series_type == SeriesType::StepLine ? s.step_vals : s.vals));
+      resampleSeries(s);
     }
     updateSeriesPoints();
     updateTitle();
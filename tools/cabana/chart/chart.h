@@ -46,9 +46,8 @@ public:
     const cabana::Signal *sig = nullptr;
     QXYSeries *series = nullptr;
     std::vector<QPointF> vals;
-    std::vector<QPointF> step_vals;
     QPointF track_pt{};
-    SegmentTree segment_tree;
+    MinMaxPyramid pyramid;
     double min = 0;
     double max = 0;
   };
@@ -65,8 +64,7 @@ private slots:
   void signalRemoved(const cabana::Signal *sig) { removeIf([=](auto &s) { return s.sig == sig; }); }
 
 private:
-  void appendCanEvents(const cabana::Signal *sig, const std::vector<const CanEvent *> &events,
-                       std::vector<QPointF> &vals, std::vector<QPointF> &step_vals);
+  void appendCanEvents(const cabana::Signal *sig, const CanEventsView &events, std::vector<QPointF> &vals);
   void createToolButtons();
   void addSeries(QXYSeries *series);
   void contextMenuEvent(QContextMenuEvent *event) override;
@@ -95,6 +93,7 @@ private:
   QXYSeries *createSeries(SeriesType type, QColor color);
   void setSeriesColor(QXYSeries *, QColor color);
   void updateSeriesPoints();
+  void resampleSeries(SigItem &s);
   void removeIf(std::function<bool(const SigItem &)> predicate);
   inline void clearTrackPoints() { for (auto &s : sigs) s.track_pt = {}; }
 
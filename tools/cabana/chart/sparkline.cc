@@ -1,43 +1,75 @@
 #include "tools/cabana/chart/sparkline.h"
 
 #include <algorithm>
+#include <cmath>
 #include <limits>
 #include <QPainter>
 
 void Sparkline::update(const MessageId &msg_id, const cabana::Signal *sig, double last_msg_ts, int range, QSize size) {
-  const auto &msgs = can->events(msg_id);
+  const auto msgs = can->events(msg_id);
 
   auto range_start = can->toMonoTime(last_msg_ts - range);
   auto range_end = can->toMonoTime(last_msg_ts);
-  auto first = std::lower_bound(msgs.cbegin(), msgs.cend(), range_start, CompareCanEvent());
-  auto last = std::upper_bound(first, msgs.cend(), range_end, CompareCanEvent());
 
-  points.clear();
+  // the cached values are kept if the window only moved forward and no events were merged into it
+  bool incremental = valid_ && *sig == sig_ && sig->color == sig_.color && range == range_ && size == size_ &&
+                     range_start >= start_ && range_end >= end_ &&
+                     (size_t)(msgs.upperBound(end_) - msgs.lowerBound(start_)) == num_events_;
+  if (!incremental) {
+    values.clear();
+  }
+  while (!values.empty() && values.front().mono_time < range_start) {
+    values.pop_front();
+  }
+  const size_t first_new = values.size();
+  auto first = incremental ? msgs.upperBound(end_) : msgs.lowerBound(range_start);
+  auto last = CanEventsView(first, msgs.end()).upperBound(range_end);
   double value = 0;
   for (auto it = first; it != last; ++it) {
-    if (sig->getValue((*it)->dat, (*it)->size, &value)) {
-      points.emplace_back(((*it)->mono_time - (*first)->mono_time) / 1e9, value);
+    if (sig->getValue(it->dat, it->size, &value)) {
+      values.push_back({it->mono_time, value});
     }
   }
 
-  if (points.empty() || size.isEmpty()) {
+  valid_ = true;
+  sig_ = *sig;
+  range_ = range;
+  size_ = size;
+  start_ = range_start;
+  end_ = range_end;
+  num_events_ = msgs.upperBound(range_end) - msgs.lowerBound(range_start);
+
+  if (values.empty() || size.isEmpty()) {
     pixmap = QPixmap();
     return;
   }
 
-  const auto [min, max] = std::minmax_element(points.begin(), points.end(),
-                                              [](auto &l, auto &r) { return l.y() < r.y(); });
-  min_val = min->y() == max->y() ? min->y() - 1 : min->y();
-  max_val = min->y() == max->y() ? max->y() + 1 : max->y();
-  freq_ = points.size() / std::max(points.back().x() - points.front().x(), 1.0);
-  render(sig->color, range, size);
+  const auto [min, max] = std::minmax_element(values.begin(), values.end(),
+                                              [](auto &l, auto &r) { return l.value < r.value; });
+  const double prev_min = min_val, prev_max = max_val;
+  min_val = min->value == max->value ? min->value - 1 : min->value;
+  max_val = min->value == max->value ? max->value + 1 : max->value;
+  freq_ = values.size() / std::max((values.back().mono_time - values.front().mono_time) / 1e9, 1.0);
+
+  // a new y range needs every point again
+  incremental = incremental && !pixmap.isNull() && min_val == prev_min && max_val == prev_max && first_new > 0;
+  if (!incremental || !renderNew(sig->color, first_new)) {
+    render(sig->color, range, size);
+  }
+  last_point = toPoint(values.back());
+}
+
+QPointF Sparkline::toPoint(const Value &v) const {
+  return QPointF((v.mono_time - origin_) * xscale_, 1 + std::abs(v.value - max_val) * yscale_);
 }
 
 void Sparkline::render(const QColor &color, int range, QSize size) {
-  const double xscale = (size.width() - 1) / (double)range;
-  const double yscale = (size.height() - 3) / (max_val - min_val);
-  for (auto &v : points) {
-    v = QPoint(v.x() * xscale, 1 + std::abs(v.y() - max_val) * yscale);
+  origin_ = start_;
+  xscale_ = (size.width() - 1) / (range * 1e9);
+  yscale_ = (size.height() - 3) / (max_val - min_val);
+  points.clear();
+  for (const auto &v : values) {
+    points.push_back(toPoint(v));
   }
 
   qreal dpr = qApp->devicePixelRatio();
@@ -48,13 +80,52 @@ void Sparkline::render(const QColor &color, int range, QSize size) {
   pixmap.setDevicePixelRatio(dpr);
   pixmap.fill(Qt::transparent);
   QPainter painter(&pixmap);
-  painter.setRenderHint(QPainter::Antialiasing, points.size() < 500);
+  antialiasing_ = points.size() < 500;
+  painter.setRenderHint(QPainter::Antialiasing, antialiasing_);
   painter.setPen(color);
   painter.drawPolyline(points.data(), points.size());
-  painter.setPen(QPen(color, 3));
-  if ((points.back().x() - points.front().x()) / points.size() > 8) {
+  draw_points_ = (points.back().x() - points.front().x()) / points.size() > 8;
+  if (draw_points_) {
+    painter.setPen(QPen(color, 3));
     painter.drawPoints(points.data(), points.size());
-  } else {
-    painter.drawPoint(points.back());
   }
 }
+
+bool Sparkline::renderNew(const QColor &color, size_t first) {
+  // the drawing style depends on the number of points
+  const double span = (values.back().mono_time - values.front().mono_time) * xscale_;
+  if ((values.size() < 500) != antialiasing_ || (span / values.size() > 8) != draw_points_) {
+    return false;
+  }
+
+  // scroll by whole device pixels and keep the remainder in the origin
+  const qreal dpr = pixmap.devicePixelRatio();
+  const int shift = std::floor((start_ - origin_) * xscale_ * dpr);
+  if (shift >= pixmap.width()) return false;
+
+  if (shift > 0) {
+    origin_ += shift / (xscale_ * dpr);
+    pixmap.scroll(-shift, 0, pixmap.rect());
+  }
+  QPainter painter(&pixmap);
+  if (shift > 0) {
+    painter.setCompositionMode(QPainter::CompositionMode_Source);
+    painter.fillRect(QRectF((pixmap.width() - shift) / dpr, 0, shift / dpr, pixmap.height() / dpr), Qt::transparent);
+    painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+  }
+  if (first == values.size()) return true;
+
+  // continue the line from the last point already drawn
+  points.clear();
+  for (size_t i = first - 1; i < values.size(); ++i) {
+    points.push_back(toPoint(values[i]));
+  }
+  painter.setRenderHint(QPainter::Antialiasing, antialiasing_);
+  painter.setPen(color);
+  painter.drawPolyline(points.data(), points.size());
+  if (draw_points_) {
+    painter.setPen(QPen(color, 3));
+    painter.drawPoints(points.data() + 1, points.size() - 1);
+  }
+  return true;
+}
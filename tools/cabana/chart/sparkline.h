@@ -2,11 +2,16 @@
 
 #include <QPixmap>
 #include <QPointF>
+#include <deque>
 #include <vector>
 
 #include "tools/cabana/dbc/dbc.h"
 #include "tools/cabana/streams/abstractstream.h"
 
+// A signal's recent values rendered into a cached pixmap. While the time window only
+// moves forward, update() decodes just the new events, scrolls the pixmap and draws the
+// new segment. It renders the whole line again only when the y range, the size or the
+// signal changes, or when events were merged into the window.
 class Sparkline {
 public:
   void update(const MessageId &msg_id, const cabana::Signal *sig, double last_msg_ts, int range, QSize size);
@@ -14,12 +19,37 @@ public:
   bool isEmpty() const { return pixmap.isNull(); }
 
   QPixmap pixmap;
+  // the newest point, highlighted by the delegate on top of the pixmap
+  QPointF last_point;
   double min_val = 0;
   double max_val = 0;
 
 private:
+  struct Value {
+    uint64_t mono_time;
+    double value;
+  };
+  QPointF toPoint(const Value &v) const;
   void render(const QColor &color, int range, QSize size);
+  // scrolls the pixmap to the new window and draws the values from index first on
+  bool renderNew(const QColor &color, size_t first);
 
+  std::deque<Value> values;
   std::vector<QPointF> points;
   double freq_ = 0;
+
+  // what the cached values and pixmap were made for
+  bool valid_ = false;
+  cabana::Signal sig_;
+  int range_ = 0;
+  QSize size_;
+  uint64_t start_ = 0;
+  uint64_t end_ = 0;
+  size_t num_events_ = 0;
+  // mono_time at x = 0 of the pixmap, and pixels per nanosecond
+  double origin_ = 0;
+  double xscale_ = 0;
+  double yscale_ = 0;
+  bool draw_points_ = false;
+  bool antialiasing_ = false;
 };
@@ -1,8 +1,18 @@
 #include "tools/cabana/dbc/dbc.h"
 
 #include <algorithm>
+#include <cmath>
+#include <cstring>
 
-#include "tools/cabana/utils/util.h"
+namespace {
+
+int num_decimals(double num) {
+  const QString string = QString::number(num);
+  auto dot_pos = string.indexOf('.');
+  return dot_pos == -1 ? 0 : string.size() - dot_pos - 1;
+}
+
+}  // namespace
 
 uint qHash(const MessageId &item) {
   return qHash(item.source) ^ qHash(item.address);
@@ -166,6 +176,17 @@ bool cabana::Signal::getValue(const uint8_t *data, size_t data_size, double *val
   return true;
 }
 
+void cabana::Signal::getValues(const uint8_t *data, size_t stride, const uint8_t *sizes, size_t count, double *values) const {
+  SignalDecoder(*this).decode(data, stride, sizes, count, values);
+  if (multiplexor) {
+    std::vector<double> mux_values(count);
+    SignalDecoder(*multiplexor).decode(data, stride, sizes, count, mux_values.data());
+    for (size_t i = 0; i < count; ++i) {
+      if (mux_values[i] != multiplex_value) values[i] = std::numeric_limits<double>::quiet_NaN();
+    }
+  }
+}
+
 bool cabana::Signal::operator==(const cabana::Signal &other) const {
   return name == other.name && size == other.size &&
          start_bit == other.start_bit &&
@@ -176,6 +197,107 @@ bool cabana::Signal::operator==(const cabana::Signal &other) const {
          multiplex_value == other.multiplex_value && type == other.type && receiver_name == other.receiver_name;
 }
 
+// cabana::SignalDecoder
+
+cabana::SignalDecoder::SignalDecoder(const cabana::Signal &sig)
+    : size(sig.size), is_signed(sig.is_signed), is_little_endian(sig.is_little_endian), factor(sig.factor), offset(sig.offset) {
+  // same walk as get_raw_value(), bounded by the largest CAN FD frame
+  constexpr int max_frame_size = 64;
+  int i = sig.msb / 8;
+  int bits = sig.size;
+  while (i >= 0 && i < max_frame_size && bits > 0 && num_steps < (int)steps.size()) {
+    int lsb = (int)(sig.lsb / 8) == i ? sig.lsb : i * 8;
+    int msb = (int)(sig.msb / 8) == i ? sig.msb : (i + 1) * 8 - 1;
+    int sz = msb - lsb + 1;
+
+    steps[num_steps++] = {.byte = (uint8_t)i, .shift = (uint8_t)(lsb - i * 8),
+                          .mask = (uint8_t)((1u << sz) - 1), .pos = (uint8_t)(bits - sz)};
+    min_size = std::max<size_t>(min_size, i + 1);
+
+    bits -= sz;
+    i = sig.is_little_endian ? i - 1 : i + 1;
+  }
+}
+
+int64_t cabana::SignalDecoder::rawValue(const uint8_t *data, size_t data_size) const {
+  int64_t val = 0;
+  for (int i = 0; i < num_steps && steps[i].byte < data_size; ++i) {
+    const auto &s = steps[i];
+    val |= (uint64_t)((data[s.byte] >> s.shift) & s.mask) << s.pos;
+  }
+  if (is_signed && size > 0 && size < 64 && ((val >> (size - 1)) & 0x1)) {
+    val -= (1ULL << size);
+  }
+  return val;
+}
+
+// Finds an 8-byte window [base, base + 8) inside each frame from which the raw value is
+// (load64(frame + base) >> shift) & mask, with bytes loaded in the signal's byte order.
+bool cabana::SignalDecoder::window(size_t stride, size_t *base, int *shift) const {
+  if (num_steps == 0 || stride < 8) return false;
+
+  int covered_bits = 0;
+  for (int i = 0; i < num_steps; ++i) covered_bits += __builtin_popcount(steps[i].mask);
+  if (covered_bits != size) return false;
+
+  const size_t first_byte = is_little_endian ? steps[num_steps - 1].byte : steps[0].byte;
+  const size_t last_byte = is_little_endian ? steps[0].byte : steps[num_steps - 1].byte;
+  *base = std::min(first_byte, stride - 8);
+  if (last_byte >= *base + 8) return false;
+
+  for (int i = 0; i < num_steps; ++i) {
+    const int offset_in_window = steps[i].byte - *base;
+    const int byte_pos = is_little_endian ? offset_in_window * 8 : (7 - offset_in_window) * 8;
+    const int step_shift = byte_pos + steps[i].shift - steps[i].pos;
+    if (i == 0) {
+      *shift = step_shift;
+    } else if (step_shift != *shift) {
+      return false;
+    }
+  }
+  return *shift >= 0 && *shift + size <= 64;
+}
+
+void cabana::SignalDecoder::decode(const uint8_t *data, size_t stride, const uint8_t *sizes, size_t count, double *values) const {
+  constexpr size_t block_size = 256;
+  int64_t raw[block_size];
+
+  size_t base = 0;
+  int shift = 0;
+  const bool has_window = window(stride, &base, &shift);
+  const uint64_t mask = size >= 64 ? ~0ULL : (1ULL << size) - 1;
+  const int64_t sign_bit = size > 0 && size < 64 ? (1LL << (size - 1)) : 0;
+
+  for (size_t begin = 0; begin < count; begin += block_size) {
+    const size_t n = std::min(block_size, count - begin);
+    const uint8_t *frames = data + begin * stride;
+    const uint8_t *frame_sizes = sizes + begin;
+
+    if (has_window && *std::min_element(frame_sizes, frame_sizes + n) >= min_size) {
+      // Straight-line loops over contiguous arrays, so the compiler can vectorize them.
+      for (size_t i = 0; i < n; ++i) {
+        uint64_t w;
+        memcpy(&w, frames + i * stride + base, sizeof(w));
+        w = is_little_endian ? w : __builtin_bswap64(w);
+        raw[i] = (w >> shift) & mask;
+      }
+      if (is_signed && sign_bit) {
+        for (size_t i = 0; i < n; ++i) {
+          raw[i] = (raw[i] ^ sign_bit) - sign_bit;
+        }
+      }
+    } else {
+      for (size_t i = 0; i < n; ++i) {
+        raw[i] = rawValue(frames + i * stride, frame_sizes[i]);
+      }
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+      values[begin + i] = raw[i] * factor + offset;
+    }
+  }
+}
+
 // helper functions
 
 double get_raw_value(const uint8_t *data, size_t data_size, const cabana::Signal &sig) {
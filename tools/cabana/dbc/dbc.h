@@ -1,5 +1,6 @@
 #pragma once
 
+#include <array>
 #include <limits>
 #include <utility>
 #include <vector>
@@ -55,6 +56,9 @@ public:
   Signal(const Signal &other) = default;
   void update();
   bool getValue(const uint8_t *data, size_t data_size, double *val) const;
+  // Batch version of getValue() for count frames stored stride bytes apart, sizes[i] being the
+  // length of frame i. values[i] is NaN where a multiplexed signal is not present.
+  void getValues(const uint8_t *data, size_t stride, const uint8_t *sizes, size_t count, double *values) const;
   QString formatValue(double value, bool with_unit = true) const;
   bool operator==(const cabana::Signal &other) const;
   inline bool operator!=(const cabana::Signal &other) const { return !(*this == other); }
@@ -85,6 +89,35 @@ public:
   Signal *multiplexor = nullptr;
 };
 
+// A Signal compiled into one shift-and-mask step per byte it covers, in the order get_raw_value()
+// visits them. When the signal fits in one 64-bit load, a batch is decoded with a single
+// shift and mask per frame.
+class SignalDecoder {
+public:
+  SignalDecoder(const Signal &sig);
+  double value(const uint8_t *data, size_t data_size) const { return rawValue(data, data_size) * factor + offset; }
+  void decode(const uint8_t *data, size_t stride, const uint8_t *sizes, size_t count, double *values) const;
+
+private:
+  struct Step {
+    uint8_t byte;   // byte index in the frame
+    uint8_t shift;  // right shift applied to the byte
+    uint8_t mask;   // mask applied after the shift
+    uint8_t pos;    // position of the extracted bits in the raw value
+  };
+  int64_t rawValue(const uint8_t *data, size_t data_size) const;
+  bool window(size_t stride, size_t *base, int *shift) const;
+
+  std::array<Step, 9> steps = {};
+  int num_steps = 0;
+  size_t min_size = 0;
+  int size;
+  bool is_signed;
+  bool is_little_endian;
+  double factor;
+  double offset;
+};
+
 class Msg {
 public:
   Msg() = default;
@@ -1,8 +1,11 @@
 #include "tools/cabana/dbc/dbcfile.h"
 
+#include <cctype>
+#include <cstring>
+#include <string_view>
+
 #include <QFile>
 #include <QFileInfo>
-#include <QRegularExpression>
 
 DBCFile::DBCFile(const QString &dbc_file_name) {
   QFile file(dbc_file_name);
@@ -61,45 +64,187 @@ cabana::Signal *DBCFile::signal(uint32_t address, const QString &name) {
   return m ? (cabana::Signal *)m->sig(name) : nullptr;
 }
 
+// A tokenizer over the UTF-8 text of a DBC file. Statements are matched on raw bytes and
+// only the parsed fields are converted to QString. Tracks the line and column of the last
+// token for error messages.
+class DBCFile::Scanner {
+public:
+  Scanner(const QByteArray &text) : p(text.constData()), end(text.constData() + text.size()), line_start(p) {}
+  inline bool atEnd() const { return p >= end; }
+  // position of the last token
+  inline int lineNumber() const { return token_line_num; }
+  inline int column() const { return token - token_line_start + 1; }
+
+  // the line of the last token, without the line break
+  QString lineText() const {
+    const char *eol = (const char *)memchr(token_line_start, '\n', end - token_line_start);
+    if (!eol) eol = end;
+    if (eol > token_line_start && eol[-1] == '\r') --eol;
+    return QString::fromUtf8(token_line_start, eol - token_line_start);
+  }
+
+  void nextLine() {
+    const char *eol = (const char *)memchr(p, '\n', end - p);
+    p = eol ? eol + 1 : end;
+    newLine();
+  }
+
+  void skipSpaces() {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\v' || *p == '\f')) ++p;
+    markToken();
+  }
+
+  void skipWhitespace() {
+    for (; p < end && isspace((unsigned char)*p); ++p) {
+      if (*p == '\n') newLine(p + 1);
+    }
+    markToken();
+  }
+
+  // consumes keyword if the text continues with it
+  bool consume(std::string_view keyword) {
+    if (end - p >= (ptrdiff_t)keyword.size() && memcmp(p, keyword.data(), keyword.size()) == 0) {
+      p += keyword.size();
+      return true;
+    }
+    return false;
+  }
+
+  bool consume(char c) {
+    skipSpaces();
+    if (p < end && *p == c) {
+      ++p;
+      return true;
+    }
+    return false;
+  }
+
+  void expect(char c) {
+    skipSpaces();
+    if (p >= end || *p != c) error(QString("expected '%1'").arg(c));
+    ++p;
+  }
+
+  inline char peek() {
+    skipSpaces();
+    return p < end ? *p : '\n';
+  }
+
+  // [A-Za-z0-9_]+
+  std::string_view word() {
+    return take([](char c) { return isalnum((unsigned char)c) || c == '_'; }, "expected identifier");
+  }
+
+  std::string_view digits() {
+    return take([](char c) { return c >= '0' && c <= '9'; }, "expected integer");
+  }
+
+  std::string_view number() {
+    return take([](char c) { return (c >= '0' && c <= '9') || c == '.' || c == '+' || c == '-' || c == 'e' || c == 'E'; }, "expected number");
+  }
+
+  // The contents of a quoted string, as written. Backslash escapes are skipped over if
+  // escapes is set, and the string may span lines if multiline is set.
+  std::string_view quoted(bool escapes, bool multiline) {
+    expect('"');
+    const char *begin = p;
+    for (; p < end && *p != '"'; ++p) {
+      if (escapes && *p == '\\' && p + 1 < end) {
+        ++p;
+      }
+      if (*p == '\n') {
+        if (!multiline) error("unterminated string");
+        newLine(p + 1);
+      }
+    }
+    if (p >= end) error("unterminated string");
+    return {begin, (size_t)(p++ - begin)};
+  }
+
+  // the rest of the line, trimmed
+  std::string_view rest() {
+    skipSpaces();
+    const char *begin = p;
+    while (p < end && *p != '\n') ++p;
+    const char *last = p;
+    while (last > begin && isspace((unsigned char)last[-1])) --last;
+    return {begin, (size_t)(last - begin)};
+  }
+
+  [[noreturn]] void error(const QString &what) { throw std::runtime_error(what.toStdString()); }
+
+private:
+  template <class Pred>
+  std::string_view take(Pred pred, const char *what) {
+    skipSpaces();
+    const char *begin = p;
+    while (p < end && pred(*p)) ++p;
+    if (p == begin) error(what);
+    return {begin, (size_t)(p - begin)};
+  }
+  inline void markToken() {
+    token = p;
+    token_line_start = line_start;
+    token_line_num = line_num;
+  }
+  inline void newLine(const char *start) {
+    line_start = start;
+    ++line_num;
+  }
+  inline void newLine() {
+    newLine(p);
+  }
+
+  const char *p, *end;
+  const char *line_start;
+  const char *token = nullptr, *token_line_start = nullptr;
+  int line_num = 1, token_line_num = 1;
+};
+
+namespace {
+
+inline QString toQString(std::string_view s) { return QString::fromUtf8(s.data(), s.size()); }
+inline QByteArray toBytes(std::string_view s) { return QByteArray::fromRawData(s.data(), s.size()); }
+
+}  // namespace
+
 void DBCFile::parse(const QString &content) {
   msgs.clear();
 
-  int line_num = 0;
-  QString line;
+  const QByteArray text = content.toUtf8();
+  Scanner s(text);
   cabana::Msg *current_msg = nullptr;
   int multiplexor_cnt = 0;
   bool seen_first = false;
-  QTextStream stream((QString *)&content);
 
-  while (!stream.atEnd()) {
-    ++line_num;
-    QString raw_line = stream.readLine();
-    line = raw_line.trimmed();
+  for (; !s.atEnd(); s.nextLine()) {
+    s.skipSpaces();
 
     bool seen = true;
     try {
-      if (line.startsWith("BO_ ")) {
+      if (s.consume("BO_ ")) {
         multiplexor_cnt = 0;
-        current_msg = parseBO(line);
-      } else if (line.startsWith("SG_ ")) {
-        parseSG(line, current_msg, multiplexor_cnt);
-      } else if (line.startsWith("VAL_ ")) {
-        parseVAL(line);
-      } else if (line.startsWith("CM_ BO_")) {
-        parseCM_BO(line, content, raw_line, stream);
-      } else if (line.startsWith("CM_ SG_ ")) {
-        parseCM_SG(line, content, raw_line, stream);
+        current_msg = parseBO(s);
+      } else if (s.consume("SG_ ")) {
+        parseSG(s, current_msg, multiplexor_cnt);
+      } else if (s.consume("VAL_ ")) {
+        parseVAL(s);
+      } else if (s.consume("CM_ BO_")) {
+        parseCM_BO(s);
+      } else if (s.consume("CM_ SG_ ")) {
+        parseCM_SG(s);
       } else {
         seen = false;
       }
     } catch (std::exception &e) {
-      throw std::runtime_error(QString("[%1:%2]%3: %4").arg(filename).arg(line_num).arg(e.what()).arg(line).toStdString());
+      throw std::runtime_error(QString("[%1:%2:%3]%4: %5").arg(filename).arg(s.lineNumber()).arg(s.column())
+                                   .arg(e.what()).arg(s.lineText().trimmed()).toStdString());
     }
 
     if (seen) {
       seen_first = true;
     } else if (!seen_first) {
-      header += raw_line + "\n";
+      header += s.lineText() + "\n";
     }
   }
 
@@ -108,124 +253,109 @@ void DBCFile::parse(const QString &content) {
   }
 }
 
-cabana::Msg *DBCFile::parseBO(const QString &line) {
-  static QRegularExpression bo_regexp(R"(^BO_ (?<address>\w+) (?<name>\w+) *: (?<size>\w+) (?<transmitter>\w+))");
-
-  QRegularExpressionMatch match = bo_regexp.match(line);
-  if (!match.hasMatch())
-    throw std::runtime_error("Invalid BO_ line format");
-
-  uint32_t address = match.captured("address").toUInt();
+cabana::Msg *DBCFile::parseBO(Scanner &s) {
+  uint32_t address = toBytes(s.word()).toUInt();
   if (msgs.count(address) > 0)
-    throw std::runtime_error(QString("Duplicate message address: %1").arg(address).toStdString());
+    s.error(QString("Duplicate message address: %1").arg(address));
+
+  auto name = s.word();
+  s.expect(':');
+  auto size = s.word();
+  auto transmitter = s.word();
 
   // Create a new message object
   cabana::Msg *msg = &msgs[address];
   msg->address = address;
-  msg->name = match.captured("name");
-  msg->size = match.captured("size").toULong();
-  msg->transmitter = match.captured("transmitter").trimmed();
+  msg->name = toQString(name);
+  msg->size = toBytes(size).toULong();
+  msg->transmitter = toQString(transmitter);
   return msg;
 }
 
-void DBCFile::parseCM_BO(const QString &line, const QString &content, const QString &raw_line, const QTextStream &stream) {
-  static QRegularExpression msg_comment_regexp(R"(^CM_ BO_ *(?<address>\w+) *\"(?<comment>(?:[^"\\]|\\.)*)\"\s*;)");
+void DBCFile::parseCM_BO(Scanner &s) {
+  uint32_t address = toBytes(s.word()).toUInt();
+  auto comment = s.quoted(true, true);
+  s.skipWhitespace();
+  s.expect(';');
 
-  QString parse_line = line;
-  if (!parse_line.endsWith("\";")) {
-    int pos = stream.pos() - raw_line.length() - 1;
-    parse_line = content.mid(pos, content.indexOf("\";", pos));
-  }
-  auto match = msg_comment_regexp.match(parse_line);
-  if (!match.hasMatch())
-    throw std::runtime_error("Invalid message comment format");
-
-  if (auto m = (cabana::Msg *)msg(match.captured("address").toUInt()))
-    m->comment = match.captured("comment").trimmed().replace("\\\"", "\"");
+  if (auto m = (cabana::Msg *)msg(address))
+    m->comment = toQString(comment).trimmed().replace("\\\"", "\"");
 }
 
-void DBCFile::parseSG(const QString &line, cabana::Msg *current_msg, int &multiplexor_cnt) {
-  static QRegularExpression sg_regexp(R"(^SG_ (\w+) : (\d+)\|(\d+)@(\d+)([\+|\-]) \(([0-9.+\-eE]+),([0-9.+\-eE]+)\) \[([0-9.+\-eE]+)\|([0-9.+\-eE]+)\] \"(.*)\" (.*))");
-  static QRegularExpression sgm_regexp(R"(^SG_ (\w+) (\w+) *: (\d+)\|(\d+)@(\d+)([\+|\-]) \(([0-9.+\-eE]+),([0-9.+\-eE]+)\) \[([0-9.+\-eE]+)\|([0-9.+\-eE]+)\] \"(.*)\" (.*))");
-
+void DBCFile::parseSG(Scanner &s, cabana::Msg *current_msg, int &multiplexor_cnt) {
   if (!current_msg)
-    throw std::runtime_error("No Message");
+    s.error("No Message");
 
-  int offset = 0;
-  auto match = sg_regexp.match(line);
-  if (!match.hasMatch()) {
-    match = sgm_regexp.match(line);
-    offset = 1;
-  }
-  if (!match.hasMatch())
-    throw std::runtime_error("Invalid SG_ line format");
-
-  QString name = match.captured(1);
+  QString name = toQString(s.word());
   if (current_msg->sig(name) != nullptr)
-    throw std::runtime_error("Duplicate signal name");
+    s.error("Duplicate signal name");
 
-  cabana::Signal s{};
-  if (offset == 1) {
-    auto indicator = match.captured(2);
+  cabana::Signal sig{};
+  if (s.peek() != ':') {
+    auto indicator = s.word();
     if (indicator == "M") {
       ++multiplexor_cnt;
       // Only one signal within a single message can be the multiplexer switch.
       if (multiplexor_cnt >= 2)
-        throw std::runtime_error("Multiple multiplexor");
+        s.error("Multiple multiplexor");
 
-      s.type = cabana::Signal::Type::Multiplexor;
+      sig.type = cabana::Signal::Type::Multiplexor;
     } else {
-      s.type = cabana::Signal::Type::Multiplexed;
-      s.multiplex_value = indicator.mid(1).toInt();
+      sig.type = cabana::Signal::Type::Multiplexed;
+      sig.multiplex_value = toBytes(indicator.substr(1)).toInt();
     }
   }
-  s.name = name;
-  s.start_bit = match.captured(offset + 2).toInt();
-  s.size = match.captured(offset + 3).toInt();
-  s.is_little_endian = match.captured(offset + 4).toInt() == 1;
-  s.is_signed = match.captured(offset + 5) == "-";
-  s.factor = match.captured(offset + 6).toDouble();
-  s.offset = match.captured(offset + 7).toDouble();
-  s.min = match.captured(8 + offset).toDouble();
-  s.max = match.captured(9 + offset).toDouble();
-  s.unit = match.captured(10 + offset);
-  s.receiver_name = match.captured(11 + offset).trimmed();
-  current_msg->sigs.push_back(new cabana::Signal(s));
+  s.expect(':');
+  sig.name = name;
+  sig.start_bit = toBytes(s.digits()).toInt();
+  s.expect('|');
+  sig.size = toBytes(s.digits()).toInt();
+  s.expect('@');
+  sig.is_little_endian = toBytes(s.digits()).toInt() == 1;
+  sig.is_signed = s.peek() == '-';
+  if (!s.consume('+') && !s.consume('-'))
+    s.error("expected '+' or '-'");
+  s.expect('(');
+  sig.factor = toBytes(s.number()).toDouble();
+  s.expect(',');
+  sig.offset = toBytes(s.number()).toDouble();
+  s.expect(')');
+  s.expect('[');
+  sig.min = toBytes(s.number()).toDouble();
+  s.expect('|');
+  sig.max = toBytes(s.number()).toDouble();
+  s.expect(']');
+  sig.unit = toQString(s.quoted(false, false));
+  sig.receiver_name = toQString(s.rest());
+  current_msg->sigs.push_back(new cabana::Signal(sig));
 }
 
-void DBCFile::parseCM_SG(const QString &line, const QString &content, const QString &raw_line, const QTextStream &stream) {
-  static QRegularExpression sg_comment_regexp(R"(^CM_ SG_ *(\w+) *(\w+) *\"((?:[^"\\]|\\.)*)\"\s*;)");
-
-  QString parse_line = line;
-  if (!parse_line.endsWith("\";")) {
-    int pos = stream.pos() - raw_line.length() - 1;
-    parse_line = content.mid(pos, content.indexOf("\";", pos));
-  }
-  auto match = sg_comment_regexp.match(parse_line);
-  if (!match.hasMatch())
-    throw std::runtime_error("Invalid CM_ SG_ line format");
+void DBCFile::parseCM_SG(Scanner &s) {
+  uint32_t address = toBytes(s.word()).toUInt();
+  QString name = toQString(s.word());
+  auto comment = s.quoted(true, true);
+  s.skipWhitespace();
+  s.expect(';');
 
-  if (auto s = signal(match.captured(1).toUInt(), match.captured(2))) {
-    s->comment = match.captured(3).trimmed().replace("\\\"", "\"");
+  if (auto sig = signal(address, name)) {
+    sig->comment = toQString(comment).trimmed().replace("\\\"", "\"");
   }
 }
 
-void DBCFile::parseVAL(const QString &line) {
-  static QRegularExpression val_regexp(R"(VAL_ (\w+) (\w+) (\s*[-+]?[0-9]+\s+\".+?\"[^;]*))");
+void DBCFile::parseVAL(Scanner &s) {
+  uint32_t address = toBytes(s.word()).toUInt();
+  QString name = toQString(s.word());
 
-  auto match = val_regexp.match(line);
-  if (!match.hasMatch())
-    throw std::runtime_error("invalid VAL_ line format");
+  ValueDescription val_desc;
+  while (s.peek() != ';' && s.peek() != '\n') {
+    double val = toBytes(s.number()).toDouble();
+    val_desc.push_back({val, toQString(s.quoted(false, false)).trimmed()});
+  }
+  if (val_desc.empty())
+    s.error("invalid VAL_ line format");
 
-  if (auto s = signal(match.captured(1).toUInt(), match.captured(2))) {
-    QStringList desc_list = match.captured(3).trimmed().split('"');
-    for (int i = 0; i < desc_list.size(); i += 2) {
-      auto val = desc_list[i].trimmed();
-      if (!val.isEmpty() && (i + 1) < desc_list.size()) {
-        auto desc = desc_list[i + 1].trimmed();
-        s->val_desc.push_back({val.toDouble(), desc});
-      }
-    }
+  if (auto sig = signal(address, name)) {
+    sig->val_desc.insert(sig->val_desc.end(), val_desc.begin(), val_desc.end());
   }
 }
 
@@ -1,7 +1,6 @@
 #pragma once
 
 #include <map>
-#include <QTextStream>
 
 #include "tools/cabana/dbc/dbc.h"
 
@@ -31,12 +30,13 @@ public:
   QString filename;
 
 private:
+  class Scanner;
   void parse(const QString &content);
-  cabana::Msg *parseBO(const QString &line);
-  void parseSG(const QString &line, cabana::Msg *current_msg, int &multiplexor_cnt);
-  void parseCM_BO(const QString &line, const QString &content, const QString &raw_line, const QTextStream &stream);
-  void parseCM_SG(const QString &line, const QString &content, const QString &raw_line, const QTextStream &stream);
-  void parseVAL(const QString &line);
+  cabana::Msg *parseBO(Scanner &s);
+  void parseSG(Scanner &s, cabana::Msg *current_msg, int &multiplexor_cnt);
+  void parseCM_BO(Scanner &s);
+  void parseCM_SG(Scanner &s);
+  void parseVAL(Scanner &s);
 
   QString header;
   std::map<uint32_t, cabana::Msg> msgs;
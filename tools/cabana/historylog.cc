@@ -1,44 +1,104 @@
 #include "tools/cabana/historylog.h"
 
+#include <cmath>
 #include <functional>
 
 #include <QFileDialog>
 #include <QPainter>
 #include <QVBoxLayout>
+#include <QtConcurrent>
 
 #include "tools/cabana/commands.h"
 #include "tools/cabana/utils/export.h"
 
+HistoryLogModel::HistoryLogModel(QObject *parent) : QAbstractTableModel(parent) {
+  filter_abort = std::make_shared<std::atomic<bool>>(false);
+  QObject::connect(&filter_watcher, &QFutureWatcher<std::vector<uint32_t>>::finished, this, &HistoryLogModel::filterFinished);
+}
+
+HistoryLogModel::~HistoryLogModel() {
+  stopFilter();
+}
+
 QVariant HistoryLogModel::data(const QModelIndex &index, int role) const {
-  const auto &m = messages[index.row()];
+  const size_t i = eventIndex(index.row());
   const int col = index.column();
   if (role == Qt::DisplayRole) {
-    if (col == 0) return QString::number(can->toSeconds(m.mono_time), 'f', 3);
-    if (!isHexMode()) return sigs[col - 1]->formatValue(m.sig_values[col - 1], false);
+    if (col == 0) return QString::number(can->toSeconds(can->events(msg_id)[i].mono_time), 'f', 3);
+    if (!isHexMode()) {
+      const auto &b = block(i);
+      double value = b.values[(col - 1) * b.count + i % BLOCK_SIZE];
+      return std::isnan(value) ? QString() : sigs[col - 1]->formatValue(value, false);
+    }
   } else if (role == Qt::TextAlignmentRole) {
     return (uint32_t)(Qt::AlignRight | Qt::AlignVCenter);
   }
 
   if (isHexMode() && col == 1) {
-    if (role == ColorsRole) return QVariant::fromValue((void *)(&m.colors));
-    if (role == BytesRole) return QVariant::fromValue((void *)(&m.data));
+    const auto &b = block(i);
+    if (role == ColorsRole) return QVariant::fromValue((void *)(&b.colors[i % BLOCK_SIZE]));
+    if (role == BytesRole) return QVariant::fromValue((void *)(&b.data[i % BLOCK_SIZE]));
   }
   return {};
 }
 
+const HistoryLogModel::Block &HistoryLogModel::block(size_t event_index) const {
+  const size_t first = event_index - event_index % BLOCK_SIZE;
+  auto it = cache.find(first);
+  if (it == cache.end() || it->second.count <= event_index - first) {
+    if (it == cache.end() && cache.size() >= MAX_CACHED_BLOCKS) {
+      cache.erase(std::min_element(cache.begin(), cache.end(), [](auto &l, auto &r) { return l.second.last_used < r.second.last_used; }));
+    }
+    const auto events = can->events(msg_id);
+    const size_t n = std::min(BLOCK_SIZE, events.size() - first);
+    const CanEventsView view(events.begin() + first, events.begin() + first + n);
+
+    Block &b = cache[first];
+    b.count = n;
+    b.values.resize(sigs.size() * n);
+    for (int i = 0; i < sigs.size(); ++i) {
+      view.getValues(sigs[i], &b.values[i * n]);
+    }
+
+    if (isHexMode()) {
+      // colors depend on the preceding changes, start a few events early so they settle
+      const size_t warmup = std::min<size_t>(first, 32);
+      const auto freq = can->lastMessage(msg_id).freq;
+      const std::vector<uint8_t> no_mask;
+      CanData hex_colors;
+      b.data.resize(n);
+      b.colors.resize(n);
+      for (size_t j = first - warmup; j < first + n; ++j) {
+        const CanEvent e = events[j];
+        hex_colors.compute(e.dat, e.size, can->toSeconds(e.mono_time), can->getSpeed(), no_mask, nullptr, freq);
+        if (j >= first) {
+          b.data[j - first].assign(e.dat, e.dat + e.size);
+          b.colors[j - first] = hex_colors.colors;
+        }
+      }
+    }
+    it = cache.find(first);
+  }
+  it->second.last_used = ++cache_clock;
+  return it->second;
+}
+
 void HistoryLogModel::setMessage(const MessageId &message_id) {
   msg_id = message_id;
   reset();
 }
 
 void HistoryLogModel::reset() {
+  stopFilter();
   beginResetModel();
   sigs.clear();
   if (auto dbc_msg = dbc()->msg(msg_id)) {
     sigs = dbc_msg->getSignals();
   }
-  messages.clear();
-  hex_colors = {};
+  num_events = 0;
+  filtered_rows.clear();
+  filtered_upto = 0;
+  cache.clear();
   endResetModel();
   setFilter(0, "", nullptr);
 }
@@ -75,61 +135,93 @@ void HistoryLogModel::setFilter(int sig_idx, const QString &value, std::function
 }
 
 void HistoryLogModel::updateState(bool clear) {
-  if (clear && !messages.empty()) {
-    beginRemoveRows({}, 0, messages.size() - 1);
-    messages.clear();
-    endRemoveRows();
+  // the events up to the current time, CanData::count is the number of events processed so far
+  const size_t n = std::min<size_t>(can->lastMessage(msg_id).count, can->events(msg_id).size());
+  if (clear || n < num_events) {
+    clearRows();
+  }
+  if (n > num_events) {
+    if (!filter_cmp) {
+      beginInsertRows({}, 0, n - num_events - 1);
+      num_events = n;
+      endInsertRows();
+    } else {
+      num_events = n;
+      startFilter();
+    }
   }
-  uint64_t current_time = can->toMonoTime(can->lastMessage(msg_id).ts) + 1;
-  fetchData(messages.begin(), current_time, messages.empty() ? 0 : messages.front().mono_time);
 }
 
-bool HistoryLogModel::canFetchMore(const QModelIndex &parent) const {
-  const auto &events = can->events(msg_id);
-  return !events.empty() && !messages.empty() && messages.back().mono_time > events.front()->mono_time;
+void HistoryLogModel::eventsMerged(const MessageEventsMap &new_events) {
+  // rows are event indices, start over if the events were inserted before the last row
+  auto it = new_events.find(msg_id);
+  if (it != new_events.end() && !it->second.empty() && num_events > 0 &&
+      it->second.front().mono_time <= can->events(msg_id)[num_events - 1].mono_time) {
+    updateState(true);
+  }
 }
 
-void HistoryLogModel::fetchMore(const QModelIndex &parent) {
-  if (!messages.empty())
-    fetchData(messages.end(), messages.back().mono_time, 0);
+void HistoryLogModel::clearRows() {
+  stopFilter();
+  const int rows = rowCount();
+  if (rows > 0) beginRemoveRows({}, 0, rows - 1);
+  num_events = 0;
+  filtered_rows.clear();
+  filtered_upto = 0;
+  cache.clear();
+  if (rows > 0) endRemoveRows();
 }
 
-void HistoryLogModel::fetchData(std::deque<Message>::iterator insert_pos, uint64_t from_time, uint64_t min_time) {
-  const auto &events = can->events(msg_id);
-  auto first = std::upper_bound(events.rbegin(), events.rend(), from_time, [](uint64_t ts, auto e) {
-    return ts > e->mono_time;
-  });
+void HistoryLogModel::startFilter() {
+  if (!filter_cmp || filter_pending || filtered_upto >= num_events) return;
+  if (filter_sig_idx < 0 || filter_sig_idx >= sigs.size()) return;
 
-  std::vector<HistoryLogModel::Message> msgs;
-  std::vector<double> values(sigs.size());
-  msgs.reserve(batch_size);
-  for (; first != events.rend() && (*first)->mono_time > min_time; ++first) {
-    const CanEvent *e = *first;
-    for (int i = 0; i < sigs.size(); ++i) {
-      sigs[i]->getValue(e->dat, e->size, &values[i]);
-    }
-    if (!filter_cmp || filter_cmp(values[filter_sig_idx], filter_value)) {
-       msgs.emplace_back(Message{e->mono_time, values, {e->dat, e->dat + e->size}});
-      if (msgs.size() >= batch_size && min_time == 0) {
-        break;
-      }
-    }
-  }
+  // filter a copy of the new events, the store may be merged into while the worker runs
+  const auto events = can->events(msg_id);
+  const CanEventsView view(events.begin() + filtered_upto, events.begin() + num_events);
+  auto copy = std::make_shared<CanEventStore>(msg_id);
+  view.forEachSpan([&](const CanEventsView::Span &s) { copy->append(s.mono_times, s.sizes, s.data, view.stride(), s.count); });
 
-  if (!msgs.empty()) {
-    if (isHexMode() && (min_time > 0 || messages.empty())) {
-      const auto freq = can->lastMessage(msg_id).freq;
-      const std::vector<uint8_t> no_mask;
-      for (auto &m : msgs) {
-        hex_colors.compute(msg_id, m.data.data(), m.data.size(), m.mono_time / (double)1e9, can->getSpeed(), no_mask, freq);
-        m.colors = hex_colors.colors;
+  // and of the signal, which can be edited or removed meanwhile
+  filter_watcher.setFuture(QtConcurrent::run([events = copy, sig = *sigs[filter_sig_idx], cmp = filter_cmp, value = filter_value,
+                                              first = filtered_upto, abort = filter_abort]() {
+    std::vector<uint32_t> rows;
+    std::vector<double> values(BLOCK_SIZE);
+    for (size_t i = 0; i < events->size() && !*abort; i += BLOCK_SIZE) {
+      const size_t n = std::min(BLOCK_SIZE, events->size() - i);
+      CanEventsView(events->begin() + i, events->begin() + i + n).getValues(&sig, values.data());
+      for (size_t j = 0; j < n; ++j) {
+        if (!std::isnan(values[j]) && cmp(values[j], value)) {
+          rows.push_back(first + i + j);
+        }
       }
     }
-    int pos = std::distance(messages.begin(), insert_pos);
-    beginInsertRows({}, pos , pos + msgs.size() - 1);
-    messages.insert(insert_pos, std::move_iterator(msgs.begin()), std::move_iterator(msgs.end()));
+    return rows;
+  }));
+  filter_pending = true;
+  filtered_upto = num_events;
+}
+
+void HistoryLogModel::stopFilter() {
+  *filter_abort = true;
+  filter_watcher.waitForFinished();
+  filter_abort = std::make_shared<std::atomic<bool>>(false);
+  filter_pending = false;
+}
+
+void HistoryLogModel::filterFinished() {
+  // ignore runs that were stopped before they finished
+  if (!filter_pending || !filter_watcher.isFinished()) return;
+
+  filter_pending = false;
+  const auto rows = filter_watcher.result();
+  if (!rows.empty()) {
+    beginInsertRows({}, 0, rows.size() - 1);
+    filtered_rows.insert(filtered_rows.end(), rows.begin(), rows.end());
     endInsertRows();
   }
+  // filter the events that arrived while the worker was running
+  startFilter();
 }
 
 // HeaderView
@@ -207,6 +299,7 @@ LogsWidget::LogsWidget(QWidget *parent) : QFrame(parent) {
   QObject::connect(value_edit, &QLineEdit::textEdited, this, &LogsWidget::filterChanged);
   QObject::connect(export_btn, &QToolButton::clicked, this, &LogsWidget::exportToCSV);
   QObject::connect(can, &AbstractStream::seekedTo, model, &HistoryLogModel::reset);
+  QObject::connect(can, &AbstractStream::eventsMerged, model, &HistoryLogModel::eventsMerged);
   QObject::connect(dbc(), &DBCManager::DBCFileChanged, model, &HistoryLogModel::reset);
   QObject::connect(UndoStack::instance(), &QUndoStack::indexChanged, model, &HistoryLogModel::reset);
   QObject::connect(model, &HistoryLogModel::modelReset, this, &LogsWidget::modelReset);
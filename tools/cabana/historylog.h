@@ -1,9 +1,13 @@
 #pragma once
 
-#include <deque>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <unordered_map>
 #include <vector>
 
 #include <QComboBox>
+#include <QFutureWatcher>
 #include <QHeaderView>
 #include <QLineEdit>
 #include <QTableView>
@@ -18,42 +22,65 @@ public:
   void paintSection(QPainter *painter, const QRect &rect, int logicalIndex) const;
 };
 
+// A virtual view of the events of one message up to the current time, newest first.
+// Rows map straight to indices in the message's event store. Signal values, bytes and
+// hex colors are decoded in blocks of consecutive events and kept in a small cache, so
+// only what is on screen is decoded. Filtering by a signal value runs on a worker thread.
 class HistoryLogModel : public QAbstractTableModel {
   Q_OBJECT
 
 public:
-  HistoryLogModel(QObject *parent) : QAbstractTableModel(parent) {}
+  HistoryLogModel(QObject *parent);
+  ~HistoryLogModel();
   void setMessage(const MessageId &message_id);
   void updateState(bool clear = false);
+  void eventsMerged(const MessageEventsMap &new_events);
   void setFilter(int sig_idx, const QString &value, std::function<bool(double, double)> cmp);
   QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
   QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
-  void fetchMore(const QModelIndex &parent) override;
-  bool canFetchMore(const QModelIndex &parent) const override;
-  int rowCount(const QModelIndex &parent = QModelIndex()) const override { return messages.size(); }
+  int rowCount(const QModelIndex &parent = QModelIndex()) const override { return filter_cmp ? filtered_rows.size() : num_events; }
   int columnCount(const QModelIndex &parent = QModelIndex()) const override { return !isHexMode() ? sigs.size() + 1 : 2; }
   inline bool isHexMode() const { return sigs.empty() || hex_mode; }
   void reset();
   void setHexMode(bool hex_mode);
 
-  struct Message {
-    uint64_t mono_time = 0;
-    std::vector<double> sig_values;
-    std::vector<uint8_t> data;
-    std::vector<QColor> colors;
+  MessageId msg_id;
+  std::vector<cabana::Signal *> sigs;
+
+private:
+  struct Block {
+    size_t count = 0;
+    std::vector<double> values;  // sigs.size() columns of count values
+    std::vector<std::vector<uint8_t>> data;
+    std::vector<std::vector<QColor>> colors;
+    uint64_t last_used = 0;
   };
 
-  void fetchData(std::deque<Message>::iterator insert_pos, uint64_t from_time, uint64_t min_time);
+  inline size_t eventIndex(int row) const {
+    return filter_cmp ? filtered_rows[filtered_rows.size() - 1 - row] : num_events - 1 - row;
+  }
+  const Block &block(size_t event_index) const;
+  void clearRows();
+  void startFilter();
+  void stopFilter();
+  void filterFinished();
+
+  static constexpr size_t BLOCK_SIZE = 256;
+  static constexpr size_t MAX_CACHED_BLOCKS = 64;
+
+  bool hex_mode = false;
+  size_t num_events = 0;
+  mutable std::unordered_map<size_t, Block> cache;
+  mutable uint64_t cache_clock = 0;
 
-  MessageId msg_id;
-  CanData hex_colors;
-  const int batch_size = 50;
   int filter_sig_idx = -1;
   double filter_value = 0;
   std::function<bool(double, double)> filter_cmp = nullptr;
-  std::deque<Message> messages;
-  std::vector<cabana::Signal *> sigs;
-  bool hex_mode = false;
+  std::vector<uint32_t> filtered_rows;  // ascending event indices that match the filter
+  size_t filtered_upto = 0;             // events before this index have been filtered
+  bool filter_pending = false;
+  std::shared_ptr<std::atomic<bool>> filter_abort;
+  QFutureWatcher<std::vector<uint32_t>> filter_watcher;
 };
 
 class LogsWidget : public QFrame {
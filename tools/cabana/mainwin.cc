@@ -22,6 +22,7 @@
 
 #include "tools/cabana/commands.h"
 #include "tools/cabana/streamselector.h"
+#include "tools/cabana/streams/livestream.h"
 #include "tools/cabana/tools/findsignal.h"
 #include "tools/cabana/utils/export.h"
 
@@ -202,6 +203,10 @@ void MainWindow::createStatusBar() {
   statusBar()->addWidget(new QLabel(tr("For Help, Press F1")));
   statusBar()->addPermanentWidget(progress_bar);
   statusBar()->addPermanentWidget(status_label = new QLabel(this));
+  // bus statistics are computed in the background, pick up the latest snapshot periodically
+  auto status_timer = new QTimer(this);
+  QObject::connect(status_timer, &QTimer::timeout, this, &MainWindow::updateStatus);
+  status_timer->start(1000);
   updateStatus();
 }
 
@@ -339,6 +344,10 @@ void MainWindow::openStream(AbstractStream *stream, const QString &dbc_file) {
   }
 
   QObject::connect(can, &AbstractStream::eventsMerged, this, &MainWindow::eventsMerged);
+  if (auto live_stream = qobject_cast<LiveStream *>(can)) {
+    QObject::connect(live_stream, &LiveStream::framesMerged, this, &MainWindow::updateStatus);
+  }
+  updateStatus();
 
   if (has_stream) {
     auto wait_dlg = new QProgressDialog(
@@ -512,7 +521,23 @@ void MainWindow::updateDownloadProgress(uint64_t cur, uint64_t total, bool succe
 }
 
 void MainWindow::updateStatus() {
-  status_label->setText(tr("Cached Minutes:%1 FPS:%2").arg(settings.max_cached_minutes).arg(settings.fps));
+  QString text = tr("Cached Minutes:%1 FPS:%2").arg(settings.max_cached_minutes).arg(settings.fps);
+  if (auto live_stream = qobject_cast<LiveStream *>(can)) {
+    text += tr(" Frames merged:%1 dropped:%2").arg(live_stream->mergedFrames()).arg(live_stream->droppedFrames());
+  }
+  QStringList tooltip;
+  if (can) {
+    // live streams show the last second, routes the average over the loaded segments
+    const bool live = can->liveStreaming();
+    for (const auto &[source, bus] : can->busStatistics().buses) {
+      text += tr(" Bus %1:%2%").arg((int)source).arg(live ? bus.last_load : bus.load, 0, 'f', 1);
+      tooltip << tr("Bus %1: %2 frames, %3 kbit/s, load %4% (peak %5%, last second %6%)")
+                     .arg((int)source).arg(bus.frames).arg(bus.bits_per_sec / 1000.0, 0, 'f', 1)
+                     .arg(bus.load, 0, 'f', 1).arg(bus.peak_load, 0, 'f', 1).arg(bus.last_load, 0, 'f', 1);
+    }
+  }
+  status_label->setText(text);
+  status_label->setToolTip(tooltip.join("\n"));
 }
 
 bool MainWindow::eventFilter(QObject *obj, QEvent *event) {
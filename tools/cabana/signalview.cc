@@ -329,6 +329,8 @@ void SignalItemDelegate::paint(QPainter *painter, const QStyleOptionViewItem &op
     if (!item->sparkline.pixmap.isNull()) {
       QSize sparkline_size = item->sparkline.pixmap.size() / item->sparkline.pixmap.devicePixelRatio();
       painter->drawPixmap(QRect(rect.topLeft(), sparkline_size), item->sparkline.pixmap);
+      painter->setPen(QPen(item->sig->color, 3));
+      painter->drawPoint(rect.topLeft() + item->sparkline.last_point);
       // min-max value
       painter->setPen(option.palette.color(option.state & QStyle::State_Selected ? QPalette::HighlightedText : QPalette::Text));
       rect.adjust(sparkline_size.width() + 1, 0, 0, 0);
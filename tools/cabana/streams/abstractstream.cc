@@ -1,18 +1,17 @@
 #include "tools/cabana/streams/abstractstream.h"
 
+#include <cmath>
+#include <numeric>
 #include <utility>
 
 #include <QApplication>
 #include "common/timing.h"
 #include "tools/cabana/settings.h"
 
-static const int EVENT_NEXT_BUFFER_SIZE = 6 * 1024 * 1024;  // 6MB
-
 AbstractStream *can = nullptr;
 
 AbstractStream::AbstractStream(QObject *parent) : QObject(parent) {
   assert(parent != nullptr);
-  event_buffer_ = std::make_unique<MonotonicBuffer>(EVENT_NEXT_BUFFER_SIZE);
 
   QObject::connect(this, &AbstractStream::privateUpdateLastMsgsSignal, this, &AbstractStream::updateLastMessages, Qt::QueuedConnection);
   QObject::connect(this, &AbstractStream::seekedTo, this, &AbstractStream::updateLastMsgsTo);
@@ -110,14 +109,65 @@ void AbstractStream::setTimeRange(const std::optional<std::pair<double, double>>
 
 void AbstractStream::updateEvent(const MessageId &id, double sec, const uint8_t *data, uint8_t size) {
   std::lock_guard lk(mutex_);
-  messages_[id].compute(id, data, size, sec, getSpeed(), masks_[id]);
+  if (!checkpoints_.count((int64_t)(sec / CHECKPOINT_INTERVAL))) {
+    saveCheckpoint(sec);
+  }
+  messages_[id].compute(data, size, sec, getSpeed(), masks_[id], &freq_estimators_[id]);
   new_msgs_.insert(id);
 }
 
-const std::vector<const CanEvent *> &AbstractStream::events(const MessageId &id) const {
-  static std::vector<const CanEvent *> empty_events;
+CanEventsView AbstractStream::events(const MessageId &id) const {
   auto it = events_.find(id);
-  return it != events_.end() ? it->second : empty_events;
+  return it != events_.end() ? CanEventsView(it->second) : CanEventsView();
+}
+
+void AbstractStream::forEachEvent(const std::function<void(const CanEvent &)> &fn) const {
+  // k-way merge of the per-message stores
+  using Cursor = std::pair<CanEventIterator, CanEventIterator>;
+  auto later = [](const Cursor &l, const Cursor &r) { return l.first->mono_time > r.first->mono_time; };
+  std::vector<Cursor> heap;
+  heap.reserve(events_.size());
+  for (const auto &[_, e] : events_) {
+    if (!e.empty()) heap.emplace_back(e.begin(), e.end());
+  }
+  std::make_heap(heap.begin(), heap.end(), later);
+  while (!heap.empty()) {
+    std::pop_heap(heap.begin(), heap.end(), later);
+    auto &cursor = heap.back();
+    fn(*cursor.first);
+    if (++cursor.first != cursor.second) {
+      std::push_heap(heap.begin(), heap.end(), later);
+    } else {
+      heap.pop_back();
+    }
+  }
+}
+
+// called with mutex_ held, before the event at sec is computed.
+void AbstractStream::saveCheckpoint(double sec) {
+  auto &checkpoint = checkpoints_[(int64_t)(sec / CHECKPOINT_INTERVAL)];
+  checkpoint = {.sec = sec, .bytes = sizeof(Checkpoint)};
+  checkpoint.msgs.reserve(messages_.size());
+  for (const auto &[id, m] : messages_) {
+    auto &cp_m = checkpoint.msgs[id];
+    cp_m.ts = m.ts;
+    cp_m.count = m.count;
+    cp_m.dat = m.dat;
+    if (auto estimator = freq_estimators_.find(id); estimator != freq_estimators_.end()) {
+      cp_m.freq_estimator = estimator->second;
+    }
+    checkpoint.bytes += sizeof(id) + sizeof(cp_m) + cp_m.dat.size();
+  }
+
+  size_t total_bytes = std::accumulate(checkpoints_.begin(), checkpoints_.end(), size_t(0),
+                                       [](size_t n, const auto &cp) { return n + cp.second.bytes; });
+  while (total_bytes > MAX_CHECKPOINT_BYTES && checkpoints_.size() > 1) {
+    // drop the one farthest from where playback is
+    auto first = checkpoints_.begin(), last = std::prev(checkpoints_.end());
+    auto farthest = sec - first->second.sec > last->second.sec - sec ? first : last;
+    total_bytes -= farthest->second.bytes;
+    checkpoints_.erase(farthest);
+  }
 }
 
 const CanData &AbstractStream::lastMessage(const MessageId &id) const {
@@ -132,30 +182,96 @@ void AbstractStream::updateLastMsgsTo(double sec) {
   current_sec_ = sec;
   uint64_t last_ts = toMonoTime(sec);
   std::unordered_map<MessageId, CanData> msgs;
+  std::unordered_map<MessageId, FrequencyEstimator> freq_estimators;
   msgs.reserve(events_.size());
+  freq_estimators.reserve(events_.size());
+
+  // copy what the rebuild needs from the shared state, the rebuild itself runs without the lock
+  std::optional<Checkpoint> checkpoint;
+  std::unordered_map<MessageId, std::vector<uint8_t>> masks;
+  std::unordered_map<MessageId, std::vector<bool>> suppressed;
+  {
+    std::lock_guard lk(mutex_);
+    // restore the closest checkpoint at or before sec, if it is close enough that
+    // replaying the events after it is cheaper than rebuilding from the last events.
+    if (auto it = checkpoints_.upper_bound((int64_t)(sec / CHECKPOINT_INTERVAL)); it != checkpoints_.begin()) {
+      if ((--it)->second.sec > sec && it != checkpoints_.begin()) --it;
+      if (it->second.sec <= sec && sec - it->second.sec < 2 * CHECKPOINT_INTERVAL) {
+        checkpoint = it->second;
+      }
+    }
+    masks = masks_;
+    for (const auto &[id, m] : messages_) {
+      auto &bytes = suppressed[id];
+      std::transform(m.last_changes.cbegin(), m.last_changes.cend(), std::back_inserter(bytes),
+                     [](const auto &change) { return change.suppressed; });
+    }
+  }
 
   for (const auto &[id, ev] : events_) {
-    auto it = std::upper_bound(ev.begin(), ev.end(), last_ts, CompareCanEvent());
-    if (it != ev.begin()) {
-      auto &m = msgs[id];
-      double freq = 0;
+    auto it = ev.begin() + ev.upperBound(last_ts);
+    if (it == ev.begin()) continue;
+
+    auto &m = msgs[id];
+    auto &estimator = freq_estimators[id];
+    auto old_suppressed = suppressed.find(id);
+    if (checkpoint) {
+      if (auto cp_m = checkpoint->msgs.find(id); cp_m != checkpoint->msgs.end()) {
+        const auto &saved = cp_m->second;
+        m.ts = saved.ts;
+        m.count = saved.count;
+        m.dat = saved.dat;
+        m.colors.assign(saved.dat.size(), QColor(0, 0, 0, 0));
+        m.last_changes.assign(saved.dat.size(), {.ts = saved.ts});
+        estimator = saved.freq_estimator;
+        m.freq = estimator.freq(saved.ts);
+      }
+      auto mask = masks.find(id);
+      const std::vector<uint8_t> no_mask;
       // Keep suppressed bits.
-      if (auto old_m = messages_.find(id); old_m != messages_.end()) {
-        freq = old_m->second.freq;
-        m.last_changes.reserve(old_m->second.last_changes.size());
-        std::transform(old_m->second.last_changes.cbegin(), old_m->second.last_changes.cend(),
-                       std::back_inserter(m.last_changes),
-                       [](const auto &change) { return CanData::ByteLastChange{.suppressed = change.suppressed}; });
+      if (old_suppressed != suppressed.end()) {
+        const size_t size = std::min(m.last_changes.size(), old_suppressed->second.size());
+        for (size_t i = 0; i < size; ++i) {
+          m.last_changes[i].suppressed = old_suppressed->second[i];
+        }
       }
+      for (auto e = ev.begin() + m.count; e < it; ++e) {
+        m.compute(e->dat, e->size, toSeconds(e->mono_time), getSpeed(), mask != masks.end() ? mask->second : no_mask, &estimator);
+      }
+      // the bit change counts start over at sec, as when rebuilding from the last event
+      for (auto &change : m.last_changes) change.bit_change_counts.fill(0);
+      continue;
+    }
+
+    // Keep suppressed bits.
+    if (old_suppressed != suppressed.end()) {
+      m.last_changes.reserve(old_suppressed->second.size());
+      std::transform(old_suppressed->second.cbegin(), old_suppressed->second.cend(), std::back_inserter(m.last_changes),
+                     [](bool suppress) { return CanData::ByteLastChange{.suppressed = suppress}; });
+    }
 
-      auto prev = std::prev(it);
-      m.compute(id, (*prev)->dat, (*prev)->size, toSeconds((*prev)->mono_time), getSpeed(), {}, freq);
-      m.count = std::distance(ev.begin(), prev) + 1;
+    auto prev = std::prev(it);
+    // fill the frequency window with the minute before prev, one binary search per second
+    const int64_t prev_sec = std::floor(toSeconds(prev->mono_time));
+    auto first = ev.begin();
+    for (int64_t s = std::max<int64_t>(0, prev_sec - FrequencyEstimator::WINDOW + 1); s <= prev_sec; ++s) {
+      first = CanEventsView(first, prev).lowerBound(toMonoTime(s));
+      auto last = CanEventsView(first, prev).lowerBound(toMonoTime(s + 1));
+      if (first != last) {
+        estimator.add(toSeconds(std::prev(last)->mono_time), last - first, toSeconds(first->mono_time));
+      }
+      first = last;
     }
+    m.compute(prev->dat, prev->size, toSeconds(prev->mono_time), getSpeed(), {}, &estimator);
+    m.count = std::distance(ev.begin(), prev) + 1;
   }
 
-  new_msgs_.clear();
-  messages_ = std::move(msgs);
+  {
+    std::lock_guard lk(mutex_);
+    new_msgs_.clear();
+    messages_ = std::move(msgs);
+    freq_estimators_ = std::move(freq_estimators);
+  }
   bool id_changed = messages_.size() != last_msgs.size() ||
                     std::any_of(messages_.cbegin(), messages_.cend(),
                                 [this](const auto &m) { return !last_msgs.count(m.first); });
@@ -163,37 +279,42 @@ void AbstractStream::updateLastMsgsTo(double sec) {
   emit msgsReceived(nullptr, id_changed);
 }
 
-const CanEvent *AbstractStream::newEvent(uint64_t mono_time, const cereal::CanData::Reader &c) {
+void AbstractStream::appendEvent(MessageEventsMap &events, uint64_t mono_time, const cereal::CanData::Reader &c) {
+  MessageId id = {.source = (uint8_t)c.getSrc(), .address = c.getAddress()};
   auto dat = c.getDat();
-  CanEvent *e = (CanEvent *)event_buffer_->allocate(sizeof(CanEvent) + sizeof(uint8_t) * dat.size());
-  e->src = c.getSrc();
-  e->address = c.getAddress();
-  e->mono_time = mono_time;
-  e->size = dat.size();
-  memcpy(e->dat, (uint8_t *)dat.begin(), e->size);
-  return e;
+  events.try_emplace(id, id).first->second.append(mono_time, (const uint8_t *)dat.begin(), dat.size());
 }
 
-void AbstractStream::mergeEvents(const std::vector<const CanEvent *> &events) {
-  static MessageEventsMap msg_events;
-  std::for_each(msg_events.begin(), msg_events.end(), [](auto &e) { e.second.clear(); });
-
-  // Group events by message ID
-  for (auto e : events) {
-    msg_events[{.source = e->src, .address = e->address}].push_back(e);
+void AbstractStream::mergeEvents(const MessageEventsMap &new_events) {
+  bool has_events = false;
+  uint64_t first_mono_time = UINT64_MAX;
+  for (const auto &[id, new_e] : new_events) {
+    if (!new_e.empty()) {
+      events_.try_emplace(id, id).first->second.merge(new_e);
+      first_mono_time = std::min(first_mono_time, new_e.front().mono_time);
+      has_events = true;
+    }
   }
-
-  if (!events.empty()) {
-    for (const auto &[id, new_e] : msg_events) {
-      if (!new_e.empty()) {
-        auto &e = events_[id];
-        auto pos = std::upper_bound(e.cbegin(), e.cend(), new_e.front()->mono_time, CompareCanEvent());
-        e.insert(pos, new_e.cbegin(), new_e.cend());
+  if (has_events) {
+    {
+      std::lock_guard lk(mutex_);
+      // keep CanData::count the index of the next event to process
+      for (const auto &[id, new_e] : new_events) {
+        for (auto msgs : {&messages_, &last_msgs}) {
+          auto m = msgs->find(id);
+          if (!new_e.empty() && m != msgs->end() && new_e.front().mono_time <= toMonoTime(m->second.ts)) {
+            m->second.count += new_e.size();
+          }
+        }
+      }
+      // checkpoints after the merged events no longer match the event counts
+      const double first_sec = toSeconds(first_mono_time);
+      for (auto it = checkpoints_.begin(); it != checkpoints_.end();) {
+        it = it->second.sec >= first_sec ? checkpoints_.erase(it) : std::next(it);
       }
     }
-    auto pos = std::upper_bound(all_events_.cbegin(), all_events_.cend(), events.front()->mono_time, CompareCanEvent());
-    all_events_.insert(pos, events.cbegin(), events.cend());
-    emit eventsMerged(msg_events);
+    bus_stats_.add(new_events);
+    emit eventsMerged(new_events);
   }
 }
 
@@ -214,35 +335,44 @@ inline QColor blend(const QColor &a, const QColor &b) {
   return QColor((a.red() + b.red()) / 2, (a.green() + b.green()) / 2, (a.blue() + b.blue()) / 2, (a.alpha() + b.alpha()) / 2);
 }
 
-// Calculate the frequency from the past one minute data
-double calc_freq(const MessageId &msg_id, double current_sec) {
-  const auto &events = can->events(msg_id);
-  if (events.empty()) return 0.0;
-
-  auto current_mono_time = can->toMonoTime(current_sec);
-  auto start_mono_time = can->toMonoTime(current_sec - 59);
-
-  auto first = std::lower_bound(events.begin(), events.end(), start_mono_time, CompareCanEvent());
-  auto last = std::upper_bound(first, events.end(), current_mono_time, CompareCanEvent());
+}  // namespace
 
-  int count = std::distance(first, last);
-  if (count > 1) {
-    double duration = ((*std::prev(last))->mono_time - (*first)->mono_time) / 1e9;
-    return count / duration;
+void FrequencyEstimator::add(double sec, uint32_t count, double first_sec) {
+  // times before the start share the first bucket, a negative index would be out of bounds
+  const int64_t s = std::max(0.0, std::floor(sec));
+  auto &b = buckets[s % WINDOW];
+  if (b.sec != s) {
+    b = {.sec = s, .count = 0, .first = first_sec < 0 ? sec : first_sec};
   }
-  return 0;
+  b.count += count;
+  b.last = sec;
 }
 
-}  // namespace
+double FrequencyEstimator::freq(double current_sec) const {
+  const int64_t cur = std::floor(current_sec);
+  uint32_t count = 0;
+  double first = current_sec, last = 0;
+  for (const auto &b : buckets) {
+    if (b.count > 0 && b.sec > cur - WINDOW && b.sec <= cur) {
+      count += b.count;
+      first = std::min(first, b.first);
+      last = std::max(last, b.last);
+    }
+  }
+  return count > 1 && last > first ? count / (last - first) : 0;
+}
 
-void CanData::compute(const MessageId &msg_id, const uint8_t *can_data, const int size, double current_sec,
-                      double playback_speed, const std::vector<uint8_t> &mask, double in_freq) {
+void CanData::compute(const uint8_t *can_data, const int size, double current_sec, double playback_speed,
+                      const std::vector<uint8_t> &mask, FrequencyEstimator *freq_estimator, double in_freq) {
   ts = current_sec;
   ++count;
 
+  if (!in_freq && freq_estimator) {
+    freq_estimator->add(ts);
+  }
   if (auto sec = seconds_since_boot(); (sec - last_freq_update_ts) >= 1) {
     last_freq_update_ts = sec;
-    freq = !in_freq ? calc_freq(msg_id, ts) : in_freq;
+    freq = in_freq || !freq_estimator ? in_freq : freq_estimator->freq(ts);
   }
 
   if (dat.size() != size) {
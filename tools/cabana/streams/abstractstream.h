@@ -2,6 +2,8 @@
 
 #include <algorithm>
 #include <array>
+#include <functional>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <optional>
@@ -15,12 +17,37 @@
 
 #include "cereal/messaging/messaging.h"
 #include "tools/cabana/dbc/dbcmanager.h"
+#include "tools/cabana/streams/busstatistics.h"
+#include "tools/cabana/streams/caneventstore.h"
 #include "tools/cabana/utils/util.h"
 #include "tools/replay/util.h"
 
+// Message frequency over the last minute, counted in one-second buckets so adding
+// an event is O(1) and no event list needs to be searched. For periodic messages it
+// stays within 2.5% of count / duration over the exact window. Right after a gap the
+// oldest bucket may hold up to a second more events than the exact window would.
+class FrequencyEstimator {
+public:
+  // Adds count events, the first at first_sec (default: sec) and the last at sec.
+  // Events must be added in time order and each call must stay within one second.
+  void add(double sec, uint32_t count = 1, double first_sec = -1);
+  double freq(double current_sec) const;
+  static constexpr int WINDOW = 60;
+
+private:
+  struct Bucket {
+    int64_t sec = -1;
+    uint32_t count = 0;
+    double first = 0;
+    double last = 0;
+  };
+  std::array<Bucket, WINDOW> buckets = {};
+};
+
 struct CanData {
-  void compute(const MessageId &msg_id, const uint8_t *dat, const int size, double current_sec,
-               double playback_speed, const std::vector<uint8_t> &mask, double in_freq = 0);
+  // Adds the event to freq_estimator and refreshes freq from it, unless in_freq is given.
+  void compute(const uint8_t *dat, const int size, double current_sec, double playback_speed,
+               const std::vector<uint8_t> &mask, FrequencyEstimator *freq_estimator, double in_freq = 0);
 
   double ts = 0.;
   uint32_t count = 0;
@@ -39,21 +66,6 @@ struct CanData {
   double last_freq_update_ts = 0;
 };
 
-struct CanEvent {
-  uint8_t src;
-  uint32_t address;
-  uint64_t mono_time;
-  uint8_t size;
-  uint8_t dat[];
-};
-
-struct CompareCanEvent {
-  constexpr bool operator()(const CanEvent *const e, uint64_t ts) const { return e->mono_time < ts; }
-  constexpr bool operator()(uint64_t ts, const CanEvent *const e) const { return ts < e->mono_time; }
-};
-
-typedef std::unordered_map<MessageId, std::vector<const CanEvent *>> MessageEventsMap;
-
 class AbstractStream : public QObject {
   Q_OBJECT
 
@@ -82,9 +94,12 @@ public:
 
   inline const std::unordered_map<MessageId, CanData> &lastMessages() const { return last_msgs; }
   inline const MessageEventsMap &eventsMap() const { return events_; }
-  inline const std::vector<const CanEvent *> &allEvents() const { return all_events_; }
   const CanData &lastMessage(const MessageId &id) const;
-  const std::vector<const CanEvent *> &events(const MessageId &id) const;
+  CanEventsView events(const MessageId &id) const;
+  // Calls fn for the events of all messages in mono_time order.
+  void forEachEvent(const std::function<void(const CanEvent &)> &fn) const;
+  // The latest bus statistics, computed in the background as events are merged. UI thread only.
+  inline const BusStatistics::Snapshot &busStatistics() { return bus_stats_.snapshot(); }
 
   size_t suppressHighlighted();
   void clearSuppressed();
@@ -105,11 +120,10 @@ public:
   SourceSet sources;
 
 protected:
-  void mergeEvents(const std::vector<const CanEvent *> &events);
-  const CanEvent *newEvent(uint64_t mono_time, const cereal::CanData::Reader &c);
+  void mergeEvents(const MessageEventsMap &new_events);
+  static void appendEvent(MessageEventsMap &events, uint64_t mono_time, const cereal::CanData::Reader &c);
   void updateEvent(const MessageId &id, double sec, const uint8_t *data, uint8_t size);
 
-  std::vector<const CanEvent *> all_events_;
   double current_sec_ = 0;
   std::optional<std::pair<double, double>> time_range_;
 
@@ -117,16 +131,39 @@ private:
   void updateLastMessages();
   void updateLastMsgsTo(double sec);
   void updateMasks();
+  void saveCheckpoint(double sec);
+
+  // The state of each message taken every CHECKPOINT_INTERVAL seconds of playback, keyed
+  // by sec / CHECKPOINT_INTERVAL. A seek restores the nearest one before the target and
+  // replays the events after it, continuing from each message's count. Only what the
+  // replay can't rebuild is kept, colors restart from the restored payload and the bit
+  // change counts from the seek target, as on a seek that rebuilds from the last events.
+  struct Checkpoint {
+    struct Msg {
+      double ts;
+      uint32_t count;
+      std::vector<uint8_t> dat;
+      FrequencyEstimator freq_estimator;
+    };
+    double sec;
+    size_t bytes;
+    std::unordered_map<MessageId, Msg> msgs;
+  };
+  static constexpr double CHECKPOINT_INTERVAL = 5.0;
+  static constexpr size_t MAX_CHECKPOINT_BYTES = 64 * 1024 * 1024;
 
   MessageEventsMap events_;
   std::unordered_map<MessageId, CanData> last_msgs;
-  std::unique_ptr<MonotonicBuffer> event_buffer_;
+  BusStatistics bus_stats_;
 
   // Members accessed in multiple threads. (mutex protected)
   std::mutex mutex_;
   std::set<MessageId> new_msgs_;
   std::unordered_map<MessageId, CanData> messages_;
+  // kept out of CanData, which is copied to the UI thread on every update
+  std::unordered_map<MessageId, FrequencyEstimator> freq_estimators_;
   std::unordered_map<MessageId, std::vector<uint8_t>> masks_;
+  std::map<int64_t, Checkpoint> checkpoints_;
 };
 
 class AbstractOpenStreamWidget : public QWidget {
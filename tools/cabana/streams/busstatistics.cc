@@ -0,0 +1,166 @@
+#include "tools/cabana/streams/busstatistics.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <utility>
+
+BusStatistics::BusStatistics(uint32_t bitrate, uint32_t data_bitrate)
+    : bitrate_(bitrate), data_bitrate_(data_bitrate), thread_(&BusStatistics::workerThread, this) {}
+
+BusStatistics::~BusStatistics() {
+  {
+    std::lock_guard lk(mutex_);
+    exit_ = true;
+  }
+  cv_.notify_one();
+  thread_.join();
+}
+
+void BusStatistics::add(const MessageEventsMap &events) {
+  MessageEventsMap copy = events;
+  {
+    std::lock_guard lk(mutex_);
+    pending_.push_back(std::move(copy));
+  }
+  cv_.notify_one();
+}
+
+const BusStatistics::Snapshot &BusStatistics::snapshot() {
+  // swap the newest snapshot in, the worker refills the old one in place
+  while (Snapshot *s = snapshots_.front()) {
+    std::swap(snapshot_, *s);
+    snapshots_.pop();
+  }
+  return snapshot_;
+}
+
+double BusStatistics::frameBits(const MessageId &id, uint8_t size) const {
+  // SOF, arbitration, control, CRC, ACK, EOF and the interframe space
+  const bool extended = id.address > 0x7ff;
+  const int overhead = extended ? 67 : 47;
+  if (size <= 8) {
+    return overhead + size * 8;
+  }
+  // CAN FD: the data field, the longer CRC and the DLC are sent at the data bitrate
+  const int arbitration = extended ? 49 : 29;
+  const int data_phase = size * 8 + 30;
+  return arbitration + data_phase * (double)bitrate_ / data_bitrate_;
+}
+
+void BusStatistics::workerThread() {
+  bool unpublished = false;
+  while (true) {
+    std::vector<MessageEventsMap> pending;
+    {
+      std::unique_lock lk(mutex_);
+      auto ready = [this]() { return exit_ || !pending_.empty(); };
+      if (unpublished) {
+        // the reader hasn't drained the ring yet, retry later
+        cv_.wait_for(lk, std::chrono::milliseconds(50), ready);
+      } else {
+        cv_.wait(lk, ready);
+      }
+      if (exit_) break;
+      pending.swap(pending_);
+    }
+    for (const auto &events : pending) {
+      process(events);
+    }
+    unpublished = !publish();
+  }
+}
+
+void BusStatistics::process(const MessageEventsMap &events) {
+  for (const auto &[id, store] : events) {
+    if (store.empty()) continue;
+
+    auto &m = msg_states_[id];
+    auto &bus = bus_states_[id.source];
+    // flips are counted across batches only if this one continues the previous one.
+    // segments loaded out of order lose the transition at their boundary.
+    const bool continues = m.count > 0 && store.front().mono_time >= m.last_time;
+    if (!continues) m.last_dat.clear();
+
+    auto bucket = bus.bits_per_sec.end();
+    for (const CanEvent &e : store) {
+      if (e.size > (int)m.histograms.size()) {
+        m.histograms.resize(e.size, {});
+        m.bit_flips.resize(e.size, {});
+      }
+      for (int i = 0; i < e.size; ++i) {
+        ++m.histograms[i][e.dat[i]];
+      }
+      const size_t n = std::min<size_t>(e.size, m.last_dat.size());
+      for (size_t i = 0; i < n; ++i) {
+        if (uint8_t diff = e.dat[i] ^ m.last_dat[i]) {
+          for (int bit = 0; bit < 8; ++bit) {
+            m.bit_flips[i][7 - bit] += (diff >> bit) & 1;
+          }
+        }
+      }
+      m.last_dat.assign(e.dat, e.dat + e.size);
+
+      const double bits = frameBits(id, e.size);
+      const int64_t sec = e.mono_time / 1000000000;
+      if (bucket == bus.bits_per_sec.end() || bucket->first != sec) {
+        bucket = bus.bits_per_sec.try_emplace(sec, 0.0).first;
+      }
+      bucket->second += bits;
+      m.bits += bits;
+      bus.bits += bits;
+    }
+
+    m.first_time = m.count == 0 ? store.front().mono_time : std::min(m.first_time, store.front().mono_time);
+    m.last_time = std::max(m.last_time, store.back().mono_time);
+    m.count += store.size();
+    bus.frames += store.size();
+    events_ += store.size();
+  }
+}
+
+bool BusStatistics::publish() {
+  Snapshot *s = snapshots_.back();
+  if (!s) return false;
+
+  s->events = events_;
+  s->buses.clear();
+  for (const auto &[source, bus] : bus_states_) {
+    auto &b = s->buses[source];
+    b.frames = bus.frames;
+    b.bits = bus.bits;
+    b.bits_per_sec = bus.bits_per_sec.empty() ? 0 : bus.bits / bus.bits_per_sec.size();
+    b.load = b.bits_per_sec * 100.0 / bitrate_;
+    double peak = 0;
+    for (const auto &[_, bits] : bus.bits_per_sec) peak = std::max(peak, bits);
+    b.peak_load = peak * 100.0 / bitrate_;
+    // the last second may still be filling up
+    auto last = bus.bits_per_sec.rbegin();
+    if (last != bus.bits_per_sec.rend() && bus.bits_per_sec.size() > 1) ++last;
+    b.last_load = last != bus.bits_per_sec.rend() ? last->second * 100.0 / bitrate_ : 0;
+  }
+
+  for (const auto &[id, m] : msg_states_) {
+    auto &stats = s->messages[id];
+    stats.count = m.count;
+    stats.bits = m.bits;
+    stats.first_time = m.first_time;
+    stats.last_time = m.last_time;
+    stats.bit_flips = m.bit_flips;
+    stats.entropy.resize(m.histograms.size());
+    for (size_t i = 0; i < m.histograms.size(); ++i) {
+      uint64_t total = 0;
+      for (uint32_t c : m.histograms[i]) total += c;
+      double h = 0;
+      for (uint32_t c : m.histograms[i]) {
+        if (c > 0) {
+          const double p = (double)c / total;
+          h -= p * std::log2(p);
+        }
+      }
+      stats.entropy[i] = h;
+    }
+  }
+  snapshots_.push();
+  return true;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "tools/cabana/streams/caneventstore.h"
+#include "tools/cabana/streams/spscring.h"
+
+// Per-bus and per-message statistics, computed on a worker thread as events are merged.
+// The worker publishes snapshots through an SPSC ring, so the UI thread reads the latest
+// one without taking a lock and never waits for a long route to be processed.
+class BusStatistics {
+public:
+  struct MessageStats {
+    uint64_t count = 0;
+    uint64_t bits = 0;  // estimated bits on the wire, frame overhead included
+    uint64_t first_time = 0;
+    uint64_t last_time = 0;
+    std::vector<double> entropy;  // Shannon entropy of each byte, 0 - 8 bits
+    std::vector<std::array<uint32_t, 8>> bit_flips;  // per byte, msb first
+  };
+  struct BusStats {
+    uint64_t frames = 0;
+    uint64_t bits = 0;
+    double bits_per_sec = 0;  // average over the seconds that carried traffic
+    double load = 0;  // bits_per_sec in percent of the bitrate
+    double peak_load = 0;  // the busiest second
+    double last_load = 0;  // the most recent second
+  };
+  struct Snapshot {
+    uint64_t events = 0;  // events processed so far
+    std::map<uint8_t, BusStats> buses;
+    std::unordered_map<MessageId, MessageStats> messages;
+  };
+
+  BusStatistics(uint32_t bitrate = 500000, uint32_t data_bitrate = 2000000);
+  ~BusStatistics();
+  // Queues a copy of the events for the worker.
+  void add(const MessageEventsMap &events);
+  // Called from the reading thread only: returns the latest published snapshot.
+  const Snapshot &snapshot();
+  // Bits on the wire for a frame, in nominal bit times. Bit stuffing is not counted and
+  // the data phase of a CAN FD frame is scaled by bitrate / data_bitrate.
+  double frameBits(const MessageId &id, uint8_t size) const;
+
+private:
+  struct MessageState {
+    uint64_t count = 0;
+    double bits = 0;
+    uint64_t first_time = 0;
+    uint64_t last_time = 0;
+    std::vector<uint8_t> last_dat;
+    std::vector<std::array<uint32_t, 256>> histograms;
+    std::vector<std::array<uint32_t, 8>> bit_flips;
+  };
+  struct BusState {
+    uint64_t frames = 0;
+    double bits = 0;
+    std::map<int64_t, double> bits_per_sec;  // keyed by mono_time in seconds
+  };
+
+  void workerThread();
+  void process(const MessageEventsMap &events);
+  bool publish();
+
+  const uint32_t bitrate_;
+  const uint32_t data_bitrate_;
+
+  // owned by the worker thread
+  uint64_t events_ = 0;
+  std::unordered_map<MessageId, MessageState> msg_states_;
+  std::map<uint8_t, BusState> bus_states_;
+
+  // written by the worker, read by snapshot()
+  SPSCRing<Snapshot> snapshots_{4};
+  Snapshot snapshot_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::vector<MessageEventsMap> pending_;
+  bool exit_ = false;
+  std::thread thread_;
+};
@@ -0,0 +1,291 @@
+#include "tools/cabana/streams/caneventstore.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Adds (or subtracts) the bit flips between count consecutive payloads to counts[stride * 8].
+// Payloads are XORed 8 bytes at a time and each bit position is counted in the byte lanes
+// of a uint64_t, so one add counts a bit of 8 bytes at once. Assumes a little-endian host.
+void countFlips(const uint8_t *data, size_t stride, size_t count, uint32_t *counts, bool subtract = false) {
+  if (count < 2) return;
+
+  constexpr uint64_t LANE_LSB = 0x0101010101010101ULL;
+  for (size_t w = 0; w < stride; w += 8) {
+    const size_t n = std::min<size_t>(8, stride - w);
+    auto load = [=](size_t k) {
+      uint64_t v = 0;
+      memcpy(&v, data + k * stride + w, n);
+      return v;
+    };
+    std::array<uint32_t, 64> sums = {};
+    uint64_t prev = load(0);
+    for (size_t k = 1; k < count;) {
+      // a byte lane holds up to 255 flips before it is flushed
+      std::array<uint64_t, 8> lanes = {};
+      for (const size_t end = std::min(count, k + 255); k < end; ++k) {
+        const uint64_t cur = load(k);
+        const uint64_t x = cur ^ prev;
+        for (int bit = 0; bit < 8; ++bit) {
+          lanes[bit] += (x >> bit) & LANE_LSB;
+        }
+        prev = cur;
+      }
+      for (int bit = 0; bit < 8; ++bit) {
+        for (size_t i = 0; i < n; ++i) {
+          sums[i * 8 + 7 - bit] += (lanes[bit] >> (i * 8)) & 0xff;
+        }
+      }
+    }
+    uint32_t *out = counts + w * 8;
+    for (size_t i = 0; i < n * 8; ++i) {
+      out[i] = subtract ? out[i] - sums[i] : out[i] + sums[i];
+    }
+  }
+}
+
+// Adds the bit flips between two payloads, for single appends where few bits change.
+void countFlips(const uint8_t *a, const uint8_t *b, size_t stride, uint32_t *counts) {
+  for (size_t i = 0; i < stride; ++i) {
+    for (uint8_t x = a[i] ^ b[i]; x != 0; x &= x - 1) {
+      ++counts[i * 8 + 7 - __builtin_ctz(x)];
+    }
+  }
+}
+
+}  // namespace
+
+size_t CanEventStore::lowerBound(uint64_t mono_time) const {
+  auto c = std::partition_point(chunks_.begin(), chunks_.end(), [=](const Chunk &ch) { return ch.mono_times.back() < mono_time; });
+  if (c == chunks_.end()) return size();
+  auto it = std::lower_bound(c->mono_times.begin(), c->mono_times.end(), mono_time);
+  return chunk_starts_[c - chunks_.begin()] + (it - c->mono_times.begin());
+}
+
+size_t CanEventStore::upperBound(uint64_t mono_time) const {
+  auto c = std::partition_point(chunks_.begin(), chunks_.end(), [=](const Chunk &ch) { return ch.mono_times.back() <= mono_time; });
+  if (c == chunks_.end()) return size();
+  auto it = std::upper_bound(c->mono_times.begin(), c->mono_times.end(), mono_time);
+  return chunk_starts_[c - chunks_.begin()] + (it - c->mono_times.begin());
+}
+
+void CanEventStore::clear() {
+  chunks_.clear();
+  chunk_starts_ = {0};
+}
+
+void CanEventStore::append(uint64_t mono_time, const uint8_t *dat, uint8_t size) {
+  if (size > stride_) {
+    setStride(size);
+  }
+  if (chunks_.empty() || chunks_.back().size() >= CHUNK_SIZE) {
+    chunks_.emplace_back();
+    chunk_starts_.push_back(chunk_starts_.back());
+  }
+  Chunk &ch = chunks_.back();
+  ch.mono_times.push_back(mono_time);
+  ch.sizes.push_back(size);
+  ch.data.insert(ch.data.end(), dat, dat + size);
+  ch.data.resize(ch.data.size() + stride_ - size);
+  ++chunk_starts_.back();
+
+  // update the prefix sums in place: a new block starts its row from the running total
+  const size_t w = stride_ * 8;
+  const size_t j = ch.size() - 1;
+  if (j % FLIP_BLOCK == 0) {
+    if (ch.flips.empty()) ch.flips.assign(w, 0);
+    ch.flips.resize(ch.flips.size() + w);
+    std::copy_n(ch.flips.end() - 2 * w, w, ch.flips.end() - w);
+  }
+  if (j > 0) {
+    const uint8_t *cur = ch.data.data() + j * stride_;
+    countFlips(cur - stride_, cur, stride_, &*(ch.flips.end() - w));
+  }
+}
+
+void CanEventStore::append(const uint64_t *mono_times, const uint8_t *sizes, const uint8_t *data, uint8_t stride, size_t count) {
+  insertChunks(chunks_.size(), mono_times, sizes, data, stride, count);
+}
+
+void CanEventStore::merge(const CanEventStore &other) {
+  if (other.empty()) return;
+
+  if (other.stride_ > stride_) {
+    setStride(other.stride_);
+  }
+  const size_t pos = upperBound(other.front().mono_time);
+  size_t c = chunkIndex(pos);
+  if (pos > chunk_starts_[c]) {
+    // split the chunk, the new events go between the two halves
+    const size_t n = pos - chunk_starts_[c];
+    Chunk &head = chunks_[c];
+    Chunk tail;
+    tail.mono_times.assign(head.mono_times.begin() + n, head.mono_times.end());
+    tail.sizes.assign(head.sizes.begin() + n, head.sizes.end());
+    tail.data.assign(head.data.begin() + n * stride_, head.data.end());
+    head.mono_times.resize(n);
+    head.sizes.resize(n);
+    head.data.resize(n * stride_);
+    updateFlips(head, n);
+    updateFlips(tail, 0);
+    chunks_.insert(chunks_.begin() + c + 1, std::move(tail));
+    chunk_starts_.insert(chunk_starts_.begin() + c + 1, pos);
+    ++c;
+  }
+  for (const Chunk &ch : other.chunks_) {
+    const size_t num_chunks = chunks_.size();
+    insertChunks(c, ch.mono_times.data(), ch.sizes.data(), ch.data.data(), other.stride_, ch.size());
+    c += chunks_.size() - num_chunks;
+  }
+}
+
+void CanEventStore::insertChunks(size_t c, const uint64_t *mono_times, const uint8_t *sizes, const uint8_t *data, uint8_t stride, size_t count) {
+  if (count == 0) return;
+
+  if (stride > stride_) {
+    setStride(stride);
+  }
+  const size_t first_changed = c > 0 ? c - 1 : 0;
+  for (size_t i = 0; i < count;) {
+    // fill up the preceding chunk first, so appends and merges don't leave small chunks behind
+    if (c == 0 || chunks_[c - 1].size() >= CHUNK_SIZE) {
+      chunks_.insert(chunks_.begin() + c, Chunk{});
+      chunk_starts_.insert(chunk_starts_.begin() + c, 0);
+      ++c;
+    }
+    Chunk &ch = chunks_[c - 1];
+    const size_t prev_size = ch.size();
+    const size_t n = std::min(CHUNK_SIZE - ch.size(), count - i);
+    ch.mono_times.insert(ch.mono_times.end(), mono_times + i, mono_times + i + n);
+    ch.sizes.insert(ch.sizes.end(), sizes + i, sizes + i + n);
+    if (stride == stride_) {
+      ch.data.insert(ch.data.end(), data + i * stride, data + (i + n) * stride);
+    } else {
+      auto it = ch.data.insert(ch.data.end(), n * stride_, 0);
+      for (size_t j = 0; j < n; ++j) {
+        memcpy(&*it + j * stride_, data + (i + j) * stride, sizes[i + j]);
+      }
+    }
+    updateFlips(ch, prev_size);
+    i += n;
+  }
+  updateChunkStarts(first_changed);
+}
+
+void CanEventStore::updateChunkStarts(size_t from) {
+  for (size_t c = from; c < chunks_.size(); ++c) {
+    chunk_starts_[c + 1] = chunk_starts_[c] + chunks_[c].size();
+  }
+}
+
+void CanEventStore::updateFlips(Chunk &ch, size_t from) const {
+  // rows up to from / FLIP_BLOCK only count flips between events before from
+  const size_t w = stride_ * 8;
+  const size_t rows = (ch.size() + FLIP_BLOCK - 1) / FLIP_BLOCK + 1;
+  ch.flips.resize(rows * w);
+  if (from == 0) {
+    std::fill_n(ch.flips.begin(), w, 0);
+  }
+  for (size_t b = from / FLIP_BLOCK + 1; b < rows; ++b) {
+    uint32_t *row = ch.flips.data() + b * w;
+    std::copy_n(row - w, w, row);
+    // the flip into an event is counted in the block of the event
+    const size_t first = std::max((b - 1) * FLIP_BLOCK, (size_t)1) - 1;
+    const size_t last = std::min(b * FLIP_BLOCK, ch.size());
+    countFlips(ch.data.data() + first * stride_, stride_, last - first, row);
+  }
+}
+
+void CanEventStore::addChunkFlips(const Chunk &ch, size_t j, uint32_t *counts, bool subtract) const {
+  const size_t w = stride_ * 8;
+  const size_t b = j == ch.size() ? ch.flips.size() / w - 1 : j / FLIP_BLOCK;
+  const uint32_t *row = ch.flips.data() + b * w;
+  for (size_t i = 0; i < w; ++i) {
+    counts[i] = subtract ? counts[i] - row[i] : counts[i] + row[i];
+  }
+  if (j < ch.size()) {
+    const size_t first = std::max(b * FLIP_BLOCK, (size_t)1) - 1;
+    countFlips(ch.data.data() + first * stride_, stride_, j - first, counts, subtract);
+  }
+}
+
+void CanEventStore::addBitFlips(size_t first, size_t last, uint32_t *counts) const {
+  // the flip into event i is counted for first < i < last
+  if (first + 1 >= last) return;
+
+  for (size_t c = chunkIndex(first + 1); chunk_starts_[c] < last; ++c) {
+    const Chunk &ch = chunks_[c];
+    size_t j = std::max(first + 1, chunk_starts_[c]) - chunk_starts_[c];
+    const size_t end = std::min(last, chunk_starts_[c + 1]) - chunk_starts_[c];
+    if (j == 0) {
+      // the flip across the chunk boundary
+      countFlips(&*(chunks_[c - 1].data.end() - stride_), ch.data.data(), stride_, counts);
+      j = 1;
+    }
+    if (end - j <= FLIP_BLOCK) {
+      countFlips(ch.data.data() + (j - 1) * stride_, stride_, end - j + 1, counts);
+    } else {
+      addChunkFlips(ch, end, counts, false);
+      addChunkFlips(ch, j, counts, true);
+    }
+  }
+}
+
+size_t CanEventStore::memoryUsage() const {
+  size_t bytes = chunks_.capacity() * sizeof(Chunk) + chunk_starts_.capacity() * sizeof(size_t);
+  for (const Chunk &ch : chunks_) {
+    bytes += ch.mono_times.capacity() * sizeof(uint64_t) + ch.sizes.capacity() + ch.data.capacity() +
+             ch.flips.capacity() * sizeof(uint32_t);
+  }
+  return bytes;
+}
+
+void CanEventStore::setStride(uint8_t stride) {
+  for (Chunk &ch : chunks_) {
+    std::vector<uint8_t> data(ch.size() * stride, 0);
+    for (size_t i = 0; i < ch.size(); ++i) {
+      memcpy(data.data() + i * stride, ch.data.data() + i * stride_, ch.sizes[i]);
+    }
+    ch.data = std::move(data);
+  }
+  stride_ = stride;
+  for (Chunk &ch : chunks_) {
+    updateFlips(ch, 0);
+  }
+}
+
+// CanEventsView
+
+CanEventIterator CanEventsView::lowerBound(uint64_t mono_time) const {
+  if (empty()) return last_;
+  const size_t i = first_.store()->lowerBound(mono_time);
+  return {first_.store(), std::clamp(i, first_.index(), last_.index())};
+}
+
+CanEventIterator CanEventsView::upperBound(uint64_t mono_time) const {
+  if (empty()) return last_;
+  const size_t i = first_.store()->upperBound(mono_time);
+  return {first_.store(), std::clamp(i, first_.index(), last_.index())};
+}
+
+void CanEventsView::getValues(const cabana::Signal *sig, double *values) const {
+  if (empty()) return;
+  forEachSpan([&](const Span &s) {
+    sig->getValues(s.data, stride(), s.sizes, s.count, values);
+    values += s.count;
+  });
+}
+
+std::vector<std::array<uint32_t, 8>> CanEventsView::bitFlips() const {
+  if (empty()) return {};
+
+  const CanEventStore *store = first_.store();
+  std::vector<uint32_t> counts(store->stride() * 8, 0);
+  store->addBitFlips(first_.index(), last_.index(), counts.data());
+  std::vector<std::array<uint32_t, 8>> flips(store->stride());
+  for (size_t i = 0; i < flips.size(); ++i) {
+    std::copy_n(counts.begin() + i * 8, 8, flips[i].begin());
+  }
+  return flips;
+}
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <iterator>
+#include <unordered_map>
+#include <vector>
+
+#include "tools/cabana/dbc/dbc.h"
+
+// A single CAN frame. dat points into the owning CanEventStore and stays valid
+// until the store is modified.
+struct CanEvent {
+  uint8_t src;
+  uint32_t address;
+  uint64_t mono_time;
+  uint8_t size;
+  const uint8_t *dat;
+};
+
+struct CompareCanEvent {
+  constexpr bool operator()(const CanEvent &e, uint64_t ts) const { return e.mono_time < ts; }
+  constexpr bool operator()(uint64_t ts, const CanEvent &e) const { return ts < e.mono_time; }
+};
+
+class CanEventStore;
+
+class CanEventIterator {
+public:
+  using iterator_category = std::random_access_iterator_tag;
+  using value_type = CanEvent;
+  using difference_type = std::ptrdiff_t;
+  using reference = CanEvent;
+  struct pointer {
+    CanEvent e;
+    const CanEvent *operator->() const { return &e; }
+  };
+
+  CanEventIterator() = default;
+  inline CanEventIterator(const CanEventStore *store, size_t i);
+  inline CanEvent operator*() const;
+  inline pointer operator->() const { return {**this}; }
+  inline CanEvent operator[](difference_type n) const { return *(*this + n); }
+  inline size_t index() const { return i_; }
+  inline const CanEventStore *store() const { return store_; }
+
+  // stepping keeps track of the chunk, jumps look it up
+  inline CanEventIterator &operator++();
+  inline CanEventIterator &operator--();
+  inline CanEventIterator operator++(int) { auto it = *this; ++*this; return it; }
+  inline CanEventIterator operator--(int) { auto it = *this; --*this; return it; }
+  inline CanEventIterator &operator+=(difference_type n) { return *this = *this + n; }
+  inline CanEventIterator &operator-=(difference_type n) { return *this = *this - n; }
+  inline CanEventIterator operator+(difference_type n) const { return {store_, i_ + n}; }
+  inline CanEventIterator operator-(difference_type n) const { return {store_, i_ - n}; }
+  friend inline CanEventIterator operator+(difference_type n, const CanEventIterator &it) { return it + n; }
+  inline difference_type operator-(const CanEventIterator &other) const { return (difference_type)i_ - (difference_type)other.i_; }
+
+  inline bool operator==(const CanEventIterator &other) const { return i_ == other.i_; }
+  inline bool operator!=(const CanEventIterator &other) const { return i_ != other.i_; }
+  inline bool operator<(const CanEventIterator &other) const { return i_ < other.i_; }
+  inline bool operator>(const CanEventIterator &other) const { return i_ > other.i_; }
+  inline bool operator<=(const CanEventIterator &other) const { return i_ <= other.i_; }
+  inline bool operator>=(const CanEventIterator &other) const { return i_ >= other.i_; }
+
+private:
+  const CanEventStore *store_ = nullptr;
+  size_t i_ = 0;
+  size_t chunk_ = 0;
+};
+
+// Columnar storage for the events of one message, ordered by mono_time.
+// Events are kept in sorted chunks of at most CHUNK_SIZE events. Within a chunk the
+// timestamps are contiguous and payloads are kept at a fixed stride, which grows to
+// the size of the largest frame seen for the message. Merging an older batch into
+// the middle splits one chunk instead of moving every later event.
+// Each chunk also keeps prefix sums of the bit flips between consecutive events, so
+// the flips over any range are found without walking its events.
+class CanEventStore {
+public:
+  static constexpr size_t CHUNK_SIZE = 4096;
+  static constexpr size_t FLIP_BLOCK = 128;
+
+  struct Chunk {
+    std::vector<uint64_t> mono_times;
+    std::vector<uint8_t> sizes;
+    std::vector<uint8_t> data;
+    // stride * 8 counters (msb first) per row. Row b counts the flips between the events
+    // before min(b * FLIP_BLOCK, size()), the last row holds the flips of the whole chunk.
+    std::vector<uint32_t> flips;
+    inline size_t size() const { return mono_times.size(); }
+  };
+
+  CanEventStore(const MessageId &id = {}) : id(id) {}
+  inline size_t size() const { return chunk_starts_.back(); }
+  inline bool empty() const { return size() == 0; }
+  inline uint8_t stride() const { return stride_; }
+  inline CanEvent operator[](size_t i) const {
+    const size_t c = chunkIndex(i);
+    return event(c, i - chunk_starts_[c]);
+  }
+  inline CanEventIterator begin() const { return {this, 0}; }
+  inline CanEventIterator end() const { return {this, size()}; }
+  inline CanEvent front() const { return event(0, 0); }
+  inline CanEvent back() const { return event(chunks_.size() - 1, chunks_.back().size() - 1); }
+
+  inline size_t numChunks() const { return chunks_.size(); }
+  inline const Chunk &chunk(size_t c) const { return chunks_[c]; }
+  // index of the first event of chunk c, or size() for c == numChunks()
+  inline size_t chunkStart(size_t c) const { return chunk_starts_[c]; }
+  // the chunk holding event i, or numChunks() for i == size()
+  inline size_t chunkIndex(size_t i) const {
+    return std::upper_bound(chunk_starts_.begin(), chunk_starts_.end(), i) - chunk_starts_.begin() - 1;
+  }
+  inline CanEvent event(size_t c, size_t j) const {
+    const Chunk &ch = chunks_[c];
+    return {id.source, id.address, ch.mono_times[j], ch.sizes[j], ch.data.data() + j * stride_};
+  }
+
+  // Index of the first event with mono_time >= (lowerBound) or > (upperBound) mono_time.
+  // Searches the chunks, then within one chunk: O(log n).
+  size_t lowerBound(uint64_t mono_time) const;
+  size_t upperBound(uint64_t mono_time) const;
+
+  void clear();
+  // Events must be appended in mono_time order.
+  void append(uint64_t mono_time, const uint8_t *dat, uint8_t size);
+  // Appends count events laid out like a Chunk with the given stride.
+  void append(const uint64_t *mono_times, const uint8_t *sizes, const uint8_t *data, uint8_t stride, size_t count);
+  // Inserts the sorted events of other after all events with mono_time <= other.front().
+  void merge(const CanEventStore &other);
+  // Adds the bit flips between consecutive events in [first, last) to counts[stride() * 8],
+  // msb first. Costs O(chunks) plus at most two FLIP_BLOCKs of events.
+  void addBitFlips(size_t first, size_t last, uint32_t *counts) const;
+  size_t memoryUsage() const;
+
+  MessageId id;
+
+private:
+  void setStride(uint8_t stride);
+  // copies count events into chunks inserted before chunk c
+  void insertChunks(size_t c, const uint64_t *mono_times, const uint8_t *sizes, const uint8_t *data, uint8_t stride, size_t count);
+  void updateChunkStarts(size_t from);
+  // recomputes the flip rows of ch after its events from index from on changed
+  void updateFlips(Chunk &ch, size_t from) const;
+  // adds (or subtracts) the flips between the events before index j of ch
+  void addChunkFlips(const Chunk &ch, size_t j, uint32_t *counts, bool subtract) const;
+
+  std::vector<Chunk> chunks_;
+  std::vector<size_t> chunk_starts_ = {0};
+  uint8_t stride_ = 0;
+};
+
+inline CanEventIterator::CanEventIterator(const CanEventStore *store, size_t i)
+    : store_(store), i_(i), chunk_(store ? store->chunkIndex(i) : 0) {}
+
+inline CanEvent CanEventIterator::operator*() const { return store_->event(chunk_, i_ - store_->chunkStart(chunk_)); }
+
+inline CanEventIterator &CanEventIterator::operator++() {
+  if (++i_ == store_->chunkStart(chunk_ + 1)) ++chunk_;
+  return *this;
+}
+
+inline CanEventIterator &CanEventIterator::operator--() {
+  if (i_-- == store_->chunkStart(chunk_)) --chunk_;
+  return *this;
+}
+
+// A view of a contiguous range of events in a CanEventStore.
+class CanEventsView {
+public:
+  CanEventsView() = default;
+  CanEventsView(const CanEventStore &store) : first_(store.begin()), last_(store.end()) {}
+  CanEventsView(CanEventIterator first, CanEventIterator last) : first_(first), last_(last) {}
+  inline CanEventIterator begin() const { return first_; }
+  inline CanEventIterator end() const { return last_; }
+  inline std::reverse_iterator<CanEventIterator> rbegin() const { return std::reverse_iterator(last_); }
+  inline std::reverse_iterator<CanEventIterator> rend() const { return std::reverse_iterator(first_); }
+  inline size_t size() const { return last_ - first_; }
+  inline bool empty() const { return first_ == last_; }
+  inline CanEvent operator[](size_t i) const { return first_[i]; }
+  inline CanEvent front() const { return *first_; }
+  inline CanEvent back() const { return *(last_ - 1); }
+
+  // O(log n) searches by mono_time, limited to the view
+  CanEventIterator lowerBound(uint64_t mono_time) const;
+  CanEventIterator upperBound(uint64_t mono_time) const;
+
+  // A contiguous run of events, laid out like CanEventStore::Chunk.
+  struct Span {
+    const uint64_t *mono_times;
+    const uint8_t *sizes;
+    const uint8_t *data;
+    size_t count;
+  };
+  // Columnar access to the events in the view: calls fn(const Span &) for each run of
+  // events that lies in one chunk, in order. Only valid for non-empty views.
+  inline uint8_t stride() const { return first_.store()->stride(); }
+  template <class Fn>
+  void forEachSpan(Fn fn) const {
+    const CanEventStore *store = first_.store();
+    for (size_t i = first_.index(); i < last_.index();) {
+      const size_t c = store->chunkIndex(i);
+      const size_t j = i - store->chunkStart(c);
+      const size_t n = std::min(store->chunkStart(c + 1), last_.index()) - i;
+      const auto &ch = store->chunk(c);
+      fn(Span{ch.mono_times.data() + j, ch.sizes.data() + j, ch.data.data() + j * stride(), n});
+      i += n;
+    }
+  }
+  // Decodes sig for every event in the view into values[size()].
+  void getValues(const cabana::Signal *sig, double *values) const;
+  // Bit flips between consecutive events in the view, per byte (msb first).
+  std::vector<std::array<uint32_t, 8>> bitFlips() const;
+
+private:
+  CanEventIterator first_, last_;
+};
+
+typedef std::unordered_map<MessageId, CanEventStore> MessageEventsMap;
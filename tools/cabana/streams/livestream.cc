@@ -2,6 +2,7 @@
 
 #include <QThread>
 #include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <memory>
 
@@ -77,26 +78,84 @@ void LiveStream::handleEvent(kj::ArrayPtr<capnp::word> data) {
   capnp::FlatArrayMessageReader reader(data);
   auto event = reader.getRoot<cereal::Event>();
   if (event.which() == cereal::Event::Which::CAN) {
+    auto can_events = event.getCan();
+    CanBatch *batch = received_batches.back();
+    if (!batch) {
+      // the UI thread is too far behind, drop the frames rather than wait for it
+      dropped_frames += can_events.size();
+      return;
+    }
+
     const uint64_t mono_time = event.getLogMonoTime();
-    std::lock_guard lk(lock);
-    for (const auto &c : event.getCan()) {
-      received_events_.push_back(newEvent(mono_time, c));
+    batch->frames.resize(can_events.size());
+    for (int i = 0; i < can_events.size(); ++i) {
+      const auto &c = can_events[i];
+      auto dat = c.getDat();
+      auto &frame = batch->frames[i];
+      frame.mono_time = mono_time;
+      frame.id = {.source = (uint8_t)c.getSrc(), .address = c.getAddress()};
+      frame.size = std::min<size_t>(dat.size(), frame.dat.size());
+      memcpy(frame.dat.data(), dat.begin(), frame.size);
+    }
+    received_batches.push();
+  }
+}
+
+// called in streamThread
+void LiveStream::handleFrames(const CanFrame *frames, size_t count) {
+  if (logger) {
+    for (size_t i = 0; i < count;) {
+      size_t n = 1;
+      while (i + n < count && frames[i + n].mono_time == frames[i].mono_time) ++n;
+
+      MessageBuilder msg;
+      auto evt = msg.initEvent();
+      evt.setLogMonoTime(frames[i].mono_time);
+      auto can_data = evt.initCan(n);
+      for (size_t j = 0; j < n; ++j) {
+        const auto &f = frames[i + j];
+        can_data[j].setAddress(f.id.address);
+        can_data[j].setSrc(f.id.source);
+        can_data[j].setDat(kj::arrayPtr(f.dat.data(), f.size));
+      }
+      logger->write(capnp::messageToFlatArray(msg));
+      i += n;
     }
   }
+
+  CanBatch *batch = received_batches.back();
+  if (!batch) {
+    dropped_frames += count;
+    return;
+  }
+  batch->frames.assign(frames, frames + count);
+  received_batches.push();
 }
 
 void LiveStream::timerEvent(QTimerEvent *event) {
   if (event->timerId() == timer_id) {
-    {
-      // merge events received from live stream thread.
-      std::lock_guard lk(lock);
-      mergeEvents(received_events_);
-      uint64_t last_received_ts = !received_events_.empty() ? received_events_.back()->mono_time : 0;
-      lastest_event_ts = std::max(lastest_event_ts, last_received_ts);
-      received_events_.clear();
+    // drain the batches received from live stream thread and merge them.
+    uint64_t merged = 0;
+    while (CanBatch *batch = received_batches.front()) {
+      for (const auto &f : batch->frames) {
+        received_events_.try_emplace(f.id, f.id).first->second.append(f.mono_time, f.dat.data(), f.size);
+      }
+      merged += batch->frames.size();
+      received_batches.pop();
     }
-    if (!all_events_.empty()) {
-      begin_event_ts = all_events_.front()->mono_time;
+    mergeEvents(received_events_);
+    for (auto &[_, e] : received_events_) {
+      if (!e.empty()) {
+        if (begin_event_ts == 0 || e.front().mono_time < begin_event_ts) begin_event_ts = e.front().mono_time;
+        lastest_event_ts = std::max(lastest_event_ts, e.back().mono_time);
+        e.clear();
+      }
+    }
+    if (merged > 0) {
+      merged_frames += merged;
+      emit framesMerged(merged_frames, dropped_frames);
+    }
+    if (lastest_event_ts != 0) {
       updateEvents();
       return;
     }
@@ -109,7 +168,7 @@ void LiveStream::updateEvents() {
 
   if (first_update_ts == 0) {
     first_update_ts = nanos_since_boot();
-    first_event_ts = current_event_ts = all_events_.back()->mono_time;
+    first_event_ts = current_event_ts = lastest_event_ts;
   }
 
   if (paused_ || prev_speed != speed_) {
@@ -120,17 +179,20 @@ void LiveStream::updateEvents() {
   }
 
   uint64_t last_ts = post_last_event && speed_ == 1.0
-                       ? all_events_.back()->mono_time
+                       ? lastest_event_ts
                        : first_event_ts + (nanos_since_boot() - first_update_ts) * speed_;
-  auto first = std::upper_bound(all_events_.cbegin(), all_events_.cend(), current_event_ts, CompareCanEvent());
-  auto last = std::upper_bound(first, all_events_.cend(), last_ts, CompareCanEvent());
-
-  for (auto it = first; it != last; ++it) {
-    const CanEvent *e = *it;
-    MessageId id = {.source = e->src, .address = e->address};
-    updateEvent(id, (e->mono_time - begin_event_ts) / 1e9, e->dat, e->size);
-    current_event_ts = e->mono_time;
+  uint64_t updated_ts = current_event_ts;
+  for (const auto &[id, events] : eventsMap()) {
+    auto first = events.begin() + events.upperBound(current_event_ts);
+    auto last = events.begin() + events.upperBound(last_ts);
+    for (auto it = first; it != last; ++it) {
+      updateEvent(id, (it->mono_time - begin_event_ts) / 1e9, it->dat, it->size);
+    }
+    if (first != last) {
+      updated_ts = std::max(updated_ts, std::prev(last)->mono_time);
+    }
   }
+  current_event_ts = updated_ts;
   emit privateUpdateLastMsgsSignal();
 }
 
@@ -1,12 +1,15 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <memory>
 #include <vector>
 
 #include <QBasicTimer>
 
 #include "tools/cabana/streams/abstractstream.h"
+#include "tools/cabana/streams/spscring.h"
 
 class LiveStream : public AbstractStream {
   Q_OBJECT
@@ -24,19 +27,42 @@ public:
   bool isPaused() const override { return paused_; }
   void pause(bool pause) override;
   void seekTo(double sec) override;
+  inline uint64_t mergedFrames() const { return merged_frames; }
+  inline uint64_t droppedFrames() const { return dropped_frames; }
+
+signals:
+  void framesMerged(uint64_t merged, uint64_t dropped);
 
 protected:
+  struct CanFrame {
+    uint64_t mono_time;
+    MessageId id;
+    uint8_t size;
+    std::array<uint8_t, 64> dat;
+  };
+
   virtual void streamThread() = 0;
   void handleEvent(kj::ArrayPtr<capnp::word> event);
+  // For streams that read frames directly from a device, each with its own timestamp.
+  // If logging is enabled, frames sharing a timestamp are logged as one can event.
+  void handleFrames(const CanFrame *frames, size_t count);
 
 private:
   void startUpdateTimer();
   void timerEvent(QTimerEvent *event) override;
   void updateEvents();
 
-  std::mutex lock;
+  // The frames of one received can message or device read, copied out of the source buffer.
+  struct CanBatch {
+    std::vector<CanFrame> frames;
+  };
+
   QThread *stream_thread;
-  std::vector<const CanEvent *> received_events_;
+  // filled by the stream thread and drained by the update timer without locking
+  SPSCRing<CanBatch> received_batches{4096};
+  MessageEventsMap received_events_;
+  std::atomic<uint64_t> dropped_frames = 0;
+  uint64_t merged_frames = 0;
 
   int timer_id;
   QBasicTimer update_timer;
@@ -5,9 +5,11 @@
 #include <QGridLayout>
 #include <QMessageBox>
 #include <QPushButton>
+#include <QtConcurrent>
 
 #include "common/timing.h"
 #include "tools/cabana/streams/routes.h"
+#include "tools/cabana/streams/segmentcache.h"
 
 ReplayStream::ReplayStream(QObject *parent) : AbstractStream(parent) {
   unsetenv("ZMQ");
@@ -27,23 +29,47 @@ static bool event_filter(const Event *e, void *opaque) {
   return ((ReplayStream *)opaque)->eventFilter(e);
 }
 
+std::string ReplayStream::cacheFile(int n) const {
+  return segment_cache::filePath(routeName().toStdString(), n, replay->route()->segments().at(n).rlog.isEmpty());
+}
+
+void ReplayStream::loadCachedSegments() {
+  MessageEventsMap events;
+  for (const auto &[n, _] : replay->route()->segments()) {
+    if (segment_cache::load(cacheFile(n), events)) {
+      processed_segments.insert(n);
+    }
+  }
+  mergeEvents(events);
+}
+
 void ReplayStream::mergeSegments() {
+  // the first merge comes once the stream has started and event times can be converted to seconds
+  if (!cache_loaded) {
+    cache_loaded = true;
+    loadCachedSegments();
+  }
+
   for (auto &[n, seg] : replay->segments()) {
     if (seg && seg->isLoaded() && !processed_segments.count(n)) {
       processed_segments.insert(n);
 
-      std::vector<const CanEvent *> new_events;
-      new_events.reserve(seg->log->events.size());
+      MessageEventsMap new_events;
       for (const Event &e : seg->log->events) {
         if (e.which == cereal::Event::Which::CAN) {
           capnp::FlatArrayMessageReader reader(e.data);
           auto event = reader.getRoot<cereal::Event>();
           for (const auto &c : event.getCan()) {
-            new_events.push_back(newEvent(e.mono_time, c));
+            appendEvent(new_events, e.mono_time, c);
           }
         }
       }
       mergeEvents(new_events);
+      QtConcurrent::run([route = routeName().toStdString(), file = cacheFile(n), events = std::move(new_events)]() {
+        if (segment_cache::save(file, events)) {
+          segment_cache::evict(route);
+        }
+      });
     }
   }
 }
@@ -4,6 +4,7 @@
 #include <algorithm>
 #include <memory>
 #include <set>
+#include <string>
 #include <vector>
 
 #include "common/prefix.h"
@@ -34,8 +35,11 @@ public:
 
 private:
   void mergeSegments();
+  void loadCachedSegments();
+  std::string cacheFile(int n) const;
   std::unique_ptr<Replay> replay = nullptr;
   std::set<int> processed_segments;
+  bool cache_loaded = false;
   std::unique_ptr<OpenpilotPrefix> op_prefix;
 };
 
@@ -0,0 +1,204 @@
+#include "tools/cabana/streams/segmentcache.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "common/util.h"
+
+namespace {
+
+constexpr char MAGIC[4] = {'C', 'B', 'E', 'V'};
+constexpr uint32_t VERSION = 1;
+
+struct FileHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t num_messages;
+};
+
+// followed by count mono_times, count sizes and count * stride bytes of data, padded to 8 bytes
+struct MessageHeader {
+  uint32_t address;
+  uint8_t source;
+  uint8_t stride;
+  uint16_t reserved;
+  uint64_t count;
+};
+
+inline size_t align8(size_t n) { return (n + 7) & ~(size_t)7; }
+inline size_t messageSize(const MessageHeader &h) {
+  return sizeof(MessageHeader) + align8(h.count * sizeof(uint64_t) + h.count + h.count * h.stride);
+}
+
+// Checks the columns of a message: no frame is longer than the stride and the events are sorted.
+bool validColumns(const MessageHeader &h, const char *column) {
+  const uint8_t *sizes = (const uint8_t *)column + h.count * sizeof(uint64_t);
+  if (std::any_of(sizes, sizes + h.count, [&h](uint8_t size) { return size > h.stride; })) return false;
+  const uint64_t *mono_times = (const uint64_t *)column;
+  return std::is_sorted(mono_times, mono_times + h.count);
+}
+
+std::string cacheRoot() {
+  return util::getenv("HOME") + "/.comma/cabana_cache";
+}
+
+// calls fn(path, const struct stat &) for each entry of dir
+template <class Fn>
+void forEachEntry(const std::string &dir, Fn fn) {
+  DIR *d = opendir(dir.c_str());
+  if (!d) return;
+  while (struct dirent *ent = readdir(d)) {
+    if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) continue;
+    const std::string path = dir + "/" + ent->d_name;
+    struct stat st = {};
+    if (lstat(path.c_str(), &st) == 0) fn(path, st);
+  }
+  closedir(d);
+}
+
+}  // namespace
+
+std::string segment_cache::routeDir(const std::string &route) {
+  std::string name = route;
+  std::replace(name.begin(), name.end(), '|', '_');
+  return cacheRoot() + "/" + name;
+}
+
+std::string segment_cache::filePath(const std::string &route, int segment, bool qlog) {
+  return routeDir(route) + "/" + std::to_string(segment) + (qlog ? ".qlog" : ".rlog");
+}
+
+bool segment_cache::save(const std::string &file, const MessageEventsMap &events) {
+  FileHeader header = {.version = VERSION, .num_messages = 0};
+  memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  size_t file_size = sizeof(FileHeader);
+  for (const auto &[id, store] : events) {
+    if (!store.empty()) {
+      ++header.num_messages;
+      file_size += messageSize({.stride = store.stride(), .count = store.size()});
+    }
+  }
+
+  std::string buf(file_size, '\0');
+  char *p = buf.data();
+  memcpy(p, &header, sizeof(header));
+  p += sizeof(header);
+  for (const auto &[id, store] : events) {
+    if (store.empty()) continue;
+
+    MessageHeader h = {.address = id.address, .source = id.source, .stride = store.stride(), .count = store.size()};
+    memcpy(p, &h, sizeof(h));
+    char *mono_times = p + sizeof(h);
+    char *sizes = mono_times + h.count * sizeof(uint64_t);
+    char *data = sizes + h.count;
+    CanEventsView(store).forEachSpan([&](const CanEventsView::Span &s) {
+      mono_times = (char *)memcpy(mono_times, s.mono_times, s.count * sizeof(uint64_t)) + s.count * sizeof(uint64_t);
+      sizes = (char *)memcpy(sizes, s.sizes, s.count) + s.count;
+      data = (char *)memcpy(data, s.data, s.count * h.stride) + s.count * h.stride;
+    });
+    p += messageSize(h);
+  }
+
+  // write to a temporary file first, so readers never see a partial file
+  size_t pos = file.rfind('/');
+  if (pos != std::string::npos && !util::create_directories(file.substr(0, pos), 0755)) {
+    return false;
+  }
+  const std::string tmp_file = file + "." + std::to_string(getpid()) + ".tmp";
+  if (util::write_file(tmp_file.c_str(), buf.data(), buf.size(), O_WRONLY | O_CREAT | O_TRUNC) != 0) {
+    unlink(tmp_file.c_str());
+    return false;
+  }
+  return rename(tmp_file.c_str(), file.c_str()) == 0;
+}
+
+bool segment_cache::load(const std::string &file, MessageEventsMap &events) {
+  int fd = HANDLE_EINTR(open(file.c_str(), O_RDONLY));
+  if (fd == -1) return false;
+
+  struct stat st = {};
+  void *addr = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(FileHeader)) {
+    addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (addr == MAP_FAILED) return false;
+
+  const char *begin = (const char *)addr;
+  const char *end = begin + st.st_size;
+  FileHeader header;
+  memcpy(&header, begin, sizeof(header));
+  bool valid = memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 && header.version == VERSION;
+
+  // validate the whole file before touching events
+  const char *p = begin + sizeof(FileHeader);
+  for (uint64_t i = 0; valid && i < header.num_messages; ++i) {
+    MessageHeader h;
+    valid = (size_t)(end - p) >= sizeof(h);
+    if (valid) {
+      memcpy(&h, p, sizeof(h));
+      valid = h.count <= (size_t)(end - p) / (sizeof(uint64_t) + 1 + h.stride) && messageSize(h) <= (size_t)(end - p) &&
+              validColumns(h, p + sizeof(h));
+      p += valid ? messageSize(h) : 0;
+    }
+  }
+
+  if (valid) {
+    madvise(addr, st.st_size, MADV_SEQUENTIAL);
+    p = begin + sizeof(FileHeader);
+    for (uint64_t i = 0; i < header.num_messages; ++i) {
+      MessageHeader h;
+      memcpy(&h, p, sizeof(h));
+      const uint8_t *column = (const uint8_t *)p + sizeof(h);
+      const uint64_t *mono_times = (const uint64_t *)column;
+      const uint8_t *sizes = column + h.count * sizeof(uint64_t);
+      const uint8_t *data = sizes + h.count;
+      MessageId id = {.source = h.source, .address = h.address};
+      events.try_emplace(id, id).first->second.append(mono_times, sizes, data, h.stride, h.count);
+      p += messageSize(h);
+    }
+    // mark the route as recently used for evict()
+    size_t pos = file.rfind('/');
+    if (pos != std::string::npos) {
+      utimes(file.substr(0, pos).c_str(), nullptr);
+    }
+  }
+  munmap(addr, st.st_size);
+  return valid;
+}
+
+void segment_cache::evict(const std::string &route, size_t max_bytes) {
+  struct RouteDir {
+    std::string path;
+    time_t mtime;
+    size_t size;
+  };
+  std::vector<RouteDir> dirs;
+  size_t total = 0;
+  forEachEntry(cacheRoot(), [&](const std::string &path, const struct stat &st) {
+    if (!S_ISDIR(st.st_mode)) return;
+    RouteDir dir = {.path = path, .mtime = st.st_mtime, .size = 0};
+    forEachEntry(path, [&](const std::string &, const struct stat &file_st) { dir.size += file_st.st_size; });
+    total += dir.size;
+    dirs.push_back(dir);
+  });
+  if (total <= max_bytes) return;
+
+  std::sort(dirs.begin(), dirs.end(), [](auto &l, auto &r) { return l.mtime < r.mtime; });
+  const std::string keep = routeDir(route);
+  for (const auto &dir : dirs) {
+    if (total <= max_bytes) break;
+    if (dir.path == keep) continue;
+    forEachEntry(dir.path, [](const std::string &path, const struct stat &) { unlink(path.c_str()); });
+    rmdir(dir.path.c_str());
+    total -= dir.size;
+  }
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+
+#include "tools/cabana/streams/caneventstore.h"
+
+// A compact copy of the CAN events of one route segment, stored in the column layout of
+// CanEventStore. Reopening a route maps these files instead of reading and parsing its logs.
+namespace segment_cache {
+// the cache is trimmed back to this size after each saved segment
+constexpr size_t MAX_SIZE = 2ULL * 1024 * 1024 * 1024;
+
+// the directory holding the cache files of a route
+std::string routeDir(const std::string &route);
+std::string filePath(const std::string &route, int segment, bool qlog);
+bool save(const std::string &file, const MessageEventsMap &events);
+// Appends the events in file to events. Returns false if the file is missing or invalid.
+bool load(const std::string &file, MessageEventsMap &events);
+// Removes the least recently used routes until the cache is at most max_bytes, except for route.
+void evict(const std::string &route, size_t max_bytes = MAX_SIZE);
+}  // namespace segment_cache
@@ -1,5 +1,20 @@
 #include "tools/cabana/streams/socketcanstream.h"
 
+#include <net/if.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
 #include <QDebug>
 #include <QFormLayout>
 #include <QHBoxLayout>
@@ -7,62 +22,134 @@
 #include <QPushButton>
 #include <QThread>
 
-SocketCanStream::SocketCanStream(QObject *parent, SocketCanStreamConfig config_) : config(config_), LiveStream(parent) {
-  if (!available()) {
-    throw std::runtime_error("SocketCAN plugin not available");
-  }
+#include "common/timing.h"
+
+namespace {
+
+constexpr int RECV_BATCH_SIZE = 64;
 
+inline uint64_t toNanos(const timespec &ts) { return ts.tv_sec * 1000000000ULL + ts.tv_nsec; }
+
+}  // namespace
+
+SocketCanStream::SocketCanStream(QObject *parent, SocketCanStreamConfig config_) : config(config_), LiveStream(parent) {
   qDebug() << "Connecting to SocketCAN device" << config.device;
   if (!connect()) {
     throw std::runtime_error("Failed to connect to SocketCAN device");
   }
 }
 
+SocketCanStream::~SocketCanStream() {
+  stop();
+  if (sock >= 0) close(sock);
+  qDebug() << "SocketCAN received" << (quint64)received_frames << "frames in" << (quint64)recv_calls << "reads";
+}
+
 bool SocketCanStream::available() {
   return QCanBus::instance()->plugins().contains("socketcan");
 }
 
+// Reads the raw socket directly instead of through QCanBusDevice, so that one
+// recvmmsg() call returns many frames, each with the kernel's receive timestamp.
 bool SocketCanStream::connect() {
-  // Connecting might generate some warnings about missing socketcan/libsocketcan libraries
-  // These are expected and can be ignored, we don't need the advanced features of libsocketcan
-  QString errorString;
-  device.reset(QCanBus::instance()->createDevice("socketcan", config.device, &errorString));
-
-  if (!device) {
-    qDebug() << "Failed to create SocketCAN device" << errorString;
+  const unsigned int ifindex = if_nametoindex(config.device.toStdString().c_str());
+  if (ifindex == 0) {
+    qDebug() << "No such SocketCAN device" << config.device;
     return false;
   }
 
-  if (!device->connectDevice()) {
-    qDebug() << "Failed to connect to device";
+  sock = socket(PF_CAN, SOCK_RAW | SOCK_CLOEXEC, CAN_RAW);
+  if (sock < 0) {
+    qDebug() << "Failed to create CAN socket:" << strerror(errno);
     return false;
   }
 
+  // accept CAN FD frames, stamp frames in the kernel, and wake up regularly to check for interruption
+  const int enable = 1;
+  const int timestamping = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+  const int rcvbuf = 4 * 1024 * 1024;
+  const timeval timeout = {.tv_sec = 0, .tv_usec = 100000};
+  setsockopt(sock, SOL_CAN_RAW, CAN_RAW_FD_FRAMES, &enable, sizeof(enable));
+  // SO_RCVBUFFORCE needs CAP_NET_ADMIN, SO_RCVBUF is capped by net.core.rmem_max
+  if (setsockopt(sock, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) != 0) {
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+  }
+  socklen_t rcvbuf_len = sizeof(rcvbuf_size);
+  getsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf_size, &rcvbuf_len);
+  setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPING, &timestamping, sizeof(timestamping)) != 0) {
+    qDebug() << "SO_TIMESTAMPING not supported, using receive time:" << strerror(errno);
+  }
+
+  sockaddr_can addr = {.can_family = AF_CAN, .can_ifindex = (int)ifindex};
+  if (bind(sock, (sockaddr *)&addr, sizeof(addr)) != 0) {
+    qDebug() << "Failed to bind to" << config.device << ":" << strerror(errno);
+    return false;
+  }
   return true;
 }
 
 void SocketCanStream::streamThread() {
-  while (!QThread::currentThread()->isInterruptionRequested()) {
-    QThread::msleep(1);
-
-    auto frames = device->readAllFrames();
-    if (frames.size() == 0) continue;
-
-    MessageBuilder msg;
-    auto evt = msg.initEvent();
-    auto canData = evt.initCan(frames.size());
+  struct Buffer {
+    canfd_frame frame;
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(scm_timestamping))];
+  };
+  std::vector<Buffer> buffers(RECV_BATCH_SIZE);
+  std::vector<iovec> iovs(RECV_BATCH_SIZE);
+  std::vector<mmsghdr> msgs(RECV_BATCH_SIZE);
+  std::vector<CanFrame> frames(RECV_BATCH_SIZE);
+  uint64_t last_mono_time = 0;
 
-    for (uint i = 0; i < frames.size(); i++) {
-      if (!frames[i].isValid()) continue;
-
-      canData[i].setAddress(frames[i].frameId());
-      canData[i].setSrc(0);
-
-      auto payload = frames[i].payload();
-      canData[i].setDat(kj::arrayPtr((uint8_t*)payload.data(), payload.size()));
+  while (!QThread::currentThread()->isInterruptionRequested()) {
+    for (int i = 0; i < RECV_BATCH_SIZE; ++i) {
+      iovs[i] = {.iov_base = &buffers[i].frame, .iov_len = sizeof(canfd_frame)};
+      msgs[i].msg_hdr = {.msg_iov = &iovs[i], .msg_iovlen = 1,
+                         .msg_control = buffers[i].control, .msg_controllen = sizeof(buffers[i].control)};
+    }
+    // blocks until the first frame (or the receive timeout), then takes what is queued
+    const int n = recvmmsg(sock, msgs.data(), RECV_BATCH_SIZE, MSG_WAITFORONE, nullptr);
+    if (n <= 0) {
+      if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        qDebug() << "SocketCAN read failed:" << strerror(errno);
+        QThread::msleep(100);
+      }
+      continue;
+    }
+    recv_calls += 1;
+
+    // kernel timestamps are CLOCK_REALTIME, mono_time is nanos_since_boot()
+    timespec realtime;
+    clock_gettime(CLOCK_REALTIME, &realtime);
+    const int64_t realtime_to_boot = (int64_t)nanos_since_boot() - (int64_t)toNanos(realtime);
+
+    size_t count = 0;
+    for (int i = 0; i < n; ++i) {
+      const canfd_frame &cf = buffers[i].frame;
+      const unsigned len = msgs[i].msg_len;
+      if ((len != CAN_MTU && len != CANFD_MTU) || (cf.can_id & CAN_ERR_FLAG)) continue;
+
+      uint64_t mono_time = 0;
+      for (cmsghdr *c = CMSG_FIRSTHDR(&msgs[i].msg_hdr); c; c = CMSG_NXTHDR(&msgs[i].msg_hdr, c)) {
+        if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPING) {
+          const auto *ts = (const scm_timestamping *)CMSG_DATA(c);
+          if (ts->ts[0].tv_sec != 0 || ts->ts[0].tv_nsec != 0) {
+            mono_time = toNanos(ts->ts[0]) + realtime_to_boot;
+          }
+        }
+      }
+
+      // keep the order of the frames if the clocks were adjusted between reads
+      last_mono_time = std::max(last_mono_time, mono_time ? mono_time : nanos_since_boot());
+      CanFrame &f = frames[count++];
+      f.mono_time = last_mono_time;
+      f.id = {.source = 0, .address = cf.can_id & ((cf.can_id & CAN_EFF_FLAG) ? CAN_EFF_MASK : CAN_SFF_MASK)};
+      f.size = std::min<size_t>(cf.len, len == CANFD_MTU ? CANFD_MAX_DLEN : CAN_MAX_DLEN);
+      memcpy(f.dat.data(), cf.data, f.size);
+    }
+    received_frames += count;
+    if (count > 0) {
+      handleFrames(frames.data(), count);
     }
-
-    handleEvent(capnp::messageToFlatArray(msg));
   }
 }
 
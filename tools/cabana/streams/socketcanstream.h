@@ -1,6 +1,6 @@
 #pragma once
 
-#include <memory>
+#include <atomic>
 
 #include <QtSerialBus/QCanBus>
 #include <QtSerialBus/QCanBusDevice>
@@ -17,19 +17,26 @@ class SocketCanStream : public LiveStream {
   Q_OBJECT
 public:
   SocketCanStream(QObject *parent, SocketCanStreamConfig config_ = {});
-  ~SocketCanStream() { stop(); }
+  ~SocketCanStream();
   static bool available();
 
   inline QString routeName() const override {
     return QString("Live Streaming From Socket CAN %1").arg(config.device);
   }
+  inline uint64_t receivedFrames() const { return received_frames; }
+  inline uint64_t recvCalls() const { return recv_calls; }
+  // the effective size of the socket's receive buffer, in bytes
+  inline int receiveBufferSize() const { return rcvbuf_size; }
 
 protected:
   void streamThread() override;
   bool connect();
 
   SocketCanStreamConfig config = {};
-  std::unique_ptr<QCanBusDevice> device;
+  int sock = -1;
+  int rcvbuf_size = 0;
+  std::atomic<uint64_t> received_frames = 0;
+  std::atomic<uint64_t> recv_calls = 0;
 };
 
 class OpenSocketCanWidget : public AbstractOpenStreamWidget {
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+// A bounded single-producer single-consumer ring. Slots are constructed once and
+// reused, so the producer fills them in place and keeps their allocated capacity.
+// Neither side ever blocks: push fails when the ring is full, front() returns
+// nullptr when it is empty.
+template <typename T>
+class SPSCRing {
+public:
+  // capacity is rounded up to a power of two
+  explicit SPSCRing(size_t capacity) {
+    size_t n = 1;
+    while (n < capacity) n <<= 1;
+    mask_ = n - 1;
+    slots_ = std::make_unique<T[]>(n);
+  }
+  inline size_t capacity() const { return mask_ + 1; }
+
+  // producer: returns the slot to fill, or nullptr if the ring is full
+  T *back() {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) > mask_) return nullptr;
+    return &slots_[tail & mask_];
+  }
+  // producer: publishes the slot returned by back()
+  void push() { tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+  // consumer: returns the oldest published slot, or nullptr if the ring is empty
+  T *front() {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) return nullptr;
+    return &slots_[head & mask_];
+  }
+  // consumer: hands the slot returned by front() back to the producer
+  void pop() { head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+private:
+  // keep the indices on separate cache lines so the two threads don't share one
+  alignas(64) std::atomic<size_t> head_ = 0;
+  alignas(64) std::atomic<size_t> tail_ = 0;
+  alignas(64) size_t mask_;
+  std::unique_ptr<T[]> slots_;
+};
@@ -1,29 +1,63 @@
 
 #undef INFO
+#include <linux/can.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <random>
+#include <thread>
+
+#include <QCoreApplication>
 #include <QDir>
+#include <QThread>
+#include <QTemporaryDir>
 
 #include "catch2/catch.hpp"
+#include "common/timing.h"
+#include "common/util.h"
 #include "tools/cabana/dbc/dbcmanager.h"
+#include "tools/cabana/historylog.h"
+#include "tools/cabana/streams/abstractstream.h"
+#include "tools/cabana/streams/busstatistics.h"
+#include "tools/cabana/streams/caneventstore.h"
+#include "tools/cabana/streams/segmentcache.h"
+#include "tools/cabana/streams/socketcanstream.h"
+#include "tools/cabana/streams/spscring.h"
+#include "tools/cabana/tools/findsignal.h"
+#include "tools/cabana/tools/findsimilarbits.h"
+#include "tools/cabana/utils/thumbnailcache.h"
+#include "tools/cabana/utils/util.h"
+#include "tools/replay/util.h"
 
 const std::string TEST_RLOG_URL = "https://commadataci.blob.core.windows.net/openpilotci/0c94aa1e1296d7c6/2021-05-05--19-48-37/0/rlog.bz2";
 
 TEST_CASE("DBCFile::generateDBC") {
-  QString fn = QString("%1/%2.dbc").arg(OPENDBC_FILE_PATH, "tesla_can");
-  DBCFile dbc_origin(fn);
-  DBCFile dbc_from_generated("", dbc_origin.generateDBC());
+  QDir dir(OPENDBC_FILE_PATH);
+  for (auto fn : dir.entryList({"*.dbc"}, QDir::Files, QDir::Name)) {
+    INFO(fn.toStdString());
+    DBCFile dbc_origin(dir.filePath(fn));
+    DBCFile dbc_from_generated("", dbc_origin.generateDBC());
 
-  REQUIRE(dbc_origin.getMessages().size() == dbc_from_generated.getMessages().size());
-  auto &msgs = dbc_origin.getMessages();
-  auto &new_msgs = dbc_from_generated.getMessages();
-  for (auto &[id, m] : msgs) {
-    auto &new_m = new_msgs.at(id);
-    REQUIRE(m.name == new_m.name);
-    REQUIRE(m.size == new_m.size);
-    REQUIRE(m.getSignals().size() == new_m.getSignals().size());
-    auto sigs = m.getSignals();
-    auto new_sigs = new_m.getSignals();
-    for (int i = 0; i < sigs.size(); ++i) {
-      REQUIRE(*sigs[i] == *new_sigs[i]);
+    REQUIRE(dbc_origin.getMessages().size() == dbc_from_generated.getMessages().size());
+    auto &msgs = dbc_origin.getMessages();
+    auto &new_msgs = dbc_from_generated.getMessages();
+    for (auto &[id, m] : msgs) {
+      auto &new_m = new_msgs.at(id);
+      REQUIRE(m.name == new_m.name);
+      REQUIRE(m.size == new_m.size);
+      REQUIRE(m.transmitter == new_m.transmitter);
+      REQUIRE(m.comment == new_m.comment);
+      REQUIRE(m.getSignals().size() == new_m.getSignals().size());
+      auto sigs = m.getSignals();
+      auto new_sigs = new_m.getSignals();
+      for (int i = 0; i < sigs.size(); ++i) {
+        REQUIRE(*sigs[i] == *new_sigs[i]);
+      }
     }
   }
 }
@@ -155,3 +189,1033 @@ TEST_CASE("parse_opendbc") {
   INFO(errors.join("\n").toStdString());
   REQUIRE(errors.empty());
 }
+
+TEST_CASE("parse_dbc errors") {
+  auto parse_error = [](const QString &content) -> std::string {
+    try {
+      DBCFile("", content);
+    } catch (std::exception &e) {
+      return e.what();
+    }
+    return {};
+  };
+  // [file:line:column]
+  REQUIRE(parse_error("BO_ 160 message_1: 8 EON\n SG_ signal_1 : 0|12@1x (1,0) [0|4095] \"\" XXX\n") ==
+          "[:2:23]expected '+' or '-': SG_ signal_1 : 0|12@1x (1,0) [0|4095] \"\" XXX");
+  REQUIRE(parse_error("BO_ 160 message_1: 8 EON\nBO_ 160 message_2: 8 EON\n") ==
+          "[:2:5]Duplicate message address: 160: BO_ 160 message_2: 8 EON");
+  REQUIRE(parse_error("BO_ 160 message_1 8 EON\n") == "[:1:19]expected ':': BO_ 160 message_1 8 EON");
+  REQUIRE(parse_error("BO_ 160 message_1: 8 EON\nVAL_ 160 signal_1 ;\n") ==
+          "[:2:19]invalid VAL_ line format: VAL_ 160 signal_1 ;");
+  REQUIRE(parse_error("BO_ 160 message_1: 8 EON\nCM_ BO_ 160 \"comment\n") ==
+          "[:2:13]unterminated string: CM_ BO_ 160 \"comment");
+}
+
+TEST_CASE("parse_opendbc benchmark", "[.benchmark]") {
+  QDir dir(OPENDBC_FILE_PATH);
+  std::vector<QString> contents;
+  for (auto fn : dir.entryList({"*.dbc"}, QDir::Files, QDir::Name)) {
+    QFile file(dir.filePath(fn));
+    REQUIRE(file.open(QIODevice::ReadOnly));
+    contents.push_back(file.readAll());
+  }
+
+  const int iterations = 10;
+  size_t num_msgs = 0;
+  double start = millis_since_boot();
+  for (int i = 0; i < iterations; ++i) {
+    for (const auto &content : contents) {
+      num_msgs += DBCFile("", content).getMessages().size();
+    }
+  }
+  printf("parsed %zu files, %zu messages: %.1f ms per pass\n", contents.size(), num_msgs / iterations,
+         (millis_since_boot() - start) / iterations);
+}
+
+TEST_CASE("CanEventStore") {
+  const MessageId id = {.source = 1, .address = 0x123};
+  CanEventStore store(id);
+  uint8_t dat[64] = {};
+  for (int i = 0; i < 64; ++i) dat[i] = i;
+
+  store.append(100, dat, 8);
+  store.append(300, dat + 1, 8);
+  REQUIRE(store.size() == 2);
+  REQUIRE(store.stride() == 8);
+
+  // a larger frame grows the stride and keeps existing payloads
+  store.append(400, dat + 2, 12);
+  REQUIRE(store.stride() == 12);
+  REQUIRE(store[1].size == 8);
+  REQUIRE(memcmp(store[1].dat, dat + 1, 8) == 0);
+  REQUIRE(memcmp(store[2].dat, dat + 2, 12) == 0);
+
+  // merge an older batch with a smaller stride
+  CanEventStore older(id);
+  older.append(200, dat + 3, 4);
+  older.append(250, dat + 4, 4);
+  store.merge(older);
+  REQUIRE(store.size() == 5);
+  std::vector<uint64_t> times;
+  for (const CanEvent &e : store) {
+    REQUIRE(e.src == id.source);
+    REQUIRE(e.address == id.address);
+    times.push_back(e.mono_time);
+  }
+  REQUIRE(times == std::vector<uint64_t>{100, 200, 250, 300, 400});
+  REQUIRE(store[1].size == 4);
+  REQUIRE(memcmp(store[1].dat, dat + 3, 4) == 0);
+  REQUIRE(memcmp(store[3].dat, dat + 1, 8) == 0);
+
+  CanEventsView view(store);
+  auto first = std::lower_bound(view.begin(), view.end(), 250, CompareCanEvent());
+  auto last = std::upper_bound(view.begin(), view.end(), 300, CompareCanEvent());
+  REQUIRE(first->mono_time == 250);
+  REQUIRE(std::distance(first, last) == 2);
+  REQUIRE(std::prev(view.end())->mono_time == 400);
+  REQUIRE(view.rbegin()->mono_time == 400);
+  REQUIRE(CanEventsView().empty());
+}
+
+TEST_CASE("CanEventStore chunks") {
+  // merge segments in random order across chunk boundaries and compare with a sorted vector
+  std::mt19937 rng(Catch::rngSeed());
+  const MessageId id = {.source = 0, .address = 0x100};
+  CanEventStore store(id);
+  std::vector<std::pair<uint64_t, uint8_t>> expected;
+  std::vector<int> segments(20);
+  std::iota(segments.begin(), segments.end(), 0);
+  std::shuffle(segments.begin(), segments.end(), rng);
+  for (int seg : segments) {
+    CanEventStore batch(id);
+    const size_t n = rng() % 3 == 0 ? rng() % 10 : rng() % (3 * CanEventStore::CHUNK_SIZE);
+    for (size_t i = 0; i < n; ++i) {
+      const uint64_t mono_time = seg * 1000000 + i * 10;
+      const uint8_t dat[8] = {(uint8_t)rng()};
+      batch.append(mono_time, dat, 1 + seg % 8);
+      expected.push_back({mono_time, dat[0]});
+    }
+    store.merge(batch);
+  }
+  std::sort(expected.begin(), expected.end());
+  REQUIRE(store.size() == expected.size());
+  REQUIRE(store.stride() == 8);
+  for (size_t c = 0; c < store.numChunks(); ++c) {
+    REQUIRE(store.chunk(c).size() > 0);
+    REQUIRE(store.chunk(c).size() <= CanEventStore::CHUNK_SIZE);
+  }
+
+  size_t i = 0;
+  for (const CanEvent &e : store) {
+    REQUIRE(e.mono_time == expected[i].first);
+    REQUIRE(e.dat[0] == expected[i].second);
+    ++i;
+  }
+  for (auto it = store.end(); it != store.begin();) {
+    --it;
+    --i;
+    REQUIRE(it->mono_time == expected[i].first);
+  }
+
+  // range queries and columnar access within a sub view
+  for (int iter = 0; iter < 200; ++iter) {
+    const size_t first = rng() % expected.size();
+    const size_t last = first + rng() % (expected.size() - first + 1);
+    const CanEventsView view(store.begin() + first, store.begin() + last);
+    const uint64_t mono_time = rng() % (expected.back().first + 10);
+    REQUIRE(view.lowerBound(mono_time) == std::lower_bound(view.begin(), view.end(), mono_time, CompareCanEvent()));
+    REQUIRE(view.upperBound(mono_time) == std::upper_bound(view.begin(), view.end(), mono_time, CompareCanEvent()));
+
+    size_t j = first;
+    if (!view.empty()) {
+      view.forEachSpan([&](const CanEventsView::Span &span) {
+        for (size_t k = 0; k < span.count; ++k, ++j) {
+          REQUIRE(span.mono_times[k] == expected[j].first);
+          REQUIRE(span.data[k * view.stride()] == expected[j].second);
+        }
+      });
+    }
+    REQUIRE(j == last);
+  }
+}
+
+TEST_CASE("CanEventStore bit flips") {
+  // appended and merged out of order, with the stride growing halfway through
+  std::mt19937 rng(Catch::rngSeed());
+  const MessageId id = {.source = 0, .address = 0x100};
+  CanEventStore store(id);
+  uint8_t dat[64] = {};
+  for (size_t i = 0; i < 2 * CanEventStore::CHUNK_SIZE + 100; ++i) {
+    dat[rng() % 8] ^= 1 << (rng() % 8);
+    store.append(i * 10, dat, 8);
+  }
+  std::vector<int> segments(10);
+  std::iota(segments.begin(), segments.end(), 1);
+  std::shuffle(segments.begin(), segments.end(), rng);
+  for (int seg : segments) {
+    CanEventStore batch(id);
+    for (size_t i = 0, n = rng() % (2 * CanEventStore::CHUNK_SIZE); i < n; ++i) {
+      dat[rng() % 64] ^= 1 << (rng() % 8);
+      batch.append(seg * 1000000 + i * 10, dat, seg > 5 ? 64 : 8);
+    }
+    store.merge(batch);
+  }
+  REQUIRE(store.stride() == 64);
+
+  for (int iter = 0; iter < 50; ++iter) {
+    const size_t first = iter == 0 ? 0 : rng() % store.size();
+    const size_t last = iter == 0 ? store.size() : first + rng() % (store.size() - first + 1);
+    const CanEventsView view(store.begin() + first, store.begin() + last);
+    std::vector<std::array<uint32_t, 8>> expected(view.empty() ? 0 : store.stride());
+    for (size_t i = first + 1; i < last; ++i) {
+      const CanEvent prev = store[i - 1], cur = store[i];
+      for (size_t j = 0; j < store.stride(); ++j) {
+        for (int bit = 0; bit < 8; ++bit) {
+          expected[j][7 - bit] += ((prev.dat[j] ^ cur.dat[j]) >> bit) & 1;
+        }
+      }
+    }
+    REQUIRE(view.bitFlips() == expected);
+  }
+}
+
+TEST_CASE("CanEventStore benchmark", "[.benchmark]") {
+  // frames of many messages arrive interleaved, as on a bus, and are scanned one message at a time
+  const size_t num_frames = 5000000, num_msgs = 50;
+  std::mt19937 rng(0);
+
+  // Previous layout: one heap object per frame plus a pointer in the message and all-events lists.
+  struct PointerCanEvent {
+    uint8_t src;
+    uint32_t address;
+    uint64_t mono_time;
+    uint8_t size;
+    uint8_t dat[];
+  };
+  MonotonicBuffer buffer(6 * 1024 * 1024);
+  std::vector<std::vector<const PointerCanEvent *>> pointer_events(num_msgs);
+  std::vector<CanEventStore> stores;
+  stores.reserve(num_msgs);
+  for (size_t m = 0; m < num_msgs; ++m) {
+    stores.emplace_back(MessageId{.source = 0, .address = (uint32_t)(0x100 + m)});
+  }
+  for (size_t i = 0; i < num_frames; ++i) {
+    const size_t m = i % num_msgs;
+    uint8_t dat[8];
+    for (auto &b : dat) b = rng();
+    auto e = (PointerCanEvent *)buffer.allocate(sizeof(PointerCanEvent) + sizeof(dat));
+    e->src = 0;
+    e->address = 0x100 + m;
+    e->mono_time = i * 200000;
+    e->size = sizeof(dat);
+    memcpy(e->dat, dat, sizeof(dat));
+    pointer_events[m].push_back(e);
+    stores[m].append(i * 200000, dat, sizeof(dat));
+  }
+
+  const size_t pointer_bytes = ((sizeof(PointerCanEvent) + 8 + 15) & ~15) + 2 * sizeof(void *);
+  size_t store_bytes = 0;
+  for (const auto &store : stores) store_bytes += store.memoryUsage();
+  printf("memory per frame: pointer layout %zu bytes, columnar store %.1f bytes\n",
+         pointer_bytes, store_bytes / (double)num_frames);
+
+  uint64_t sum = 0;
+  double start = millis_since_boot();
+  for (const auto &events : pointer_events) {
+    for (auto e : events) sum += e->mono_time + e->dat[3];
+  }
+  double pointer_ms = millis_since_boot() - start;
+
+  uint64_t store_sum = 0;
+  start = millis_since_boot();
+  for (const auto &store : stores) {
+    for (const CanEvent &e : CanEventsView(store)) store_sum += e.mono_time + e.dat[3];
+  }
+  double store_ms = millis_since_boot() - start;
+
+  printf("scan %zu frames of %zu messages: pointer layout %.2f ms, columnar store %.2f ms\n",
+         num_frames, num_msgs, pointer_ms, store_ms);
+  REQUIRE(sum == store_sum);
+}
+
+TEST_CASE("CanEventsView::bitFlips benchmark", "[.benchmark]") {
+  std::mt19937 rng(Catch::rngSeed());
+  CanEventStore store({.source = 0, .address = 0x123});
+  uint8_t dat[8] = {};
+  for (size_t i = 0; i < 500000; ++i) {
+    dat[rng() % 8] ^= 1 << (rng() % 8);
+    store.append(i * 10000000, dat, sizeof(dat));
+  }
+  std::vector<std::pair<size_t, size_t>> ranges(100);
+  for (auto &[first, last] : ranges) {
+    first = rng() % store.size();
+    last = first + rng() % (store.size() - first + 1);
+  }
+
+  // walking the events of each range
+  double start = millis_since_boot();
+  uint64_t walk_sum = 0;
+  for (auto [first, last] : ranges) {
+    std::array<std::array<uint32_t, 8>, 8> counts = {};
+    for (auto it = store.begin() + first + 1; it < store.begin() + last; ++it) {
+      const CanEvent prev = it[-1], cur = *it;
+      for (int j = 0; j < 8; ++j) {
+        for (int bit = 0; bit < 8; ++bit) counts[j][7 - bit] += ((prev.dat[j] ^ cur.dat[j]) >> bit) & 1;
+      }
+    }
+    for (const auto &c : counts) walk_sum += std::accumulate(c.begin(), c.end(), 0u);
+  }
+  const double walk_ms = millis_since_boot() - start;
+
+  start = millis_since_boot();
+  uint64_t prefix_sum = 0;
+  for (auto [first, last] : ranges) {
+    for (const auto &c : CanEventsView(store.begin() + first, store.begin() + last).bitFlips()) {
+      prefix_sum += std::accumulate(c.begin(), c.end(), 0u);
+    }
+  }
+  const double prefix_ms = millis_since_boot() - start;
+
+  printf("bit flips of %zu ranges: walking events %.2f ms, prefix sums %.2f ms\n", ranges.size(), walk_ms, prefix_ms);
+  REQUIRE(walk_sum == prefix_sum);
+}
+
+TEST_CASE("CanEventStore merge benchmark", "[.benchmark]") {
+  // segments of a 100Hz message arriving in random order, as when replay loads them out of order
+  const int num_segments = 600;
+  const int events_per_segment = 6000;
+  std::vector<int> segments(num_segments);
+  std::iota(segments.begin(), segments.end(), 0);
+  std::shuffle(segments.begin(), segments.end(), std::mt19937(0));
+  const uint8_t dat[8] = {};
+
+  CanEventStore store;
+  double merge_ms = 0;
+  for (int seg : segments) {
+    CanEventStore batch;
+    for (int i = 0; i < events_per_segment; ++i) {
+      batch.append(seg * 60000000000ULL + i * 10000000ULL, dat, sizeof(dat));
+    }
+    double start = millis_since_boot();
+    store.merge(batch);
+    merge_ms += millis_since_boot() - start;
+  }
+  printf("merged %d shuffled segments (%zu events) in %.1f ms, %zu chunks\n",
+         num_segments, store.size(), merge_ms, store.numChunks());
+  REQUIRE(store.size() == (size_t)num_segments * events_per_segment);
+}
+
+TEST_CASE("Signal::getValues matches get_raw_value") {
+  const int stride = GENERATE(8, 64, 5);
+  std::mt19937 rng(Catch::rngSeed());
+  for (int iter = 0; iter < 20000; ++iter) {
+    cabana::Signal sig = {};
+    sig.start_bit = rng() % (stride * 8);
+    sig.size = 1 + rng() % 64;
+    sig.is_little_endian = rng() % 2;
+    sig.is_signed = sig.size < 64 && rng() % 2;
+    sig.factor = rng() % 2 ? 1.0 : std::uniform_real_distribution<double>(-10, 10)(rng);
+    sig.offset = rng() % 2 ? 0.0 : std::uniform_real_distribution<double>(-100, 100)(rng);
+    updateMsbLsb(sig);
+
+    // full frames take the single-load path, short frames the per-byte steps
+    const bool full_frames = rng() % 2;
+    const int count = 1 + rng() % 300;
+    std::vector<uint8_t> data(count * stride), sizes(count);
+    for (int i = 0; i < count; ++i) {
+      sizes[i] = full_frames ? stride : 1 + rng() % stride;
+      for (int j = 0; j < sizes[i]; ++j) data[i * stride + j] = rng();
+    }
+
+    std::vector<double> values(count);
+    sig.getValues(data.data(), stride, sizes.data(), count, values.data());
+    for (int i = 0; i < count; ++i) {
+      double expected = get_raw_value(data.data() + i * stride, sizes[i], sig);
+      INFO("start_bit " << sig.start_bit << " size " << sig.size << " little_endian " << sig.is_little_endian
+                        << " signed " << sig.is_signed << " frame size " << (int)sizes[i]);
+      REQUIRE(memcmp(&expected, &values[i], sizeof(double)) == 0);
+    }
+  }
+}
+
+TEST_CASE("Signal::getValues multiplexed") {
+  DBCFile file("", R"(BO_ 162 message_1: 8 XXX
+  SG_ mux M : 0|8@1+ (1,0) [0|255] "" XXX
+  SG_ sig_4 m4 : 8|16@1+ (0.5,1) [0|1] "" XXX
+)");
+  auto msg = file.msg(162);
+  REQUIRE(msg != nullptr);
+  auto sig = msg->sig("sig_4");
+  REQUIRE(sig->multiplexor != nullptr);
+
+  const uint8_t data[][8] = {{4, 0x10, 0x20}, {3, 0x10, 0x20}, {4, 0xff, 0xff}};
+  const uint8_t sizes[] = {8, 8, 8};
+  double values[3];
+  sig->getValues(&data[0][0], 8, sizes, 3, values);
+  for (int i = 0; i < 3; ++i) {
+    double value = 0;
+    if (sig->getValue(data[i], 8, &value)) {
+      REQUIRE(values[i] == value);
+    } else {
+      REQUIRE(std::isnan(values[i]));
+    }
+  }
+}
+
+TEST_CASE("MinMaxPyramid") {
+  std::mt19937 rng(Catch::rngSeed());
+  std::vector<QPointF> points;
+  MinMaxPyramid pyramid;
+  // grow the series in uneven batches, as live streaming does
+  while (points.size() < 3000) {
+    const size_t n = 1 + rng() % 300;
+    for (size_t i = 0; i < n; ++i) {
+      points.emplace_back(points.size(), std::uniform_real_distribution<double>(-100, 100)(rng));
+    }
+    pyramid.append(points);
+    REQUIRE(pyramid.size() == points.size());
+
+    for (int i = 0; i < 50; ++i) {
+      size_t first = rng() % points.size();
+      size_t last = first + 1 + rng() % (points.size() - first);
+      auto [min, max] = std::minmax_element(points.begin() + first, points.begin() + last,
+                                            [](auto &l, auto &r) { return l.y() < r.y(); });
+      REQUIRE(pyramid.minmax(points, first, last) == std::make_pair(min->y(), max->y()));
+
+      const size_t max_buckets = 1 + rng() % 100;
+      for (bool bucket_ends : {false, true}) {
+        std::vector<QPointF> out;
+        pyramid.downsample(points, first, last, max_buckets, out, bucket_ends);
+        REQUIRE(out.front() == points[first]);
+        REQUIRE(out.back() == points[last - 1]);
+        REQUIRE(out.size() <= std::max(last - first, (bucket_ends ? 4 : 2) * (max_buckets + 2) + 2));
+        REQUIRE(std::is_sorted(out.begin(), out.end(), [](auto &l, auto &r) { return l.x() < r.x(); }));
+        // the extremes are kept, also when they are in a partial bucket at an edge
+        REQUIRE(std::find(out.begin(), out.end(), *min) != out.end());
+        REQUIRE(std::find(out.begin(), out.end(), *max) != out.end());
+      }
+    }
+  }
+
+  MinMaxPyramid rebuilt;
+  rebuilt.build(points);
+  REQUIRE(rebuilt.minmax(points, 0, points.size()) == pyramid.minmax(points, 0, points.size()));
+}
+
+TEST_CASE("MinMaxPyramid benchmark", "[.benchmark]") {
+  // points handed to the chart and time to produce them for a 2000 pixel wide plot
+  const size_t plot_width = 2000;
+  std::mt19937 rng(0);
+  for (size_t n : {10000, 100000, 1000000, 10000000}) {
+    std::vector<QPointF> points;
+    points.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+      points.emplace_back(i / 100.0, std::sin(i / 1000.0) * 100 + rng() % 10);
+    }
+
+    double start = millis_since_boot();
+    MinMaxPyramid pyramid;
+    pyramid.build(points);
+    double build_ms = millis_since_boot() - start;
+
+    std::vector<QPointF> out;
+    start = millis_since_boot();
+    const int iterations = 100;
+    for (int i = 0; i < iterations; ++i) {
+      out.clear();
+      pyramid.downsample(points, 0, points.size(), plot_width, out);
+    }
+    double downsample_ms = (millis_since_boot() - start) / iterations;
+
+    start = millis_since_boot();
+    auto minmax = pyramid.minmax(points, n / 3, n - 1);
+    double minmax_ms = millis_since_boot() - start;
+
+    printf("%zu points: build %.2f ms, %zu points drawn in %.3f ms per redraw, minmax %.4f ms [%.1f, %.1f]\n",
+           n, build_ms, out.size(), downsample_ms, minmax_ms, minmax.first, minmax.second);
+    REQUIRE(out.size() <= 2 * (plot_width + 2) + 2);
+  }
+}
+
+TEST_CASE("SignalBitPlanes::find matches get_raw_value") {
+  const int stride = GENERATE(8, 64, 5);
+  const bool full_frames = GENERATE(true, false);
+  std::mt19937 rng(Catch::rngSeed());
+
+  CanEventStore store({.source = 0, .address = 0x100});
+  const size_t count = 700;
+  for (size_t i = 0; i < count; ++i) {
+    // runs of zero and 0xff bytes make equal values likely
+    uint8_t dat[64] = {};
+    const int size = full_frames ? stride : 1 + rng() % stride;
+    for (int j = 0; j < size; ++j) dat[j] = rng() % 3 == 0 ? 0 : rng() % 2 ? rng() : 0xff;
+    store.append(i * 1000, dat, size);
+  }
+  SignalBitPlanes planes(store);
+  REQUIRE(planes.size() == count);
+
+  for (int iter = 0; iter < 5000; ++iter) {
+    cabana::Signal sig = {};
+    sig.start_bit = rng() % (stride * 8);
+    sig.size = 1 + rng() % 64;
+    sig.is_little_endian = rng() % 2;
+    sig.is_signed = sig.size < 64 && rng() % 2;
+    const double factors[] = {1.0, -1.0, 0.0, std::uniform_real_distribution<double>(-3, 3)(rng)};
+    sig.factor = factors[rng() % 4];
+    sig.offset = rng() % 2 ? 0.0 : std::uniform_real_distribution<double>(-100, 100)(rng);
+    updateMsbLsb(sig);
+
+    // compare with values the signal takes, so that = and between find matches
+    auto random_value = [&]() {
+      const CanEvent e = store[rng() % count];
+      return get_raw_value(e.dat, e.size, sig);
+    };
+    FindSignalFilter filter = {.compare = (FindSignalFilter::Compare)(rng() % 7)};
+    filter.v1 = random_value();
+    filter.v2 = random_value();
+    const size_t first = rng() % count;
+    size_t expected = first;
+    while (expected < count && !filter(get_raw_value(store[expected].dat, store[expected].size, sig))) ++expected;
+
+    INFO("start_bit " << sig.start_bit << " size " << sig.size << " little_endian " << sig.is_little_endian
+                      << " signed " << sig.is_signed << " factor " << sig.factor << " compare " << filter.compare);
+    REQUIRE(planes.find(sig, filter.rawRange(sig), first, count) == expected);
+  }
+}
+
+TEST_CASE("SignalBitPlanes benchmark", "[.benchmark]") {
+  // every 8-16 bit little endian candidate of an 8 byte message, with a value that never matches
+  const size_t num_frames = 200000;
+  std::mt19937 rng(0);
+  CanEventStore store({.source = 0, .address = 0x100});
+  for (size_t i = 0; i < num_frames; ++i) {
+    uint8_t dat[8];
+    for (auto &d : dat) d = rng() % 200;
+    store.append(i * 10000000, dat, sizeof(dat));
+  }
+  std::vector<cabana::Signal> candidates;
+  for (int size = 8; size <= 16; ++size) {
+    for (int start = 0; start <= 64 - size; ++start) {
+      cabana::Signal sig = {};
+      sig.start_bit = start;
+      sig.size = size;
+      sig.is_little_endian = true;
+      updateMsbLsb(sig);
+      candidates.push_back(sig);
+    }
+  }
+  const FindSignalFilter filter = {.compare = FindSignalFilter::Equal, .v1 = 1e9};
+
+  size_t matches = 0;
+  double start = millis_since_boot();
+  for (const auto &sig : candidates) {
+    auto it = std::find_if(store.begin(), store.end(), [&](const CanEvent &e) { return filter(get_raw_value(e.dat, e.size, sig)); });
+    matches += it != store.end();
+  }
+  double per_event_ms = millis_since_boot() - start;
+
+  start = millis_since_boot();
+  SignalBitPlanes planes(store);
+  for (const auto &sig : candidates) {
+    matches += planes.find(sig, filter.rawRange(sig), 0, planes.size()) < planes.size();
+  }
+  double planes_ms = millis_since_boot() - start;
+
+  printf("%zu candidates x %zu frames: per event %.1f ms, bit planes %.1f ms\n",
+         candidates.size(), num_frames, per_event_ms, planes_ms);
+  REQUIRE(matches == 0);
+}
+
+TEST_CASE("FindSimilarBitsDlg::countMismatches") {
+  const bool equal = GENERATE(true, false);
+  std::mt19937 rng(Catch::rngSeed());
+  for (int iter = 0; iter < 20; ++iter) {
+    CanEventStore store({.source = 0, .address = 0x100});
+    std::vector<FindSimilarBitsDlg::TargetBit> target;
+    const size_t count = 1 + rng() % 1000;
+    for (size_t i = 0; i < count; ++i) {
+      uint8_t dat[8];
+      for (auto &d : dat) d = rng();
+      store.append(i * 100, dat, 1 + rng() % 8);
+      if (rng() % 4 == 0) target.push_back({i * 100 + rng() % 200, rng() % 2 == 0});
+    }
+    std::sort(target.begin(), target.end(), [](auto &l, auto &r) { return l.mono_time < r.mono_time; });
+
+    // compare every event with the last target sample at or before it, one bit at a time
+    std::vector<uint32_t> expected;
+    size_t t = 0;
+    for (const CanEvent &e : CanEventsView(store)) {
+      while (t < target.size() && target[t].mono_time <= e.mono_time) ++t;
+      if (t == 0) continue;
+      expected.resize(std::max<size_t>(expected.size(), e.size * 8));
+      for (int i = 0; i < e.size; ++i) {
+        for (int j = 0; j < 8; ++j) {
+          bool bit = ((e.dat[i] >> (7 - j)) & 1) != 0;
+          expected[i * 8 + j] += equal ? (bit != target[t - 1].value) : (bit == target[t - 1].value);
+        }
+      }
+    }
+    REQUIRE(FindSimilarBitsDlg::countMismatches(store, target, equal) == expected);
+  }
+}
+
+TEST_CASE("FindSimilarBitsDlg::countMismatches benchmark", "[.benchmark]") {
+  // one hour of a 100 Hz target bit against 200 messages at 50 Hz
+  const uint64_t duration = 3600ULL * 1000000000ULL;
+  std::mt19937 rng(0);
+  std::vector<FindSimilarBitsDlg::TargetBit> target;
+  for (uint64_t ts = 0; ts < duration; ts += 10000000) {
+    target.push_back({ts, rng() % 2 == 0});
+  }
+  std::vector<CanEventStore> messages(200);
+  for (auto &store : messages) {
+    for (uint64_t ts = rng() % 20000000; ts < duration; ts += 20000000) {
+      uint64_t dat = ((uint64_t)rng() << 32) | rng();
+      store.append(ts, (const uint8_t *)&dat, sizeof(dat));
+    }
+  }
+
+  size_t total = 0;
+  double start = millis_since_boot();
+  for (const auto &store : messages) {
+    total += FindSimilarBitsDlg::countMismatches(store, target, true).size();
+  }
+  printf("compared %zu bits of %zu messages (%zu frames each) in %.1f ms on one thread\n",
+         total, messages.size(), messages[0].size(), millis_since_boot() - start);
+  REQUIRE(total == messages.size() * 64);
+}
+
+TEST_CASE("segment_cache") {
+  std::mt19937 rng(Catch::rngSeed());
+  MessageEventsMap events;
+  for (uint32_t address : {0x100, 0x200, 0x300}) {
+    MessageId id = {.source = (uint8_t)(address >> 8), .address = address};
+    auto &store = events.try_emplace(id, id).first->second;
+    for (int i = 0; i < 1000; ++i) {
+      uint8_t dat[64];
+      for (auto &d : dat) d = rng();
+      store.append(i * 1000 + address, dat, address == 0x300 ? 1 + rng() % 64 : 8);
+    }
+  }
+  events.try_emplace({.source = 0, .address = 0x400}, MessageId{.source = 0, .address = 0x400});
+
+  QTemporaryDir dir;
+  const std::string file = dir.path().toStdString() + "/route/0.rlog";
+  REQUIRE(segment_cache::save(file, events));
+
+  // loaded events are appended to what is already in the map
+  MessageEventsMap loaded;
+  MessageId first_id = {.source = 1, .address = 0x100};
+  loaded.try_emplace(first_id, first_id).first->second.append(0, (const uint8_t *)"\x01", 1);
+  REQUIRE(segment_cache::load(file, loaded));
+  REQUIRE(loaded.size() == 3);
+  for (const auto &[id, store] : events) {
+    if (store.empty()) continue;
+    const auto &l = loaded.at(id);
+    const size_t offset = l.size() - store.size();
+    REQUIRE(offset == (id.address == 0x100 ? 1 : 0));
+    for (size_t i = 0; i < store.size(); ++i) {
+      REQUIRE(l[offset + i].mono_time == store[i].mono_time);
+      REQUIRE(l[offset + i].size == store[i].size);
+      REQUIRE(memcmp(l[offset + i].dat, store[i].dat, store[i].size) == 0);
+    }
+  }
+
+  SECTION("invalid files are rejected") {
+    MessageEventsMap ignored;
+    REQUIRE_FALSE(segment_cache::load(dir.path().toStdString() + "/route/1.rlog", ignored));
+    std::string content = util::read_file(file);
+    content.resize(content.size() / 2);
+    REQUIRE(util::write_file(file.c_str(), content.data(), content.size(), O_WRONLY | O_TRUNC) == 0);
+    REQUIRE_FALSE(segment_cache::load(file, ignored));
+    REQUIRE(ignored.empty());
+  }
+
+  SECTION("corrupt columns are rejected") {
+    // the first message: its header follows the 16 byte file header, then its columns
+    std::string content = util::read_file(file);
+    const size_t message = 16, columns = message + 16;
+    uint64_t count;
+    memcpy(&count, content.data() + message + 8, sizeof(count));
+    REQUIRE(count > 1);
+    SECTION("frame longer than the stride") {
+      content[columns + count * sizeof(uint64_t)] = content[message + 5] + 1;
+    }
+    SECTION("unsorted events") {
+      std::swap_ranges(content.begin() + columns, content.begin() + columns + 8, content.begin() + columns + 8);
+    }
+    REQUIRE(util::write_file(file.c_str(), content.data(), content.size(), O_WRONLY | O_TRUNC) == 0);
+    MessageEventsMap ignored;
+    REQUIRE_FALSE(segment_cache::load(file, ignored));
+    REQUIRE(ignored.empty());
+  }
+}
+
+TEST_CASE("segment_cache::evict") {
+  QTemporaryDir home;
+  const QByteArray old_home = qgetenv("HOME");
+  qputenv("HOME", home.path().toUtf8());
+
+  // three routes of 1000 bytes, used in order
+  const std::string content(1000, 'x');
+  for (int i = 0; i < 3; ++i) {
+    const std::string file = segment_cache::filePath("route" + std::to_string(i), 0, false);
+    REQUIRE(util::create_directories(file.substr(0, file.rfind('/')), 0755));
+    REQUIRE(util::write_file(file.c_str(), content.data(), content.size(), O_WRONLY | O_CREAT) == 0);
+    struct timeval times[2] = {{.tv_sec = 1000 + i}, {.tv_sec = 1000 + i}};
+    REQUIRE(utimes(segment_cache::routeDir("route" + std::to_string(i)).c_str(), times) == 0);
+  }
+
+  // the oldest route goes first, the current one is kept even if it is the oldest
+  segment_cache::evict("route0", 2000);
+  REQUIRE(util::file_exists(segment_cache::filePath("route0", 0, false)));
+  REQUIRE_FALSE(util::file_exists(segment_cache::routeDir("route1")));
+  REQUIRE(util::file_exists(segment_cache::filePath("route2", 0, false)));
+  segment_cache::evict("route2", 2000);
+  REQUIRE(util::file_exists(segment_cache::filePath("route0", 0, false)));
+  segment_cache::evict("route2", 1000);
+  REQUIRE_FALSE(util::file_exists(segment_cache::routeDir("route0")));
+  REQUIRE(util::file_exists(segment_cache::filePath("route2", 0, false)));
+
+  qputenv("HOME", old_home);
+}
+
+TEST_CASE("SPSCRing") {
+  SPSCRing<std::vector<int>> ring(5);
+  REQUIRE(ring.capacity() == 8);
+  REQUIRE(ring.front() == nullptr);
+
+  SECTION("push fails when full") {
+    for (int i = 0; i < ring.capacity(); ++i) {
+      auto slot = ring.back();
+      REQUIRE(slot != nullptr);
+      slot->assign(1, i);
+      ring.push();
+    }
+    REQUIRE(ring.back() == nullptr);
+    REQUIRE(ring.front()->at(0) == 0);
+    ring.pop();
+    REQUIRE(ring.back() != nullptr);
+  }
+
+  SECTION("items arrive in order across threads") {
+    const int count = 200000;
+    std::thread producer([&]() {
+      for (int i = 0; i < count;) {
+        if (auto slot = ring.back()) {
+          slot->assign(i % 7 + 1, i);
+          ring.push();
+          ++i;
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    });
+    int next = 0;
+    while (next < count) {
+      if (auto slot = ring.front()) {
+        REQUIRE(slot->size() == next % 7 + 1);
+        REQUIRE(slot->back() == next);
+        ring.pop();
+        ++next;
+      } else {
+        std::this_thread::yield();
+      }
+    }
+    producer.join();
+    REQUIRE(ring.front() == nullptr);
+  }
+}
+
+TEST_CASE("FrequencyEstimator") {
+  auto hz = GENERATE(100.0, 10.0, 1.0, 0.2);
+  std::mt19937 rng(Catch::rngSeed());
+  std::normal_distribution<double> jitter(0, 0.05 / hz);
+  std::vector<double> ts;
+  for (double t = 0.3; t < 300; t += 1.0 / hz) {
+    ts.push_back(std::max(0.0, t + jitter(rng)));
+  }
+  std::sort(ts.begin(), ts.end());
+
+  // count / duration over the exact minute before each event
+  FrequencyEstimator estimator;
+  for (size_t i = 0; i < ts.size(); ++i) {
+    estimator.add(ts[i]);
+    auto first = std::lower_bound(ts.begin(), ts.begin() + i + 1, ts[i] - 59);
+    const int count = ts.begin() + i + 1 - first;
+    if (count > 1) {
+      const double expected = count / (ts[i] - *first);
+      REQUIRE(estimator.freq(ts[i]) == Approx(expected).epsilon(0.025));
+    }
+  }
+
+  // times before the start share the first bucket
+  FrequencyEstimator early;
+  early.add(-0.5);
+  early.add(0.5);
+  REQUIRE(early.freq(0.5) == Approx(2.0));
+}
+
+class TestStream : public DummyStream {
+public:
+  TestStream(QObject *parent) : DummyStream(parent) {}
+  using AbstractStream::mergeEvents;
+
+  void playTo(double sec) {
+    forEachEvent([&](const CanEvent &e) {
+      if (toSeconds(e.mono_time) <= sec) {
+        updateEvent({.source = e.src, .address = e.address}, toSeconds(e.mono_time), e.dat, e.size);
+      }
+    });
+    emit privateUpdateLastMsgsSignal();
+    QCoreApplication::processEvents();
+  }
+};
+
+TEST_CASE("AbstractStream seek checkpoints") {
+  std::mt19937 rng(Catch::rngSeed());
+  MessageEventsMap events;
+  for (auto [address, hz] : {std::pair{0x100u, 100}, std::pair{0x200u, 10}}) {
+    MessageId id = {.source = 0, .address = address};
+    auto &store = events.try_emplace(id, id).first->second;
+    uint8_t dat[8] = {};
+    for (int i = 0; i < 30 * hz; ++i) {
+      dat[rng() % 8] ^= 1 << (rng() % 8);
+      store.append(i * (uint64_t)1e9 / hz + address, dat, sizeof(dat));
+    }
+  }
+
+  QObject parent;
+  const double target = 17.3;
+  // played straight to the target
+  TestStream expected(&parent);
+  expected.mergeEvents(events);
+  expected.playTo(target);
+  // played to the end, then seeked back to a checkpoint
+  TestStream seeked(&parent);
+  seeked.mergeEvents(events);
+  seeked.playTo(30);
+  emit seeked.seekedTo(target);
+  // seeked without checkpoints, rebuilt from the last events
+  TestStream rebuilt(&parent);
+  rebuilt.mergeEvents(events);
+  emit rebuilt.seekedTo(target);
+
+  for (const auto &[id, _] : events) {
+    const auto &a = expected.lastMessage(id);
+    for (const auto *stream : {&seeked, &rebuilt}) {
+      const auto &b = stream->lastMessage(id);
+      REQUIRE(b.count == a.count);
+      REQUIRE(b.dat == a.dat);
+      REQUIRE(b.last_changes.size() == a.last_changes.size());
+      // both seeks start counting bit changes over
+      for (const auto &change : b.last_changes) {
+        REQUIRE(change.bit_change_counts == std::array<uint32_t, 8>{});
+      }
+    }
+  }
+}
+
+TEST_CASE("HistoryLogModel") {
+  MessageId id = {.source = 0, .address = 0x100};
+  MessageEventsMap events;
+  auto &store = events.try_emplace(id, id).first->second;
+  for (int i = 0; i < 3000; ++i) {
+    const uint8_t dat[8] = {(uint8_t)(i * 7)};
+    store.append(i * (uint64_t)1e7, dat, sizeof(dat));
+  }
+  REQUIRE(dbc()->open(SOURCE_ALL, "", R"(BO_ 256 message_1: 8 XXX
+  SG_ sig_a : 0|8@1+ (1,0) [0|255] "" XXX
+)"));
+
+  QObject parent;
+  TestStream stream(&parent);
+  auto prev_can = std::exchange(can, &stream);
+  stream.mergeEvents(events);
+  stream.playTo(30);
+
+  HistoryLogModel model(&parent);
+  model.setMessage(id);
+  REQUIRE(model.rowCount() == store.size());
+  // newest first
+  REQUIRE(model.index(0, 1).data().toInt() == (uint8_t)(2999 * 7));
+  REQUIRE(model.index(store.size() - 1, 1).data().toInt() == 0);
+
+  model.setFilter(0, "250", std::greater<double>{});
+  for (int i = 0; i < 100 && model.rowCount() == 0; ++i) {
+    QThread::msleep(10);
+    QCoreApplication::processEvents();
+  }
+  int expected = 0;
+  for (int i = 0; i < store.size(); ++i) expected += (uint8_t)(i * 7) > 250;
+  REQUIRE(model.rowCount() == expected);
+  for (int row = 0; row < model.rowCount(); ++row) {
+    REQUIRE(model.index(row, 1).data().toInt() > 250);
+  }
+
+  dbc()->closeAll();
+  can = prev_can;
+}
+
+TEST_CASE("BusStatistics") {
+  BusStatistics stats;
+  REQUIRE(stats.frameBits({.source = 0, .address = 0x100}, 8) == 111);
+  REQUIRE(stats.frameBits({.source = 0, .address = 0x18daf110}, 8) == 131);
+  REQUIRE(stats.frameBits({.source = 0, .address = 0x100}, 64) == 29 + (64 * 8 + 30) / 4.0);
+
+  // 128 Hz for 8 seconds: a constant byte, a counter over all values and a toggling bit
+  MessageId id = {.source = 1, .address = 0x100};
+  const int count = 1024;
+  for (int half = 0; half < 2; ++half) {
+    MessageEventsMap events;
+    auto &store = events.try_emplace(id, id).first->second;
+    for (int i = half * count / 2; i < (half + 1) * count / 2; ++i) {
+      const uint8_t dat[8] = {0x55, (uint8_t)i, (uint8_t)(i & 1)};
+      store.append(100 * (uint64_t)1e9 + i * (uint64_t)1e9 / 128, dat, sizeof(dat));
+    }
+    stats.add(events);
+  }
+  for (int i = 0; i < 100 && stats.snapshot().events < count; ++i) {
+    QThread::msleep(10);
+  }
+  const auto &snapshot = stats.snapshot();
+  REQUIRE(snapshot.events == count);
+
+  const auto &m = snapshot.messages.at(id);
+  REQUIRE(m.count == count);
+  REQUIRE(m.entropy[0] == 0);
+  REQUIRE(m.entropy[1] == Approx(8));
+  REQUIRE(m.entropy[2] == Approx(1));
+  REQUIRE(m.entropy[3] == 0);
+  // flips are counted across the two batches too
+  REQUIRE(m.bit_flips[0] == std::array<uint32_t, 8>{});
+  REQUIRE(m.bit_flips[1][7] == count - 1);
+  REQUIRE(m.bit_flips[1][0] == count / 128 - 1);
+  REQUIRE(m.bit_flips[2] == std::array<uint32_t, 8>{0, 0, 0, 0, 0, 0, 0, count - 1});
+
+  const auto &bus = snapshot.buses.at(1);
+  const double load = 128 * 111 * 100.0 / 500000;
+  REQUIRE(bus.frames == count);
+  REQUIRE(bus.bits == count * 111);
+  REQUIRE(bus.bits_per_sec == 128 * 111);
+  REQUIRE(bus.load == Approx(load));
+  REQUIRE(bus.peak_load == Approx(load));
+  REQUIRE(bus.last_load == Approx(load));
+}
+
+TEST_CASE("ThumbnailCache") {
+  QTemporaryDir dir;
+  const std::string file = dir.path().toStdString() + "/route/thumbnails";
+  auto thumbnails = [](uint64_t begin, int count) {
+    std::vector<ThumbnailCache::Thumbnail> result;
+    for (int i = 0; i < count; ++i) {
+      result.push_back({begin + i * 100, QByteArray(10 + i, 'a' + i)});
+    }
+    return result;
+  };
+  auto wait = [](ThumbnailCache &cache, size_t size) {
+    for (int i = 0; i < 100 && cache.size() < size; ++i) {
+      QThread::msleep(10);
+      QCoreApplication::processEvents();
+    }
+    return cache.size() == size;
+  };
+
+  {
+    ThumbnailCache cache(file, 90);
+    cache.add(1000, 1300, thumbnails(1000, 3));
+    cache.add(2000, 2100, thumbnails(2000, 2));
+    REQUIRE(wait(cache, 5));
+    // a block that is already in the file is skipped
+    cache.add(1000, 1300, thumbnails(1000, 4));
+    REQUIRE_FALSE(wait(cache, 6));
+
+    REQUIRE(cache.jpeg(1000) == QByteArray(10, 'a'));
+    REQUIRE(cache.jpeg(1101) == QByteArray(12, 'c'));
+    REQUIRE(cache.jpeg(2100) == QByteArray(11, 'b'));
+    REQUIRE(cache.jpeg(2101).isEmpty());
+  }
+
+  // a block left partially written is dropped when the file is opened again
+  const std::string content = util::read_file(file);
+  REQUIRE(util::write_file(file.c_str(), content.data(), content.size() / 2, O_WRONLY | O_APPEND) == 0);
+  {
+    ThumbnailCache cache(file, 90);
+    REQUIRE(cache.size() == 5);
+    REQUIRE(cache.jpeg(2000) == QByteArray(10, 'a'));
+    cache.add(2000, 2100, thumbnails(2000, 2));
+    cache.add(3000, 3000, thumbnails(3000, 1));
+    REQUIRE(wait(cache, 6));
+    REQUIRE(cache.jpeg(3000) == QByteArray(10, 'a'));
+  }
+  REQUIRE(util::read_file(file).size() > content.size());
+}
+
+TEST_CASE("SocketCanStream vcan") {
+  // needs a virtual CAN interface: ip link add dev vcan0 type vcan && ip link set up vcan0
+  const char *device = "vcan0";
+  const unsigned int ifindex = if_nametoindex(device);
+  if (ifindex == 0) {
+    WARN("skipped, no vcan0 interface");
+    return;
+  }
+  int tx = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+  sockaddr_can addr = {.can_family = AF_CAN, .can_ifindex = (int)ifindex};
+  REQUIRE(bind(tx, (sockaddr *)&addr, sizeof(addr)) == 0);
+
+  settings.log_livestream = false;
+  QObject parent;
+  SocketCanStream stream(&parent, {.device = device});
+  stream.start();
+
+  // the frames not read yet must fit in the receive buffer, which takes up to a few
+  // hundred bytes per frame. it is small if cabana can't raise net.core.rmem_max
+  const uint32_t max_unread = std::clamp(stream.receiveBufferSize() / 2048, 16, 1000);
+  INFO("receive buffer " << stream.receiveBufferSize() << " bytes, up to " << max_unread << " unread frames");
+
+  const uint32_t num_frames = 100000;
+  const int num_ids = 16;
+  const uint64_t send_start = nanos_since_boot();
+  for (uint32_t i = 0; i < num_frames; ++i) {
+    can_frame f = {.can_id = 0x100 + i % num_ids, .can_dlc = 8};
+    memcpy(f.data, &i, sizeof(i));
+    while (write(tx, &f, sizeof(f)) != sizeof(f)) {
+      REQUIRE(errno == ENOBUFS);
+      std::this_thread::yield();
+    }
+    while (i + 1 >= stream.receivedFrames() + max_unread && nanos_since_boot() - send_start < 30e9) {
+      std::this_thread::yield();
+    }
+  }
+  const uint64_t send_end = nanos_since_boot();
+  close(tx);
+
+  for (int i = 0; i < 500 && stream.mergedFrames() < num_frames; ++i) {
+    QThread::msleep(10);
+    QCoreApplication::processEvents();
+  }
+  printf("SocketCAN: %lu frames at %.0f frames/s, %.3f syscalls per frame\n", stream.receivedFrames(),
+         num_frames / ((send_end - send_start) / 1e9), stream.recvCalls() / (double)stream.receivedFrames());
+  REQUIRE(stream.receivedFrames() == num_frames);
+  REQUIRE(stream.mergedFrames() == num_frames);
+  if (stream.recvCalls() >= stream.receivedFrames()) {
+    WARN("recvmmsg returned one frame per call");
+  }
+
+  // kernel timestamps from the send window, in order. frames are stamped when vcan
+  // delivers them, which can trail the write
+  const uint64_t max_delivery_delay = 100e6;
+  for (int id = 0; id < num_ids; ++id) {
+    const auto events = stream.events({.source = 0, .address = 0x100u + id});
+    REQUIRE(events.size() == num_frames / num_ids);
+    uint64_t prev_time = send_start;
+    for (uint32_t i = 0; i < events.size(); ++i) {
+      const CanEvent e = events[i];
+      REQUIRE(e.mono_time >= prev_time);
+      REQUIRE(e.mono_time <= send_end + max_delivery_delay);
+      REQUIRE(e.size == 8);
+      REQUIRE(*(uint32_t *)e.dat == i * num_ids + id);
+      prev_time = e.mono_time;
+    }
+  }
+}
@@ -1,15 +1,223 @@
 #include "tools/cabana/tools/findsignal.h"
 
+#include <array>
+
 #include <QFormLayout>
 #include <QHBoxLayout>
 #include <QHeaderView>
 #include <QMenu>
 #include <QtConcurrent>
-#include <QTimer>
 #include <QVBoxLayout>
 
+// FindSignalFilter
+
+bool FindSignalFilter::operator()(double v) const {
+  switch (compare) {
+    case Equal: return v == v1;
+    case Greater: return v > v1;
+    case GreaterEqual: return v >= v1;
+    case NotEqual: return v != v1;
+    case Less: return v < v1;
+    case LessEqual: return v <= v1;
+    case Between: return v >= v1 && v <= v2;
+  }
+  return false;
+}
+
+FindSignalFilter::RawRange FindSignalFilter::rawRange(const cabana::Signal &sig) const {
+  // get_raw_value() returns 64-bit values as int64_t
+  const bool is_signed = sig.is_signed || sig.size >= 64;
+  const int64_t min = !is_signed ? 0 : sig.size >= 64 ? std::numeric_limits<int64_t>::min() : -(1LL << (sig.size - 1));
+  const int64_t max = sig.size >= 64 ? std::numeric_limits<int64_t>::max() : (int64_t)((1ULL << (sig.size - is_signed)) - 1);
+
+  // Without !=, the filter passes a range of values. raw * factor + offset is monotonic in raw,
+  // so the raw values passing it are a range too, found by binary search on the exact expression.
+  const Compare cmp = compare == NotEqual ? Equal : compare;
+  auto value = [&](int64_t raw) { return raw * sig.factor + sig.offset; };
+  auto above_low = [&](int64_t raw) {
+    double v = value(raw);
+    return cmp == Greater ? v > v1 : cmp == Less || cmp == LessEqual ? true : v >= v1;
+  };
+  auto below_high = [&](int64_t raw) {
+    double v = value(raw);
+    return cmp == Less ? v < v1 : cmp == Greater || cmp == GreaterEqual ? true : v <= (cmp == Between ? v2 : v1);
+  };
+  // first raw in [min, max] for which pred, which goes from false to true, holds. max + 1 if none.
+  auto first_true = [&](auto pred, bool *found) {
+    int64_t lo = min, hi = max;
+    *found = pred(max);
+    while (lo < hi) {
+      int64_t mid = lo + (int64_t)(((uint64_t)hi - (uint64_t)lo) / 2);
+      if (pred(mid)) hi = mid;
+      else lo = mid + 1;
+    }
+    return lo;
+  };
+  // last raw for which pred, which goes from true to false, holds.
+  auto last_true = [&](auto pred, bool *found) {
+    bool any_false = false;
+    int64_t first_false = first_true([&](int64_t raw) { return !pred(raw); }, &any_false);
+    *found = pred(min);
+    return !*found ? min : any_false ? first_false - 1 : max;
+  };
+
+  const bool increasing = !(sig.factor < 0);
+  bool has_lo = false, has_hi = false;
+  int64_t lo = increasing ? first_true(above_low, &has_lo) : first_true(below_high, &has_lo);
+  int64_t hi = increasing ? last_true(below_high, &has_hi) : last_true(above_low, &has_hi);
+  if (!has_lo || !has_hi || lo > hi) {
+    // no raw value passes, or with != all of them do
+    return {.lo = min, .hi = max, .invert = compare != NotEqual};
+  }
+  return {.lo = lo, .hi = hi, .invert = compare == NotEqual};
+}
+
+// SignalBitPlanes
+
+// Transposes an 8x8 bit matrix: bit c of byte r moves to bit r of byte c.
+static inline uint64_t transpose8x8(uint64_t x) {
+  uint64_t t = (x ^ (x >> 7)) & 0x00aa00aa00aa00aaULL;
+  x ^= t ^ (t << 7);
+  t = (x ^ (x >> 14)) & 0x0000cccc0000ccccULL;
+  x ^= t ^ (t << 14);
+  t = (x ^ (x >> 28)) & 0x00000000f0f0f0f0ULL;
+  x ^= t ^ (t << 28);
+  return x;
+}
+
+SignalBitPlanes::SignalBitPlanes(const CanEventsView &events) : count(events.size()) {
+  if (events.empty()) return;
+
+  num_bytes = events.stride();
+  num_bits = num_bytes * 8;
+  const size_t num_words = (count + 63) / 64;
+
+  // 8 events at a time, one 8x8 bit transpose per byte
+  planes.assign(num_words * num_bits, 0);
+  const uint8_t *rows[8];
+  size_t first = 0, n = 0;
+  auto transpose_rows = [&]() {
+    uint64_t *word = &planes[(first / 64) * num_bits];
+    const int shift = first % 64;
+    for (size_t byte = 0; byte < num_bytes; ++byte) {
+      uint64_t x = 0;
+      for (size_t r = 0; r < n; ++r) {
+        x |= (uint64_t)rows[r][byte] << (8 * r);
+      }
+      if (x == 0) continue;
+      x = transpose8x8(x);
+      for (int b = 0; b < 8; ++b) {
+        word[byte * 8 + b] |= ((x >> (8 * b)) & 0xff) << shift;
+      }
+    }
+    first += n;
+    n = 0;
+  };
+  bool short_frames = false;
+  events.forEachSpan([&](const CanEventsView::Span &s) {
+    for (size_t j = 0; j < s.count; ++j) {
+      rows[n++] = s.data + j * num_bytes;
+      if (n == 8) transpose_rows();
+    }
+    short_frames |= std::any_of(s.sizes, s.sizes + s.count, [this](uint8_t size) { return size < num_bytes; });
+  });
+  if (n > 0) transpose_rows();
+
+  if (short_frames) {
+    has_byte.assign(num_words * num_bytes, 0);
+    size_t i = 0;
+    events.forEachSpan([&](const CanEventsView::Span &s) {
+      for (size_t j = 0; j < s.count; ++j, ++i) {
+        for (size_t byte = 0; byte < s.sizes[j]; ++byte) {
+          has_byte[(i / 64) * num_bytes + byte] |= 1ULL << (i % 64);
+        }
+      }
+    });
+  }
+}
+
+size_t SignalBitPlanes::find(const cabana::Signal &sig, const FindSignalFilter::RawRange &range, size_t first, size_t last) const {
+  last = std::min(last, count);
+  if (first >= last || sig.size <= 0 || sig.size > 64) return last;
+
+  // plane of each bit of the raw value, following get_raw_value(). Bits past the
+  // last byte of the frame read as zero.
+  const size_t zero_plane = num_bits;
+  std::array<size_t, 64> bit_planes;
+  bit_planes.fill(zero_plane);
+  const int msb_byte = sig.msb / 8;
+  int i = msb_byte;
+  int bits = sig.size;
+  while (i >= 0 && i < (int)num_bytes && bits > 0) {
+    int lsb = (int)(sig.lsb / 8) == i ? sig.lsb : i * 8;
+    int msb = (int)(sig.msb / 8) == i ? sig.msb : (i + 1) * 8 - 1;
+    int size = msb - lsb + 1;
+    for (int b = 0; b < size; ++b) {
+      bit_planes[bits - size + b] = lsb + b;
+    }
+    bits -= size;
+    i = sig.is_little_endian ? i - 1 : i + 1;
+  }
+
+  // Compare raw values as unsigned by flipping the sign bit of signed values.
+  const bool is_signed = sig.is_signed || sig.size >= 64;
+  const uint64_t mask = sig.size >= 64 ? ~0ULL : (1ULL << sig.size) - 1;
+  const uint64_t bias = is_signed ? 1ULL << (sig.size - 1) : 0;
+  const uint64_t lo = ((uint64_t)range.lo ^ bias) & mask;
+  const uint64_t hi = ((uint64_t)range.hi ^ bias) & mask;
+
+  const size_t first_word = first / 64;
+  const size_t last_word = (last - 1) / 64;
+  for (size_t w = first_word; w <= last_word; ++w) {
+    const uint64_t *word = &planes[w * num_bits];
+    // frames too short for the first byte of the signal decode to zero
+    const uint64_t valid = has_byte.empty() || msb_byte >= (int)num_bytes ? ~0ULL : has_byte[w * num_bytes + msb_byte];
+
+    // bit-serial comparison with lo and hi, most significant bit first
+    uint64_t eq_lo = ~0ULL, gt_lo = 0, eq_hi = ~0ULL, lt_hi = 0;
+    for (int b = sig.size - 1; b >= 0; --b) {
+      uint64_t x = bit_planes[b] != zero_plane ? word[bit_planes[b]] & valid : 0;
+      if (is_signed && b == sig.size - 1) x = ~x;
+      if ((lo >> b) & 1) {
+        eq_lo &= x;
+      } else {
+        gt_lo |= eq_lo & x;
+        eq_lo &= ~x;
+      }
+      if ((hi >> b) & 1) {
+        lt_hi |= eq_hi & ~x;
+        eq_hi &= x;
+      } else {
+        eq_hi &= ~x;
+      }
+    }
+
+    uint64_t match = (gt_lo | eq_lo) & (lt_hi | eq_hi);
+    if (range.invert) match = ~match;
+    if (w == first_word) match &= ~0ULL << (first % 64);
+    if (w == last_word && last % 64) match &= (1ULL << (last % 64)) - 1;
+    if (match) {
+      return w * 64 + __builtin_ctzll(match);
+    }
+  }
+  return last;
+}
+
 // FindSignalModel
 
+FindSignalModel::FindSignalModel(QObject *parent) : QAbstractTableModel(parent) {
+  QObject::connect(&search_watcher, &QFutureWatcher<void>::finished, [this]() {
+    search_groups.clear();
+    histories.push_back(filtered_signals);
+    emit searchFinished();
+  });
+}
+
+FindSignalModel::~FindSignalModel() {
+  search_watcher.cancel();
+  search_watcher.waitForFinished();
+}
+
 QVariant FindSignalModel::headerData(int section, Qt::Orientation orientation, int role) const {
   static QString titles[] = {"Id", "Start Bit, size", "(time, value)"};
   if (role != Qt::DisplayRole) return {};
@@ -28,32 +236,74 @@ QVariant FindSignalModel::data(const QModelIndex &index, int role) const {
   return {};
 }
 
-void FindSignalModel::search(std::function<bool(double)> cmp) {
+void FindSignalModel::search(const FindSignalFilter &filter) {
   beginResetModel();
-
-  std::mutex lock;
-  const auto prev_sigs = !histories.isEmpty() ? histories.back() : initial_signals;
   filtered_signals.clear();
-  filtered_signals.reserve(prev_sigs.size());
-  QtConcurrent::blockingMap(prev_sigs, [&](auto &s) {
-    const auto &events = can->events(s.id);
-    auto first = std::upper_bound(events.cbegin(), events.cend(), s.mono_time, CompareCanEvent());
-    auto last = events.cend();
+  endResetModel();
+
+  // one task per message, so its payloads are transposed once for all candidates
+  QHash<MessageId, int> group_index;
+  for (const auto &s : !histories.isEmpty() ? histories.back() : initial_signals) {
+    auto it = group_index.find(s.id);
+    if (it == group_index.end()) {
+      it = group_index.insert(s.id, search_groups.size());
+      search_groups.push_back({});
+    }
+    search_groups[*it].candidates.push_back(s);
+  }
+
+  // the workers search copies of the events, the stores may be merged into while they run
+  for (auto &group : search_groups) {
+    const auto &candidates = group.candidates;
+    const auto events = can->events(candidates.front().id);
+    auto last = events.end();
     if (last_time < std::numeric_limits<uint64_t>::max()) {
-      last = std::upper_bound(events.cbegin(), events.cend(), last_time, CompareCanEvent());
+      last = events.upperBound(last_time);
+    }
+    auto min_time = std::min_element(candidates.begin(), candidates.end(), [](auto &l, auto &r) { return l.mono_time < r.mono_time; })->mono_time;
+    const CanEventsView range(CanEventsView(events.begin(), last).upperBound(min_time), last);
+    group.events = std::make_shared<CanEventStore>(candidates.front().id);
+    if (!range.empty()) {
+      range.forEachSpan([&](const CanEventsView::Span &s) { group.events->append(s.mono_times, s.sizes, s.data, range.stride(), s.count); });
+    }
+  }
+
+  // matches are appended to the model as each message finishes
+  search_watcher.setFuture(QtConcurrent::map(search_groups, [this, filter, begin_time = can->beginMonoTime()](const SearchGroup &group) {
+    auto matches = searchMessage(group, filter, begin_time);
+    if (!matches.isEmpty()) {
+      QMetaObject::invokeMethod(this, [this, matches]() { appendSignals(matches); }, Qt::QueuedConnection);
     }
+  }));
+}
 
-    auto it = std::find_if(first, last, [&](const CanEvent *e) { return cmp(get_raw_value(e->dat, e->size, s.sig)); });
-    if (it != last) {
+QList<FindSignalModel::SearchSignal> FindSignalModel::searchMessage(const SearchGroup &group, const FindSignalFilter &filter, uint64_t begin_time) {
+  if (group.events->empty()) return {};
+
+  QList<SearchSignal> matches;
+  const CanEventsView range(*group.events);
+  const auto first = range.begin();
+  SignalBitPlanes planes(range);
+  for (const auto &s : group.candidates) {
+    size_t from = range.upperBound(s.mono_time) - first;
+    size_t i = planes.find(s.sig, filter.rawRange(s.sig), from, planes.size());
+    if (i < planes.size()) {
+      const CanEvent e = first[i];
+      const double sec = std::max(0.0, (e.mono_time - begin_time) / 1e9);
       auto values = s.values;
-      values += QString("(%1, %2)").arg(can->toSeconds((*it)->mono_time), 0, 'f', 3).arg(get_raw_value((*it)->dat, (*it)->size, s.sig));
-      std::lock_guard lk(lock);
-      filtered_signals.push_back({.id = s.id, .mono_time = (*it)->mono_time, .sig = s.sig, .values = values});
+      values += QString("(%1, %2)").arg(sec, 0, 'f', 3).arg(get_raw_value(e.dat, e.size, s.sig));
+      matches.push_back({.id = s.id, .mono_time = e.mono_time, .sig = s.sig, .values = values});
     }
-  });
-  histories.push_back(filtered_signals);
+  }
+  return matches;
+}
 
-  endResetModel();
+void FindSignalModel::appendSignals(const QList<SearchSignal> &sigs) {
+  const int rows = rowCount();
+  const int new_rows = std::min(filtered_signals.size() + sigs.size(), 300);
+  if (new_rows > rows) beginInsertRows({}, rows, new_rows - 1);
+  filtered_signals.append(sigs);
+  if (new_rows > rows) endInsertRows();
 }
 
 void FindSignalModel::undo() {
@@ -160,6 +410,10 @@ FindSignalDlg::FindSignalDlg(QWidget *parent) : QDialog(parent, Qt::WindowFlags(
   QObject::connect(search_btn, &QPushButton::clicked, this, &FindSignalDlg::search);
   QObject::connect(undo_btn, &QPushButton::clicked, model, &FindSignalModel::undo);
   QObject::connect(model, &QAbstractItemModel::modelReset, this, &FindSignalDlg::modelReset);
+  QObject::connect(model, &FindSignalModel::searchFinished, this, &FindSignalDlg::modelReset);
+  QObject::connect(model, &QAbstractItemModel::rowsInserted, [this]() {
+    stats_label->setText(tr("%1 matches found so far...").arg(model->filtered_signals.size()));
+  });
   QObject::connect(reset_btn, &QPushButton::clicked, model, &FindSignalModel::reset);
   QObject::connect(view, &QTableView::customContextMenuRequested, this, &FindSignalDlg::customMenuRequested);
   QObject::connect(view, &QTableView::doubleClicked, [this](const QModelIndex &index) {
@@ -175,24 +429,19 @@ void FindSignalDlg::search() {
   if (model->histories.isEmpty()) {
     setInitialSignals();
   }
-  auto v1 = value1->text().toDouble();
-  auto v2 = value2->text().toDouble();
-  std::function<bool(double)> cmp = nullptr;
-  switch (compare_cb->currentIndex()) {
-    case 0: cmp = [v1](double v) { return v == v1;}; break;
-    case 1: cmp = [v1](double v) { return v > v1;}; break;
-    case 2: cmp = [v1](double v) { return v >= v1;}; break;
-    case 3: cmp = [v1](double v) { return v != v1;}; break;
-    case 4: cmp = [v1](double v) { return v < v1;}; break;
-    case 5: cmp = [v1](double v) { return v <= v1;}; break;
-    case 6: cmp = [v1, v2](double v) { return v >= v1 && v <= v2;}; break;
-  }
+  FindSignalFilter filter = {
+    .compare = (FindSignalFilter::Compare)compare_cb->currentIndex(),
+    .v1 = value1->text().toDouble(),
+    .v2 = value2->text().toDouble(),
+  };
+  model->search(filter);
   properties_group->setEnabled(false);
   message_group->setEnabled(false);
   search_btn->setEnabled(false);
-  stats_label->setVisible(false);
+  undo_btn->setEnabled(false);
+  reset_btn->setEnabled(false);
+  stats_label->setText(tr("Finding ...."));
   search_btn->setText("Finding ....");
-  QTimer::singleShot(0, this, [=]() { model->search(cmp); });
 }
 
 void FindSignalDlg::setInitialSignals() {
@@ -226,9 +475,9 @@ void FindSignalDlg::setInitialSignals() {
 
   for (const auto &[id, m] : can->lastMessages()) {
     if (buses.isEmpty() || buses.contains(id.source) && (addresses.isEmpty() || addresses.contains(id.address))) {
-      const auto &events = can->events(id);
-      auto e = std::lower_bound(events.cbegin(), events.cend(), first_time, CompareCanEvent());
-      if (e != events.cend()) {
+      const auto events = can->events(id);
+      auto e = events.lowerBound(first_time);
+      if (e != events.end()) {
         const int total_size = m.dat.size() * 8;
         for (int size = min_size->value(); size <= max_size->value(); ++size) {
           for (int start = 0; start <= total_size - size; ++start) {
@@ -236,7 +485,7 @@ void FindSignalDlg::setInitialSignals() {
             s.sig.start_bit = start;
             s.sig.size = size;
             updateMsbLsb(s.sig);
-            s.value = get_raw_value((*e)->dat, (*e)->size, s.sig);
+            s.value = get_raw_value(e->dat, e->size, s.sig);
             model->initial_signals.push_back(s);
           }
         }
@@ -246,6 +495,8 @@ void FindSignalDlg::setInitialSignals() {
 }
 
 void FindSignalDlg::modelReset() {
+  if (model->isSearching()) return;
+
   properties_group->setEnabled(model->histories.isEmpty());
   message_group->setEnabled(model->histories.isEmpty());
   search_btn->setText(model->histories.isEmpty() ? tr("Find") : tr("Find Next"));
@@ -2,9 +2,12 @@
 
 #include <algorithm>
 #include <limits>
+#include <memory>
+#include <vector>
 
 #include <QAbstractTableModel>
 #include <QCheckBox>
+#include <QFutureWatcher>
 #include <QLabel>
 #include <QPushButton>
 #include <QTableView>
@@ -12,7 +15,49 @@
 #include "tools/cabana/commands.h"
 #include "tools/cabana/settings.h"
 
+struct FindSignalFilter {
+  // in the order of the compare combo box
+  enum Compare { Equal, Greater, GreaterEqual, NotEqual, Less, LessEqual, Between };
+  // Raw values passing the filter: lo <= raw <= hi, or outside that range when invert is set.
+  struct RawRange {
+    int64_t lo;
+    int64_t hi;
+    bool invert;
+  };
+
+  bool operator()(double v) const;
+  RawRange rawRange(const cabana::Signal &sig) const;
+
+  Compare compare = Equal;
+  double v1 = 0;
+  double v2 = 0;
+};
+
+// The payloads of a range of events transposed into bit planes: word w of plane b holds
+// bit b of events [64w, 64w + 64), so a candidate signal is compared with 64 events at a
+// time using a few word operations per signal bit.
+class SignalBitPlanes {
+public:
+  SignalBitPlanes(const CanEventsView &events);
+  size_t size() const { return count; }
+  // bit b of events [64w, 64w + 64)
+  uint64_t bits(size_t w, size_t b) const { return planes[w * num_bits + b]; }
+  // events of [64w, 64w + 64) whose frame includes byte
+  uint64_t hasByte(size_t w, size_t byte) const { return has_byte.empty() ? ~0ULL : has_byte[w * num_bytes + byte]; }
+  // Index of the first event in [first, last) whose raw value of sig is in range, or last if there is none.
+  size_t find(const cabana::Signal &sig, const FindSignalFilter::RawRange &range, size_t first, size_t last) const;
+
+private:
+  size_t count = 0;
+  size_t num_bytes = 0;
+  size_t num_bits = 0;
+  std::vector<uint64_t> planes;    // planes[word * num_bits + bit]
+  std::vector<uint64_t> has_byte;  // has_byte[word * num_bytes + byte], empty if all frames are num_bytes long
+};
+
 class FindSignalModel : public QAbstractTableModel {
+  Q_OBJECT
+
 public:
   struct SearchSignal {
     MessageId id = {};
@@ -22,12 +67,14 @@ public:
     QStringList values;
   };
 
-  FindSignalModel(QObject *parent) : QAbstractTableModel(parent) {}
+  FindSignalModel(QObject *parent);
+  ~FindSignalModel();
   QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
   QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
   int columnCount(const QModelIndex &parent = QModelIndex()) const override { return 3; }
   int rowCount(const QModelIndex &parent = QModelIndex()) const override { return std::min(filtered_signals.size(), 300); }
-  void search(std::function<bool(double)> cmp);
+  void search(const FindSignalFilter &filter);
+  bool isSearching() const { return search_watcher.isRunning(); }
   void reset();
   void undo();
 
@@ -35,6 +82,21 @@ public:
   QList<SearchSignal> initial_signals;
   QList<QList<SearchSignal>> histories;
   uint64_t last_time = std::numeric_limits<uint64_t>::max();
+
+signals:
+  void searchFinished();
+
+private:
+  // the candidates of one message and a copy of the events they are searched in
+  struct SearchGroup {
+    QList<SearchSignal> candidates;
+    std::shared_ptr<CanEventStore> events;
+  };
+  static QList<SearchSignal> searchMessage(const SearchGroup &group, const FindSignalFilter &filter, uint64_t begin_time);
+  void appendSignals(const QList<SearchSignal> &sigs);
+
+  QList<SearchGroup> search_groups;
+  QFutureWatcher<void> search_watcher;
 };
 
 class FindSignalDlg : public QDialog {
@@ -9,9 +9,11 @@
 #include <QLabel>
 #include <QPushButton>
 #include <QRadioButton>
+#include <QtConcurrent>
 
 #include "tools/cabana/dbc/dbcmanager.h"
 #include "tools/cabana/streams/abstractstream.h"
+#include "tools/cabana/tools/findsignal.h"
 
 FindSimilarBitsDlg::FindSimilarBitsDlg(QWidget *parent) : QDialog(parent, Qt::WindowFlags() | Qt::Window) {
   setWindowTitle(tr("Find similar bits"));
@@ -85,6 +87,7 @@ FindSimilarBitsDlg::FindSimilarBitsDlg(QWidget *parent) : QDialog(parent, Qt::Wi
 
   setMinimumSize({700, 500});
   QObject::connect(search_btn, &QPushButton::clicked, this, &FindSimilarBitsDlg::find);
+  QObject::connect(&search_watcher, &QFutureWatcher<void>::finished, [this]() { search_btn->setEnabled(true); });
   QObject::connect(table, &QTableWidget::doubleClicked, [this](const QModelIndex &index) {
     if (index.isValid()) {
       MessageId msg_id = {.source = (uint8_t)find_bus_combo->currentData().toUInt(), .address = table->item(index.row(), 0)->text().toUInt(0, 16)};
@@ -93,17 +96,52 @@ FindSimilarBitsDlg::FindSimilarBitsDlg(QWidget *parent) : QDialog(parent, Qt::Wi
   });
 }
 
+FindSimilarBitsDlg::~FindSimilarBitsDlg() {
+  search_watcher.cancel();
+  search_watcher.waitForFinished();
+}
+
 void FindSimilarBitsDlg::find() {
   search_btn->setEnabled(false);
   table->clear();
-  uint32_t selected_address = msg_cb->currentData().toUInt();
-  auto msg_mismatched = calcBits(src_bus_combo->currentText().toUInt(), selected_address, byte_idx_sb->value(), bit_idx_sb->value(),
-                                 find_bus_combo->currentText().toUInt(), equal_combo->currentIndex() == 0, min_msgs->text().toInt());
-  table->setRowCount(msg_mismatched.size());
+  table->setRowCount(0);
   table->setColumnCount(6);
   table->setHorizontalHeaderLabels({"address", "byte idx", "bit idx", "mismatches", "total msgs", "% mismatched"});
-  for (int i = 0; i < msg_mismatched.size(); ++i) {
-    auto &m = msg_mismatched[i];
+  msg_mismatched.clear();
+
+  const int byte_idx = byte_idx_sb->value();
+  const int bit_idx = bit_idx_sb->value();
+  const MessageId target_id = {.source = (uint8_t)src_bus_combo->currentText().toUInt(), .address = msg_cb->currentData().toUInt()};
+  std::vector<TargetBit> target;
+  for (const CanEvent &e : can->events(target_id)) {
+    if (e.size > byte_idx) {
+      target.push_back({e.mono_time, ((e.dat[byte_idx] >> (7 - bit_idx)) & 1) != 0});
+    }
+  }
+
+  const uint8_t find_bus = find_bus_combo->currentText().toUInt();
+  search_events.clear();
+  for (const auto &[id, events] : can->eventsMap()) {
+    if (id.source == find_bus) search_events.push_back(std::make_shared<const CanEventStore>(events));
+  }
+
+  // each message is compared on a worker thread and its bits are ranked in as they arrive
+  const bool equal = equal_combo->currentIndex() == 0;
+  const int min_msgs_cnt = min_msgs->text().toInt();
+  search_watcher.setFuture(QtConcurrent::map(search_events, [=](const std::shared_ptr<const CanEventStore> &events) {
+    auto results = calcBits(*events, target, equal, min_msgs_cnt);
+    if (!results.isEmpty()) {
+      QMetaObject::invokeMethod(this, [this, results]() { addResults(results); }, Qt::QueuedConnection);
+    }
+  }));
+}
+
+void FindSimilarBitsDlg::addResults(const QList<mismatched_struct> &results) {
+  for (const auto &m : results) {
+    auto it = std::upper_bound(msg_mismatched.begin(), msg_mismatched.end(), m.perc, [](float perc, auto &r) { return perc < r.perc; });
+    const int i = it - msg_mismatched.begin();
+    msg_mismatched.insert(it, m);
+    table->insertRow(i);
     table->setItem(i, 0, new QTableWidgetItem(QString("%1").arg(m.address, 1, 16)));
     table->setItem(i, 1, new QTableWidgetItem(QString::number(m.byte_idx)));
     table->setItem(i, 2, new QTableWidgetItem(QString::number(m.bit_idx)));
@@ -111,50 +149,55 @@ void FindSimilarBitsDlg::find() {
     table->setItem(i, 4, new QTableWidgetItem(QString::number(m.total)));
     table->setItem(i, 5, new QTableWidgetItem(QString::number(m.perc, 'f', 2)));
   }
-  search_btn->setEnabled(true);
 }
 
-QList<FindSimilarBitsDlg::mismatched_struct> FindSimilarBitsDlg::calcBits(uint8_t bus, uint32_t selected_address, int byte_idx,
-                                                                          int bit_idx, uint8_t find_bus, bool equal, int min_msgs_cnt) {
-  QHash<uint32_t, QVector<uint32_t>> mismatches;
-  QHash<uint32_t, uint32_t> msg_count;
-  const auto &events = can->allEvents();
-  int bit_to_find = -1;
-  for (const CanEvent *e : events) {
-    if (e->src == bus) {
-      if (e->address == selected_address && e->size > byte_idx) {
-        bit_to_find = ((e->dat[byte_idx] >> (7 - bit_idx)) & 1) != 0;
-      }
-    }
-    if (e->src == find_bus) {
-      ++msg_count[e->address];
-      if (bit_to_find == -1) continue;
+QList<FindSimilarBitsDlg::mismatched_struct> FindSimilarBitsDlg::calcBits(const CanEventStore &events, const std::vector<TargetBit> &target,
+                                                                          bool equal, int min_msgs_cnt) {
+  const uint32_t cnt = events.size();
+  if (cnt <= (uint32_t)std::max(min_msgs_cnt, 0)) return {};
 
-      auto &mismatched = mismatches[e->address];
-      if (mismatched.size() < e->size * 8) {
-        mismatched.resize(e->size * 8);
-      }
-      for (int i = 0; i < e->size; ++i) {
-        for (int j = 0; j < 8; ++j) {
-          int bit = ((e->dat[i] >> (7 - j)) & 1) != 0;
-          mismatched[i * 8 + j] += equal ? (bit != bit_to_find) : (bit == bit_to_find);
-        }
-      }
+  QList<mismatched_struct> result;
+  auto mismatched = countMismatches(events, target, equal);
+  for (size_t i = 0; i < mismatched.size(); ++i) {
+    if (float perc = (mismatched[i] / (double)cnt) * 100; perc < 50) {
+      result.push_back({events.id.address, (uint32_t)i / 8, (uint32_t)i % 8, mismatched[i], cnt, perc});
     }
   }
+  return result;
+}
 
-  QList<mismatched_struct> result;
-  result.reserve(mismatches.size());
-  for (auto it = mismatches.begin(); it != mismatches.end(); ++it) {
-    if (auto cnt = msg_count[it.key()]; cnt > min_msgs_cnt) {
-      auto &mismatched = it.value();
-      for (int i = 0; i < mismatched.size(); ++i) {
-        if (float perc = (mismatched[i] / (double)cnt) * 100; perc < 50) {
-          result.push_back({it.key(), (uint32_t)i / 8, (uint32_t)i % 8, mismatched[i], cnt, perc});
-        }
+std::vector<uint32_t> FindSimilarBitsDlg::countMismatches(const CanEventsView &events, const std::vector<TargetBit> &target, bool equal) {
+  if (events.empty() || target.empty()) return {};
+
+  // Sample the target bit on the message's own timestamps, packed 64 events per word
+  // like the bit planes of the message.
+  const size_t num_words = (events.size() + 63) / 64;
+  std::vector<uint64_t> target_bits(num_words, 0), valid(num_words, 0);
+  size_t max_size = 0;
+  size_t i = 0, t = 0;
+  events.forEachSpan([&](const CanEventsView::Span &s) {
+    for (size_t j = 0; j < s.count; ++j, ++i) {
+      while (t < target.size() && target[t].mono_time <= s.mono_times[j]) ++t;
+      if (t > 0) {
+        valid[i / 64] |= 1ULL << (i % 64);
+        target_bits[i / 64] |= (uint64_t)target[t - 1].value << (i % 64);
+        max_size = std::max<size_t>(max_size, s.sizes[j]);
+      }
+    }
+  });
+  if (std::all_of(valid.begin(), valid.end(), [](uint64_t w) { return w == 0; })) return {};
+
+  // one XOR and popcount per bit for every 64 events
+  SignalBitPlanes planes(events);
+  std::vector<uint32_t> mismatches(max_size * 8, 0);
+  for (size_t w = 0; w < num_words; ++w) {
+    for (size_t byte = 0; byte < max_size; ++byte) {
+      const uint64_t mask = valid[w] & planes.hasByte(w, byte);
+      for (int j = 0; j < 8; ++j) {
+        const uint64_t diff = planes.bits(w, byte * 8 + 7 - j) ^ target_bits[w];
+        mismatches[byte * 8 + j] += __builtin_popcountll((equal ? diff : ~diff) & mask);
       }
     }
   }
-  std::sort(result.begin(), result.end(), [](auto &l, auto &r) { return l.perc < r.perc; });
-  return result;
+  return mismatches;
 }
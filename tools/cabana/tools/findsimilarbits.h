@@ -1,18 +1,33 @@
 #pragma once
 
+#include <memory>
+#include <vector>
+
 #include <QComboBox>
 #include <QDialog>
+#include <QFutureWatcher>
 #include <QLineEdit>
 #include <QSpinBox>
 #include <QTableWidget>
 
 #include "tools/cabana/dbc/dbcmanager.h"
+#include "tools/cabana/streams/caneventstore.h"
 
 class FindSimilarBitsDlg : public QDialog {
   Q_OBJECT
 
 public:
   FindSimilarBitsDlg(QWidget *parent);
+  ~FindSimilarBitsDlg();
+
+  struct TargetBit {
+    uint64_t mono_time;
+    bool value;
+  };
+  // Number of events in which each bit (byte_idx * 8 + bit_idx) of the message differs from
+  // (equal) or matches (!equal) the value the target bit holds at the event's time. Empty if
+  // no event comes after the first target sample.
+  static std::vector<uint32_t> countMismatches(const CanEventsView &events, const std::vector<TargetBit> &target, bool equal);
 
 signals:
   void openMessage(const MessageId &msg_id);
@@ -22,8 +37,8 @@ private:
     uint32_t address, byte_idx, bit_idx, mismatches, total;
     float perc;
   };
-  QList<mismatched_struct> calcBits(uint8_t bus, uint32_t selected_address, int byte_idx, int bit_idx, uint8_t find_bus,
-                                    bool equal, int min_msgs_cnt);
+  static QList<mismatched_struct> calcBits(const CanEventStore &events, const std::vector<TargetBit> &target, bool equal, int min_msgs_cnt);
+  void addResults(const QList<mismatched_struct> &results);
   void find();
 
   QTableWidget *table;
@@ -31,4 +46,8 @@ private:
   QSpinBox *byte_idx_sb, *bit_idx_sb;
   QPushButton *search_btn;
   QLineEdit *min_msgs;
+  QList<mismatched_struct> msg_mismatched;
+  // copies of the searched messages' events, the stream's stores may change while the workers run
+  std::vector<std::shared_ptr<const CanEventStore>> search_events;
+  QFutureWatcher<void> search_watcher;
 };
@@ -1,5 +1,8 @@
 #include "tools/cabana/utils/export.h"
 
+#include <cmath>
+#include <vector>
+
 #include <QFile>
 #include <QTextStream>
 
@@ -12,10 +15,15 @@ void exportToCSV(const QString &file_name, std::optional<MessageId> msg_id) {
   if (file.open(QIODevice::ReadWrite | QIODevice::Truncate)) {
     QTextStream stream(&file);
     stream << "time,addr,bus,data\n";
-    for (auto e : msg_id ? can->events(*msg_id) : can->allEvents()) {
-      stream << QString::number(can->toSeconds(e->mono_time), 'f', 3) << ","
-             << "0x" << QString::number(e->address, 16) << "," << e->src << ","
-             << "0x" << QByteArray::fromRawData((const char *)e->dat, e->size).toHex().toUpper() << "\n";
+    auto write_event = [&](const CanEvent &e) {
+      stream << QString::number(can->toSeconds(e.mono_time), 'f', 3) << ","
+             << "0x" << QString::number(e.address, 16) << "," << e.src << ","
+             << "0x" << QByteArray::fromRawData((const char *)e.dat, e.size).toHex().toUpper() << "\n";
+    };
+    if (msg_id) {
+      for (const CanEvent &e : can->events(*msg_id)) write_event(e);
+    } else {
+      can->forEachEvent(write_event);
     }
   }
 }
@@ -29,13 +37,19 @@ void exportSignalsToCSV(const QString &file_name, const MessageId &msg_id) {
       stream << "," << s->name;
     stream << "\n";
 
-    for (auto e : can->events(msg_id)) {
-      stream << QString::number(can->toSeconds(e->mono_time), 'f', 3) << ","
-             << "0x" << QString::number(e->address, 16) << "," << e->src;
-      for (auto s : msg->sigs) {
-        double value = 0;
-        s->getValue(e->dat, e->size, &value);
-        stream << "," << QString::number(value, 'f', s->precision);
+    const auto events = can->events(msg_id);
+    std::vector<std::vector<double>> values(msg->sigs.size(), std::vector<double>(events.size()));
+    for (int i = 0; i < msg->sigs.size(); ++i) {
+      events.getValues(msg->sigs[i], values[i].data());
+    }
+
+    for (size_t i = 0; i < events.size(); ++i) {
+      const CanEvent e = events[i];
+      stream << QString::number(can->toSeconds(e.mono_time), 'f', 3) << ","
+             << "0x" << QString::number(e.address, 16) << "," << e.src;
+      for (int j = 0; j < msg->sigs.size(); ++j) {
+        double value = std::isnan(values[j][i]) ? 0 : values[j][i];
+        stream << "," << QString::number(value, 'f', msg->sigs[j]->precision);
       }
       stream << "\n";
     }
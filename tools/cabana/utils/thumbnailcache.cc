@@ -0,0 +1,199 @@
+#include "tools/cabana/utils/thumbnailcache.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include <QBuffer>
+#include <QImage>
+#include <QtConcurrent>
+
+#include "common/util.h"
+#include "tools/cabana/streams/segmentcache.h"
+
+namespace {
+
+constexpr char MAGIC[4] = {'C', 'B', 'T', '1'};
+// keep at most this many KB of decoded pixmaps
+constexpr int MAX_PIXMAP_KB = 32 * 1024;
+
+// followed by count entries and their JPEG data
+struct BlockHeader {
+  char magic[4];
+  uint32_t count;
+  uint64_t begin;  // mono_time range of the qlog the thumbnails came from
+  uint64_t end;
+  uint64_t size;  // of the whole block
+};
+
+struct BlockEntry {
+  uint64_t mono_time;
+  uint64_t offset;  // from the start of the block
+  uint64_t size;
+};
+
+// Returns the size of the valid block at p, or 0.
+size_t validBlock(const char *p, size_t available, BlockHeader &h) {
+  if (available < sizeof(h)) return 0;
+  memcpy(&h, p, sizeof(h));
+  if (memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0 || h.size > available ||
+      h.count > (h.size - sizeof(h)) / sizeof(BlockEntry)) {
+    return 0;
+  }
+  for (uint32_t i = 0; i < h.count; ++i) {
+    BlockEntry e;
+    memcpy(&e, p + sizeof(h) + i * sizeof(e), sizeof(e));
+    if (e.offset > h.size || e.size > h.size - e.offset) return 0;
+  }
+  return h.size;
+}
+
+}  // namespace
+
+ThumbnailCache::ThumbnailCache(const std::string &file, int height, QObject *parent)
+    : QObject(parent), file_(file), height_(height), pixmaps_(MAX_PIXMAP_KB) {
+  pool_.setMaxThreadCount(1);
+  QObject::connect(this, &ThumbnailCache::appended, this, &ThumbnailCache::reload, Qt::QueuedConnection);
+
+  reload();
+  // drop a block left partially written by a previous run
+  struct stat st = {};
+  if (stat(file_.c_str(), &st) == 0 && (size_t)st.st_size > scanned_) {
+    truncate(file_.c_str(), scanned_);
+  }
+  for (const char *p = map_; p < map_ + scanned_;) {
+    BlockHeader h;
+    memcpy(&h, p, sizeof(h));
+    blocks_.insert(h.begin);
+    p += h.size;
+  }
+}
+
+ThumbnailCache::~ThumbnailCache() {
+  pool_.clear();
+  pool_.waitForDone();
+  if (map_) munmap((void *)map_, map_size_);
+}
+
+std::string ThumbnailCache::filePath(const std::string &route) {
+  return segment_cache::routeDir(route) + "/thumbnails";
+}
+
+void ThumbnailCache::addQLog(std::shared_ptr<LogReader> qlog) {
+  if (qlog->events.empty()) return;
+
+  QtConcurrent::run(&pool_, [this, qlog]() {
+    const uint64_t begin = qlog->events.front().mono_time;
+    if (blocks_.count(begin)) return;
+
+    std::vector<Thumbnail> thumbnails;
+    for (const Event &e : qlog->events) {
+      if (e.which == cereal::Event::Which::THUMBNAIL) {
+        capnp::FlatArrayMessageReader reader(e.data);
+        auto thumb = reader.getRoot<cereal::Event>().getThumbnail();
+        auto data = thumb.getThumbnail();
+        if (QImage image; image.loadFromData(data.begin(), data.size(), "jpeg")) {
+          QByteArray jpeg;
+          QBuffer buffer(&jpeg);
+          buffer.open(QIODevice::WriteOnly);
+          image.scaledToHeight(height_, Qt::SmoothTransformation).save(&buffer, "jpeg");
+          thumbnails.push_back({thumb.getTimestampEof(), jpeg});
+        }
+      }
+    }
+    append(begin, qlog->events.back().mono_time, thumbnails);
+  });
+}
+
+void ThumbnailCache::add(uint64_t begin, uint64_t end, std::vector<Thumbnail> thumbnails) {
+  QtConcurrent::run(&pool_, [this, begin, end, thumbnails = std::move(thumbnails)]() {
+    if (!blocks_.count(begin)) {
+      append(begin, end, thumbnails);
+    }
+  });
+}
+
+// called in the worker
+void ThumbnailCache::append(uint64_t begin, uint64_t end, const std::vector<Thumbnail> &thumbnails) {
+  BlockHeader h = {.count = (uint32_t)thumbnails.size(), .begin = begin, .end = end};
+  memcpy(h.magic, MAGIC, sizeof(MAGIC));
+  h.size = sizeof(h) + thumbnails.size() * sizeof(BlockEntry);
+  for (const auto &t : thumbnails) h.size += t.jpeg.size();
+
+  std::string buf(h.size, '\0');
+  memcpy(buf.data(), &h, sizeof(h));
+  uint64_t offset = sizeof(h) + thumbnails.size() * sizeof(BlockEntry);
+  for (size_t i = 0; i < thumbnails.size(); ++i) {
+    BlockEntry e = {.mono_time = thumbnails[i].mono_time, .offset = offset, .size = (uint64_t)thumbnails[i].jpeg.size()};
+    memcpy(buf.data() + sizeof(h) + i * sizeof(e), &e, sizeof(e));
+    memcpy(buf.data() + offset, thumbnails[i].jpeg.data(), e.size);
+    offset += e.size;
+  }
+
+  // blocks are only appended, so the mapped part of the file never changes
+  size_t pos = file_.rfind('/');
+  if (pos != std::string::npos) {
+    util::create_directories(file_.substr(0, pos), 0755);
+  }
+  if (util::write_file(file_.c_str(), buf.data(), buf.size(), O_WRONLY | O_CREAT | O_APPEND) == 0) {
+    blocks_.insert(begin);
+    emit appended();
+  }
+}
+
+void ThumbnailCache::reload() {
+  struct stat st = {};
+  if (stat(file_.c_str(), &st) != 0 || (size_t)st.st_size <= scanned_) return;
+
+  int fd = HANDLE_EINTR(open(file_.c_str(), O_RDONLY));
+  if (fd == -1) return;
+  void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) return;
+
+  if (map_) munmap((void *)map_, map_size_);
+  map_ = (const char *)addr;
+  map_size_ = st.st_size;
+
+  BlockHeader h;
+  while (size_t block_size = validBlock(map_ + scanned_, map_size_ - scanned_, h)) {
+    for (uint32_t i = 0; i < h.count; ++i) {
+      BlockEntry e;
+      memcpy(&e, map_ + scanned_ + sizeof(h) + i * sizeof(e), sizeof(e));
+      index_[e.mono_time] = {.offset = scanned_ + e.offset, .size = e.size};
+    }
+    scanned_ += block_size;
+  }
+  emit updated();
+}
+
+QByteArray ThumbnailCache::jpeg(uint64_t mono_time) const {
+  auto it = index_.lower_bound(mono_time);
+  return it != index_.end() ? QByteArray::fromRawData(map_ + it->second.offset, it->second.size) : QByteArray();
+}
+
+QPixmap ThumbnailCache::thumbnail(uint64_t mono_time) {
+  auto it = index_.lower_bound(mono_time);
+  if (it == index_.end()) return {};
+
+  if (QPixmap *pm = pixmaps_.object(it->first)) return *pm;
+
+  auto pm = std::make_unique<QPixmap>();
+  if (!pm->loadFromData((const uchar *)map_ + it->second.offset, it->second.size, "jpeg")) return {};
+
+  QPixmap result = *pm;
+  if (it->first >= visible_range_.first && it->first <= visible_range_.second) {
+    pixmaps_.insert(it->first, pm.release(), std::max(1, result.width() * result.height() * 4 / 1024));
+  }
+  return result;
+}
+
+void ThumbnailCache::setVisibleRange(uint64_t begin, uint64_t end) {
+  visible_range_ = {begin, end};
+  for (uint64_t key : pixmaps_.keys()) {
+    if (key < begin || key > end) pixmaps_.remove(key);
+  }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <QByteArray>
+#include <QCache>
+#include <QObject>
+#include <QPixmap>
+#include <QThreadPool>
+
+#include "tools/replay/logreader.h"
+
+// The timeline thumbnails of a route, kept as scaled JPEGs in one memory-mapped file next
+// to the segment cache. Each segment's qlog is decoded and appended as a block on a worker
+// thread, and a qlog already in the file is skipped when the route is opened again.
+// Pixmaps are decoded on demand and only kept for the visible part of the timeline.
+class ThumbnailCache : public QObject {
+  Q_OBJECT
+
+public:
+  struct Thumbnail {
+    uint64_t mono_time;
+    QByteArray jpeg;
+  };
+
+  ThumbnailCache(const std::string &file, int height, QObject *parent = nullptr);
+  ~ThumbnailCache();
+  static std::string filePath(const std::string &route);
+
+  // Decodes and scales the thumbnails of a segment's qlog in the background.
+  void addQLog(std::shared_ptr<LogReader> qlog);
+  // Appends the thumbnails between begin and end in the background, unless a block for
+  // begin is in the file already.
+  void add(uint64_t begin, uint64_t end, std::vector<Thumbnail> thumbnails);
+  inline size_t size() const { return index_.size(); }
+  // The encoded and the decoded thumbnail at or after mono_time.
+  QByteArray jpeg(uint64_t mono_time) const;
+  QPixmap thumbnail(uint64_t mono_time);
+  // Drops the decoded pixmaps outside [begin, end].
+  void setVisibleRange(uint64_t begin, uint64_t end);
+
+signals:
+  void appended();
+  void updated();
+
+private:
+  struct Entry {
+    uint64_t offset;  // in the file
+    uint64_t size;
+  };
+  // maps the grown file and indexes the blocks after the ones seen so far
+  void reload();
+  void append(uint64_t begin, uint64_t end, const std::vector<Thumbnail> &thumbnails);
+
+  const std::string file_;
+  const int height_;
+
+  // owned by the UI thread
+  const char *map_ = nullptr;
+  size_t map_size_ = 0;
+  size_t scanned_ = 0;
+  std::map<uint64_t, Entry> index_;
+  QCache<uint64_t, QPixmap> pixmaps_;
+  std::pair<uint64_t, uint64_t> visible_range_ = {0, UINT64_MAX};
+
+  // owned by the worker, which runs one task at a time
+  QThreadPool pool_;
+  std::set<uint64_t> blocks_;
+};
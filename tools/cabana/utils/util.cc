@@ -16,37 +16,104 @@
 
 #include "selfdrive/ui/qt/util.h"
 
-// SegmentTree
+// MinMaxPyramid
 
-void SegmentTree::build(const std::vector<QPointF> &arr) {
-  size = arr.size();
-  tree.resize(4 * size);  // size of the tree is 4 times the size of the array
-  if (size > 0) {
-    build_tree(arr, 1, 0, size - 1);
+void MinMaxPyramid::build(const std::vector<QPointF> &points) {
+  levels.clear();
+  count = 0;
+  append(points);
+}
+
+void MinMaxPyramid::append(const std::vector<QPointF> &points) {
+  size_t first = count;  // first changed element of the level below
+  size_t below_size = points.size();
+  count = points.size();
+  for (size_t level = 0; below_size > 1; ++level) {
+    if (level == levels.size()) {
+      levels.emplace_back();
+      first = 0;
+    }
+    auto below = [&](size_t i) -> Bucket {
+      return level == 0 ? Bucket{(uint32_t)i, (uint32_t)i} : levels[level - 1][i];
+    };
+    auto &buckets = levels[level];
+    const size_t size = (below_size + FACTOR - 1) / FACTOR;
+    buckets.resize(size);
+    // only the buckets covering new elements change
+    for (size_t b = first / FACTOR; b < size; ++b) {
+      Bucket bucket = below(b * FACTOR);
+      for (size_t i = b * FACTOR + 1; i < std::min((b + 1) * FACTOR, below_size); ++i) {
+        const Bucket e = below(i);
+        if (points[e.min].y() < points[bucket.min].y()) bucket.min = e.min;
+        if (points[e.max].y() > points[bucket.max].y()) bucket.max = e.max;
+      }
+      buckets[b] = bucket;
+    }
+    first /= FACTOR;
+    below_size = size;
   }
 }
 
-void SegmentTree::build_tree(const std::vector<QPointF> &arr, int n, int left, int right) {
-  if (left == right) {
-    const double y = arr[left].y();
-    tree[n] = {y, y};
-  } else {
-    const int mid = (left + right) >> 1;
-    build_tree(arr, 2 * n, left, mid);
-    build_tree(arr, 2 * n + 1, mid + 1, right);
-    tree[n] = {std::min(tree[2 * n].first, tree[2 * n + 1].first), std::max(tree[2 * n].second, tree[2 * n + 1].second)};
+std::pair<double, double> MinMaxPyramid::minmax(const std::vector<QPointF> &points, size_t first, size_t last) const {
+  last = std::min(last, count);
+  if (first >= last) return {std::numeric_limits<double>::max(), std::numeric_limits<double>::lowest()};
+  const Bucket b = extremes(points, first, last);
+  return {points[b.min].y(), points[b.max].y()};
+}
+
+MinMaxPyramid::Bucket MinMaxPyramid::extremes(const std::vector<QPointF> &points, size_t first, size_t last) const {
+  Bucket result = {(uint32_t)first, (uint32_t)first};
+  auto add = [&](int level, size_t i) {
+    const Bucket b = level < 0 ? Bucket{(uint32_t)i, (uint32_t)i} : levels[level][i];
+    if (points[b.min].y() < points[result.min].y()) result.min = b.min;
+    if (points[b.max].y() > points[result.max].y()) result.max = b.max;
+  };
+
+  // Walk up from the raw points, consuming the unaligned ends at each level.
+  for (int level = -1; first < last; ++level) {
+    if (level + 1 == (int)levels.size()) {
+      while (first < last) add(level, first++);
+      break;
+    }
+    while (first < last && first % FACTOR) add(level, first++);
+    while (first < last && last % FACTOR) add(level, --last);
+    first /= FACTOR;
+    last /= FACTOR;
   }
+  return result;
 }
 
-std::pair<double, double> SegmentTree::get_minmax(int n, int left, int right, int range_left, int range_right) const {
-  if (range_left > right || range_right < left)
-    return {std::numeric_limits<double>::max(), std::numeric_limits<double>::lowest()};
-  if (range_left <= left && range_right >= right)
-    return tree[n];
-  int mid = (left + right) >> 1;
-  auto l = get_minmax(2 * n, left, mid, range_left, range_right);
-  auto r = get_minmax(2 * n + 1, mid + 1, right, range_left, range_right);
-  return {std::min(l.first, r.first), std::max(l.second, r.second)};
+void MinMaxPyramid::downsample(const std::vector<QPointF> &points, size_t first, size_t last, size_t max_buckets,
+                               std::vector<QPointF> &out, bool bucket_ends) const {
+  last = std::min(last, count);
+  if (first >= last) return;
+  if (last - first <= 2 * max_buckets || levels.empty()) {
+    out.insert(out.end(), points.begin() + first, points.begin() + last);
+    return;
+  }
+
+  // lowest level with no more than max_buckets buckets in range
+  size_t level = 0, span = FACTOR;
+  while (level + 1 < levels.size() && (last - first) / span > max_buckets) {
+    ++level;
+    span *= FACTOR;
+  }
+
+  // keep the end points, and the extremes of each bucket in time order
+  out.push_back(points[first]);
+  for (size_t b = first / span; b <= (last - 1) / span; ++b) {
+    const size_t begin = std::max(first, b * span), end = std::min(last, (b + 1) * span);
+    // the buckets at the edges can be partly out of range, find their extremes in range
+    const Bucket bucket = begin == b * span && end == (b + 1) * span ? levels[level][b] : extremes(points, begin, end);
+    auto [lo, hi] = std::minmax(bucket.min, bucket.max);
+    size_t keep[] = {begin, lo, hi, end - 1};
+    const size_t *keep_end = std::unique(keep, keep + 4);
+    for (const size_t *i = keep; i != keep_end; ++i) {
+      if (!bucket_ends && (*i == begin || *i == end - 1) && *i != lo && *i != hi) continue;
+      if (*i > first && *i < last - 1) out.push_back(points[*i]);
+    }
+  }
+  out.push_back(points[last - 1]);
 }
 
 // MessageBytesDelegate
@@ -254,12 +321,6 @@ QString formatSeconds(double sec, bool include_milliseconds, bool absolute_time)
 
 }  // namespace utils
 
-int num_decimals(double num) {
-  const QString string = QString::number(num);
-  auto dot_pos = string.indexOf('.');
-  return dot_pos == -1 ? 0 : string.size() - dot_pos - 1;
-}
-
 QString signalToolTip(const cabana::Signal *sig) {
   return QObject::tr(R"(
     %1<br /><span font-size:small">
@@ -52,17 +52,35 @@ enum {
   BytesRole = Qt::UserRole + 2
 };
 
-class SegmentTree {
+// Min/max summary of a series at several resolutions. Each bucket of level n holds the
+// indices of the lowest and highest point among 4^(n+1) consecutive points, so a range can be
+// queried or drawn by visiting a bounded number of buckets. Indices refer to the vector
+// passed to build()/append(), which must outlive the pyramid's use.
+class MinMaxPyramid {
 public:
-  SegmentTree() = default;
-  void build(const std::vector<QPointF> &arr);
-  inline std::pair<double, double> minmax(int left, int right) const { return get_minmax(1, 0, size - 1, left, right); }
+  MinMaxPyramid() = default;
+  void build(const std::vector<QPointF> &points);
+  // Extends the pyramid with the points appended to the series since the last build/append.
+  void append(const std::vector<QPointF> &points);
+  // min and max y of points[first, last)
+  std::pair<double, double> minmax(const std::vector<QPointF> &points, size_t first, size_t last) const;
+  // Appends points[first, last) to out, reduced to the min and max of at most max_buckets buckets.
+  // With bucket_ends, the first and last point of each bucket are kept too, which a step line
+  // needs to hold the right value across buckets.
+  void downsample(const std::vector<QPointF> &points, size_t first, size_t last, size_t max_buckets,
+                  std::vector<QPointF> &out, bool bucket_ends = false) const;
+  size_t size() const { return count; }
 
 private:
-  std::pair<double, double> get_minmax(int n, int left, int right, int range_left, int range_right) const;
-  void build_tree(const std::vector<QPointF> &arr, int n, int left, int right);
-  std::vector<std::pair<double, double>> tree;
-  int size = 0;
+  static constexpr size_t FACTOR = 4;
+  struct Bucket {
+    uint32_t min;
+    uint32_t max;
+  };
+  // indices of the lowest and highest of points[first, last), first < last <= count
+  Bucket extremes(const std::vector<QPointF> &points, size_t first, size_t last) const;
+  std::vector<std::vector<Bucket>> levels;
+  size_t count = 0;
 };
 
 class MessageBytesDelegate : public QStyledItemDelegate {
@@ -161,5 +179,4 @@ private:
   QSocketNotifier *sn;
 };
 
-int num_decimals(double num);
 QString signalToolTip(const cabana::Signal *sig);
@@ -11,7 +11,6 @@
 #include <QStackedLayout>
 #include <QStyleOptionSlider>
 #include <QVBoxLayout>
-#include <QtConcurrent>
 
 #include "tools/cabana/streams/replaystream.h"
 
@@ -245,6 +244,9 @@ void VideoWidget::updatePlayBtnState() {
 
 Slider::Slider(QWidget *parent) : QSlider(Qt::Horizontal, parent) {
   thumbnail_label = new InfoLabel(parent);
+  thumbnails = new ThumbnailCache(ThumbnailCache::filePath(can->routeName().toStdString()),
+                                  MIN_VIDEO_HEIGHT - THUMBNAIL_MARGIN * 2, this);
+  QObject::connect(thumbnails, &ThumbnailCache::updated, this, qOverload<>(&Slider::update));
   setMouseTracking(true);
 }
 
@@ -256,37 +258,27 @@ AlertInfo Slider::alertInfo(double seconds) {
 }
 
 QPixmap Slider::thumbnail(double seconds)  {
-  auto it = thumbnails.lowerBound(can->toMonoTime(seconds));
-  return it != thumbnails.end() ? it.value() : QPixmap();
+  return thumbnails->thumbnail(can->toMonoTime(seconds));
 }
 
 void Slider::setTimeRange(double min, double max) {
   assert(min < max);
   setRange(min * factor, max * factor);
+  thumbnails->setVisibleRange(can->toMonoTime(min), can->toMonoTime(max));
 }
 
 void Slider::parseQLog(std::shared_ptr<LogReader> qlog) {
-  std::mutex mutex;
-  QtConcurrent::blockingMap(qlog->events.cbegin(), qlog->events.cend(), [&mutex, this](const Event &e) {
-    if (e.which == cereal::Event::Which::THUMBNAIL) {
-      capnp::FlatArrayMessageReader reader(e.data);
-      auto thumb = reader.getRoot<cereal::Event>().getThumbnail();
-      auto data = thumb.getThumbnail();
-      if (QPixmap pm; pm.loadFromData(data.begin(), data.size(), "jpeg")) {
-        QPixmap scaled = pm.scaledToHeight(MIN_VIDEO_HEIGHT - THUMBNAIL_MARGIN * 2, Qt::SmoothTransformation);
-        std::lock_guard lk(mutex);
-        thumbnails[thumb.getTimestampEof()] = scaled;
-      }
-    } else if (e.which == cereal::Event::Which::CONTROLS_STATE) {
+  thumbnails->addQLog(qlog);
+  for (const Event &e : qlog->events) {
+    if (e.which == cereal::Event::Which::CONTROLS_STATE) {
       capnp::FlatArrayMessageReader reader(e.data);
       auto cs = reader.getRoot<cereal::Event>().getControlsState();
       if (cs.getAlertType().size() > 0 && cs.getAlertText1().size() > 0 &&
           cs.getAlertSize() != cereal::ControlsState::AlertSize::NONE) {
-        std::lock_guard lk(mutex);
         alerts.emplace(e.mono_time, AlertInfo{cs.getAlertStatus(), cs.getAlertText1().cStr(), cs.getAlertText2().cStr()});
       }
     }
-  });
+  }
   update();
 }
 
@@ -14,6 +14,7 @@
 #include <QTabBar>
 
 #include "selfdrive/ui/qt/widgets/cameraview.h"
+#include "tools/cabana/utils/thumbnailcache.h"
 #include "tools/cabana/utils/util.h"
 #include "tools/replay/logreader.h"
 
@@ -54,7 +55,7 @@ private:
   bool event(QEvent *event) override;
   void paintEvent(QPaintEvent *ev) override;
 
-  QMap<uint64_t, QPixmap> thumbnails;
+  ThumbnailCache *thumbnails;
   std::map<uint64_t, AlertInfo> alerts;
   InfoLabel *thumbnail_label;
 };
@@ -58,7 +58,9 @@ class _LogFileReader:
       dat = bz2.decompress(dat)
     elif ext == ".zst" or dat.startswith(b'\x28\xB5\x2F\xFD'):
       # https://github.com/facebook/zstd/blob/dev/doc/zstd_compression_format.md#zstandard-frames
-      dat = zstd.decompress(dat)
+      # logs written by loggerd are split into several frames, followed by a seek table
+      with zstd.ZstdDecompressor().stream_reader(dat, read_across_frames=True) as reader:
+        dat = reader.read()
 
     ents = capnp_log.Event.read_multiple_bytes(dat)
 
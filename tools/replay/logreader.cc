@@ -1,7 +1,9 @@
 #include "tools/replay/logreader.h"
 
 #include <algorithm>
+#include <cstring>
 #include <utility>
+
 #include "tools/replay/filereader.h"
 #include "tools/replay/util.h"
 #include "common/util.h"
@@ -27,11 +29,17 @@ bool LogReader::load(const char *data, size_t size, std::atomic<bool> *abort) {
     events.reserve(65000);
     kj::ArrayPtr<const capnp::word> words((const capnp::word *)data, size / sizeof(capnp::word));
     while (words.size() > 0 && !(abort && *abort)) {
-      capnp::FlatArrayMessageReader reader(words);
-      auto event = reader.getRoot<cereal::Event>();
-      auto which = event.which();
-      auto event_data = kj::arrayPtr(words.begin(), reader.getEnd());
-      words = kj::arrayPtr(reader.getEnd(), words.end());
+      cereal::Event::Which which;
+      uint64_t mono_time;
+      kj::ArrayPtr<const capnp::word> event_data;
+      if (!scanEvent(words, &which, &mono_time, &event_data)) {
+        capnp::FlatArrayMessageReader reader(words);
+        auto event = reader.getRoot<cereal::Event>();
+        which = event.which();
+        mono_time = event.getLogMonoTime();
+        event_data = kj::arrayPtr(words.begin(), reader.getEnd());
+      }
+      words = kj::arrayPtr(event_data.end(), words.end());
 
       if (!filters_.empty()) {
         if (which >= filters_.size() || !filters_[which])
@@ -41,12 +49,13 @@ bool LogReader::load(const char *data, size_t size, std::atomic<bool> *abort) {
         event_data = kj::arrayPtr((const capnp::word *)buf, event_data.size());
       }
 
-      uint64_t mono_time = event.getLogMonoTime();
       const Event &evt = events.emplace_back(which, mono_time, event_data);
       // Add encodeIdx packet again as a frame packet for the video stream
       if (evt.which == cereal::Event::ROAD_ENCODE_IDX ||
           evt.which == cereal::Event::DRIVER_ENCODE_IDX ||
           evt.which == cereal::Event::WIDE_ROAD_ENCODE_IDX) {
+        capnp::FlatArrayMessageReader reader(event_data);
+        auto event = reader.getRoot<cereal::Event>();
         auto idx = capnp::AnyStruct::Reader(event).getPointerSection()[0].getAs<cereal::EncodeIndex>();
         if (idx.getType() == cereal::EncodeIndex::Type::FULL_H_E_V_C) {
           uint64_t sof = idx.getTimestampSof();
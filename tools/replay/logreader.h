@@ -4,6 +4,7 @@
 #include <vector>
 
 #include "cereal/gen/cpp/log.capnp.h"
+#include "cereal/messaging/messaging.h"
 #include "system/camerad/cameras/camera_common.h"
 #include "tools/replay/util.h"
 
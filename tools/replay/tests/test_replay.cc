@@ -4,6 +4,7 @@
 #include <QEventLoop>
 
 #include "catch2/catch.hpp"
+#include "common/timing.h"
 #include "common/util.h"
 #include "tools/replay/replay.h"
 #include "tools/replay/util.h"
@@ -71,6 +72,88 @@ TEST_CASE("LogReader") {
   }
 }
 
+std::string read_test_rlog() {
+  FileReader reader(true);
+  return decompressBZ2(reader.read(TEST_RLOG_URL));
+}
+
+TEST_CASE("scanEvent") {
+  std::string content = read_test_rlog();
+  REQUIRE(!content.empty());
+
+  size_t scanned = 0;
+  kj::ArrayPtr<const capnp::word> words((const capnp::word *)content.data(), content.size() / sizeof(capnp::word));
+  while (words.size() > 0) {
+    capnp::FlatArrayMessageReader reader(words);
+    auto event = reader.getRoot<cereal::Event>();
+
+    cereal::Event::Which which;
+    uint64_t mono_time;
+    kj::ArrayPtr<const capnp::word> event_data;
+    if (scanEvent(words, &which, &mono_time, &event_data)) {
+      REQUIRE(which == event.which());
+      REQUIRE(mono_time == event.getLogMonoTime());
+      REQUIRE(event_data.end() == reader.getEnd());
+      ++scanned;
+    }
+    words = kj::arrayPtr(reader.getEnd(), words.end());
+  }
+  REQUIRE(scanned > 0);
+
+  SECTION("truncated message") {
+    kj::ArrayPtr<const capnp::word> all((const capnp::word *)content.data(), content.size() / sizeof(capnp::word));
+    capnp::FlatArrayMessageReader reader(all);
+    size_t first_size = reader.getEnd() - all.begin();
+
+    cereal::Event::Which which;
+    uint64_t mono_time;
+    kj::ArrayPtr<const capnp::word> event_data;
+    REQUIRE_FALSE(scanEvent(all.slice(0, 0), &which, &mono_time, &event_data));
+    REQUIRE_FALSE(scanEvent(all.slice(0, first_size - 1), &which, &mono_time, &event_data));
+    REQUIRE(scanEvent(all.slice(0, first_size), &which, &mono_time, &event_data));
+  }
+}
+
+TEST_CASE("scanEvent benchmark", "[.benchmark]") {
+  std::string content = read_test_rlog();
+  REQUIRE(!content.empty());
+  const kj::ArrayPtr<const capnp::word> all((const capnp::word *)content.data(), content.size() / sizeof(capnp::word));
+  const int iterations = 10;
+
+  size_t count = 0;
+  uint64_t checksum = 0;
+  double start = millis_since_boot();
+  for (int i = 0; i < iterations; ++i) {
+    for (auto words = all; words.size() > 0; ++count) {
+      capnp::FlatArrayMessageReader reader(words);
+      auto event = reader.getRoot<cereal::Event>();
+      checksum += event.which() + event.getLogMonoTime();
+      words = kj::arrayPtr(reader.getEnd(), words.end());
+    }
+  }
+  double reader_ms = millis_since_boot() - start;
+  printf("FlatArrayMessageReader: %zu msgs in %.2f ms, %.0f msgs/s\n", count, reader_ms, count / (reader_ms / 1000.0));
+
+  size_t scan_count = 0;
+  uint64_t scan_checksum = 0;
+  start = millis_since_boot();
+  for (int i = 0; i < iterations; ++i) {
+    for (auto words = all; words.size() > 0; ++scan_count) {
+      cereal::Event::Which which;
+      uint64_t mono_time;
+      kj::ArrayPtr<const capnp::word> event_data;
+      REQUIRE(scanEvent(words, &which, &mono_time, &event_data));
+      scan_checksum += which + mono_time;
+      words = kj::arrayPtr(event_data.end(), words.end());
+    }
+  }
+  double scan_ms = millis_since_boot() - start;
+  printf("scanEvent: %zu msgs in %.2f ms, %.0f msgs/s\n", scan_count, scan_ms, scan_count / (scan_ms / 1000.0));
+
+  REQUIRE(scan_count == count);
+  REQUIRE(scan_checksum == checksum);
+}
+
 void read_segment(int n, const SegmentFile &segment_file, uint32_t flags) {
   QEventLoop loop;
   Segment segment(n, segment_file, flags);